@@ -0,0 +1,521 @@
+/*
+ * bench.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * audio-tool-bench: times the hot kernels on synthetic buffers, with no
+ * sound card.  Prints one tab-separated line per case:
+ *
+ *	bench case unit count ns/unit units/s cycles/unit
+ *
+ * A unit is a frame for the DSP kernels, and one call for the parsers
+ * and lookups.  Cycles come from a perf_event_open() counter, else the
+ * time stamp counter on x86, else they are 0; the header says which.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "oscillator-table.h"
+#include "tone-generator.h"
+#include "format-convert.h"
+#include "wav-reader.h"
+#include "mixer_cache.h"
+
+#ifndef VERSION_STR
+#define VERSION_STR "unknown"
+#endif
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS "unknown"
+#endif
+
+/* Each case is timed in BENCH_REPEATS runs of about BENCH_RUN_NS, and
+ * the fastest run is reported, being the one least disturbed. */
+#define BENCH_RUN_NS 20000000LL
+#define BENCH_REPEATS 5
+
+#define PERIOD_FRAMES 1024
+#define MAX_CHANNELS 16
+#define RATE 48000
+
+enum cycle_source {
+	CYCLES_NONE,
+	CYCLES_PERF,
+	CYCLES_TSC,
+};
+
+static const char *cycle_source_names[] = {
+	[CYCLES_NONE] = "none",
+	[CYCLES_PERF] = "perf",
+	[CYCLES_TSC] = "tsc",
+};
+
+struct bench {
+	const char *filter;	/* only cases with this in their name */
+	enum cycle_source cycles;
+	int perf_fd;
+};
+
+/* What a case does once; returns the units it did */
+typedef unsigned (*bench_func)(void *arg);
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void cycles_init(struct bench *b)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	b->perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (b->perf_fd >= 0) {
+		b->cycles = CYCLES_PERF;
+		return;
+	}
+#if defined(__i386__) || defined(__x86_64__)
+	b->cycles = CYCLES_TSC;
+#else
+	b->cycles = CYCLES_NONE;
+#endif
+}
+
+static uint64_t cycles_now(struct bench *b)
+{
+	uint64_t count = 0;
+
+	switch (b->cycles) {
+	case CYCLES_PERF:
+		if (read(b->perf_fd, &count, sizeof(count)) != sizeof(count))
+			count = 0;
+		break;
+	case CYCLES_TSC:
+#if defined(__i386__) || defined(__x86_64__)
+		count = __rdtsc();
+#endif
+		break;
+	default:
+		break;
+	}
+	return count;
+}
+
+static void bench_run(struct bench *b, const char *name, const char *unit,
+		      bench_func func, void *arg)
+{
+	uint64_t units, best_units = 0, cycles, best_cycles = 0;
+	int64_t start, ns, best_ns = 0;
+	uint64_t c0;
+	int r;
+
+	if (b->filter && !strstr(name, b->filter))
+		return;
+
+	/* warm the caches and the branch predictors */
+	func(arg);
+
+	for (r = 0 ; r < BENCH_REPEATS ; ++r) {
+		units = 0;
+		c0 = cycles_now(b);
+		start = now_ns();
+		do {
+			units += func(arg);
+			ns = now_ns() - start;
+		} while (ns < BENCH_RUN_NS);
+		cycles = cycles_now(b) - c0;
+
+		if (!best_units || (ns * best_units < best_ns * units)) {
+			best_units = units;
+			best_ns = ns;
+			best_cycles = cycles;
+		}
+	}
+
+	printf("%s\t%s\t%llu\t%.3f\t%.0f\t%.2f\n", name, unit,
+	       (unsigned long long)best_units, (double)best_ns / best_units,
+	       best_units * 1e9 / best_ns, (double)best_cycles / best_units);
+	fflush(stdout);
+}
+
+/* Tone rendering: every wave table, format and channel layout */
+
+struct osc_case {
+	struct oscillator osc;
+	void *buf;
+};
+
+static unsigned bench_oscillator(void *arg)
+{
+	struct osc_case *c = arg;
+
+	oscillator_render(&c->osc, c->buf, PERIOD_FRAMES);
+	return PERIOD_FRAMES;
+}
+
+static void bench_oscillators(struct bench *b, void *buf)
+{
+	static const unsigned channels[] = { 1, 2, 3, 6, 8, 16 };
+	static const int bits[] = { 8, 16, 24, 32 };
+	/* the low tone steps less than an entry a frame, so interpolates */
+	static const char *freqs[] = { "997", "31" };
+	const struct wave_table *tbl;
+	struct osc_case c;
+	struct tone tone;
+	char name[128];
+	unsigned ch, bi, fi;
+
+	c.buf = buf;
+	for (tbl = tone_wave_tables() ; tbl->name ; ++tbl) {
+		for (fi = 0 ; fi < STATIC_ARRAY_SIZE(freqs) ; ++fi) {
+			if (tone_init(&tone, tbl->name, freqs[fi], "3", RATE))
+				continue;
+			for (bi = 0 ; bi < STATIC_ARRAY_SIZE(bits) ; ++bi) {
+				for (ch = 0 ; ch < STATIC_ARRAY_SIZE(channels) ; ++ch) {
+					oscillator_init(&c.osc, tone.table,
+						tone.scale, tone.volume,
+						channels[ch], ~0, bits[bi]);
+					snprintf(name, sizeof(name),
+						 "oscillator\t%s %s Hz s%d %uch (%s)",
+						 tbl->name, freqs[fi], bits[bi],
+						 channels[ch], c.osc.kernel);
+					bench_run(b, name, "frame",
+						  bench_oscillator, &c);
+				}
+			}
+		}
+	}
+}
+
+/* Sample format conversion, as play and cap do it */
+
+struct convert_case {
+	struct format_convert fc;
+	unsigned channels;
+	void *src, *dst;
+};
+
+static unsigned bench_convert(void *arg)
+{
+	struct convert_case *c = arg;
+
+	format_convert(&c->fc, c->dst, c->src, PERIOD_FRAMES * c->channels);
+	return PERIOD_FRAMES;
+}
+
+static void bench_converts(struct bench *b, void *src, void *dst)
+{
+	static const enum sample_format formats[] = {
+		SAMPLE_FORMAT_S16_LE, SAMPLE_FORMAT_S24_3LE,
+		SAMPLE_FORMAT_S32_LE, SAMPLE_FORMAT_FLOAT_LE,
+	};
+	struct convert_case c;
+	char name[128];
+	unsigned from, to;
+	int dither;
+
+	c.src = src;
+	c.dst = dst;
+	c.channels = 2;
+	for (from = 0 ; from < STATIC_ARRAY_SIZE(formats) ; ++from) {
+		for (to = 0 ; to < STATIC_ARRAY_SIZE(formats) ; ++to) {
+			for (dither = 0 ; dither < 2 ; ++dither) {
+				if ((from == to) || (dither &&
+				    (sample_format_bits(formats[to]) >=
+				     sample_format_bits(formats[from]))))
+					continue;
+				format_convert_init(&c.fc, formats[from],
+						    formats[to], dither);
+				snprintf(name, sizeof(name),
+					 "convert\t%s to %s %uch%s",
+					 sample_format_name(formats[from]),
+					 sample_format_name(formats[to]),
+					 c.channels, dither ? " dither" : "");
+				bench_run(b, name, "frame", bench_convert, &c);
+			}
+		}
+	}
+}
+
+/* WAV parsing: opening a file indexes all of its chunks */
+
+static void put_le16(unsigned char *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static int put_chunk(int fd, const char *id, const void *data, uint32_t size)
+{
+	unsigned char hdr[8];
+	static const char pad;
+
+	memcpy(hdr, id, 4);
+	put_le32(hdr + 4, size);
+	if ((write(fd, hdr, 8) != 8) ||
+	    (write(fd, data, size) != (ssize_t)size) ||
+	    ((size & 1) && (write(fd, &pad, 1) != 1)))
+		return errno ? errno : EIO;
+	return 0;
+}
+
+/* Writes a 16-bit stereo file with a data chunk of the given frames,
+ * after num_extra chunks that a reader must skip */
+static int write_wav(const char *path, unsigned frames, unsigned num_extra,
+		     const void *data)
+{
+	unsigned char riff[12], fmt[16], extra[37];
+	uint32_t data_bytes = frames * 4;
+	uint32_t size = 4 + (8 + sizeof(fmt)) + (8 + data_bytes) +
+		num_extra * (8 + sizeof(extra) + 1);
+	unsigned i;
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return errno;
+
+	memcpy(riff, "RIFF", 4);
+	put_le32(riff + 4, size);
+	memcpy(riff + 8, "WAVE", 4);
+	put_le16(fmt, WAV_FORMAT_PCM);
+	put_le16(fmt + 2, 2);
+	put_le32(fmt + 4, RATE);
+	put_le32(fmt + 8, RATE * 4);
+	put_le16(fmt + 12, 4);
+	put_le16(fmt + 14, 16);
+	memset(extra, 'x', sizeof(extra));
+
+	if (write(fd, riff, sizeof(riff)) != sizeof(riff))
+		ret = errno ? errno : EIO;
+	if (!ret)
+		ret = put_chunk(fd, "fmt ", fmt, sizeof(fmt));
+	for (i = 0 ; !ret && (i < num_extra) ; ++i)
+		ret = put_chunk(fd, (i & 1) ? "LIST" : "JUNK", extra,
+				sizeof(extra));
+	if (!ret)
+		ret = put_chunk(fd, "data", data, data_bytes);
+
+	close(fd);
+	return ret;
+}
+
+struct wav_case {
+	const char *path;
+	int error;
+};
+
+static unsigned bench_wav_open(void *arg)
+{
+	struct wav_case *c = arg;
+	struct wav_reader r;
+
+	if (wav_reader_open(&r, c->path))
+		c->error = 1;
+	else
+		wav_reader_close(&r);
+	return 1;
+}
+
+static void bench_wavs(struct bench *b, const void *data)
+{
+	static const unsigned extras[] = { 0, 16, 256 };
+	char path[PATH_MAX], name[128];
+	const char *tmp = getenv("TMPDIR");
+	struct wav_case c;
+	unsigned i;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/audio-tool-bench-%d.wav",
+		 tmp ? tmp : "/tmp", (int)getpid());
+	c.path = path;
+
+	for (i = 0 ; i < STATIC_ARRAY_SIZE(extras) ; ++i) {
+		ret = write_wav(path, PERIOD_FRAMES, extras[i], data);
+		if (ret) {
+			fprintf(stderr, "Unable to write %s (%s)\n", path,
+				strerror(ret));
+			break;
+		}
+		c.error = 0;
+		snprintf(name, sizeof(name), "wav_reader_open\t%u chunks",
+			 extras[i] + 2);
+		bench_run(b, name, "call", bench_wav_open, &c);
+		if (c.error)
+			fprintf(stderr, "wav_reader_open() failed on %s\n",
+				path);
+	}
+	unlink(path);
+}
+
+/* Mixer cache lookups, on a cache the size of a phone codec's */
+
+#define MIXER_CONTROLS 512
+
+struct mixer_case {
+	struct audio_tool_mixer_cache cache;
+	char name[AUDIO_TOOL_MIX_CTL_NAME_MAX];
+};
+
+static unsigned bench_mixer_lookup(void *arg)
+{
+	struct mixer_case *c = arg;
+
+	mixer_cache_get_id_by_name(&c->cache, c->name);
+	return 1;
+}
+
+static unsigned bench_mixer_audit(void *arg)
+{
+	struct mixer_case *c = arg;
+	size_t n;
+
+	mixer_cache_reset_touch(&c->cache);
+	for (n = 0 ; n < c->cache.count ; ++n)
+		mixer_cache_touch(&c->cache, n);
+	mixer_cache_audit_touch(&c->cache, 0);
+	return 1;
+}
+
+static void bench_mixer_cache(struct bench *b)
+{
+	static const unsigned positions[] = { 0, MIXER_CONTROLS / 2,
+					       MIXER_CONTROLS - 1 };
+	struct mixer_case c;
+	char name[128];
+	unsigned i;
+
+	mixer_cache_init(&c.cache);
+	c.cache.ctrls = calloc(MIXER_CONTROLS, sizeof(*c.cache.ctrls));
+	if (!c.cache.ctrls)
+		return;
+	c.cache.count = MIXER_CONTROLS;
+	for (i = 0 ; i < MIXER_CONTROLS ; ++i) {
+		c.cache.ctrls[i].id = i;
+		c.cache.ctrls[i].type = MIXER_CTL_TYPE_INT;
+		c.cache.ctrls[i].num_values = 1;
+		/* names that share long prefixes, as real ones do */
+		snprintf(c.cache.ctrls[i].name, sizeof(c.cache.ctrls[i].name),
+			 "DL1 Mixer Multimedia Playback Volume %u", i);
+	}
+
+	for (i = 0 ; i < STATIC_ARRAY_SIZE(positions) ; ++i) {
+		strcpy(c.name, c.cache.ctrls[positions[i]].name);
+		snprintf(name, sizeof(name),
+			 "mixer_cache_get_id_by_name\tcontrol %u of %u",
+			 positions[i] + 1, MIXER_CONTROLS);
+		bench_run(b, name, "call", bench_mixer_lookup, &c);
+	}
+	snprintf(name, sizeof(name), "mixer_cache_audit_touch\t%u controls",
+		 MIXER_CONTROLS);
+	bench_run(b, name, "call", bench_mixer_audit, &c);
+
+	mixer_cache_deinit(&c.cache);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b;
+	size_t size = PERIOD_FRAMES * MAX_CHANNELS * sizeof(float);
+	char *src, *dst;
+	size_t i;
+
+	if ((argc > 2) || ((argc == 2) && (argv[1][0] == '-'))) {
+		fprintf(stderr, "Usage: audio-tool-bench [filter]\n");
+		return 1;
+	}
+
+	memset(&b, 0, sizeof(b));
+	b.filter = (argc == 2) ? argv[1] : NULL;
+	cycles_init(&b);
+
+	src = malloc(size);
+	dst = malloc(size);
+	if (!src || !dst) {
+		fprintf(stderr, "Unable to allocate %zu bytes\n", 2 * size);
+		return 1;
+	}
+	/* Noise, so nothing takes a shortcut on silence.  It's made of
+	 * floats in [-0.5, 0.5], which is noise in the other formats too. */
+	srand(1);
+	for (i = 0 ; i < size / sizeof(float) ; ++i)
+		((float *)src)[i] = (float)(rand() - RAND_MAX / 2) / RAND_MAX;
+
+	printf("# audio-tool-bench %s, cflags \"%s\", cycles from %s\n",
+	       VERSION_STR, BENCH_CFLAGS, cycle_source_names[b.cycles]);
+	printf("bench\tcase\tunit\tcount\tns_per_unit\tunits_per_sec\t"
+	       "cycles_per_unit\n");
+
+	bench_oscillators(&b, dst);
+	bench_converts(&b, src, dst);
+	bench_wavs(&b, src);
+	bench_mixer_cache(&b);
+
+	free(src);
+	free(dst);
+	if (b.perf_fd >= 0)
+		close(b.perf_fd);
+	return 0;
+}
@@ -0,0 +1,526 @@
+/*
+ * caps.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "caps.h"
+#include "alsa-control.h"
+#include "format-convert.h"
+
+#define CAPS_VERSION 1
+
+static const unsigned int caps_rates[] = {
+	8000, 11025, 16000, 22050, 32000, 44100, 48000,
+	64000, 88200, 96000, 176400, 192000,
+};
+
+#define NUM_RATES (sizeof(caps_rates) / sizeof(caps_rates[0]))
+
+static int caps_compare(const void *a, const void *b)
+{
+	const struct caps_stream *sa = a, *sb = b;
+
+	if (sa->device != sb->device)
+		return (sa->device < sb->device) ? -1 : 1;
+	return sa->capture - sb->capture;
+}
+
+static int caps_probe_stream(struct caps_stream *s, unsigned int card,
+			     unsigned int device, int capture)
+{
+	struct pcm_params *params;
+	unsigned int i;
+
+	/* pcm_params_get() does not always set errno when it fails */
+	errno = 0;
+	params = pcm_params_get(card, device, capture ? PCM_IN : PCM_OUT);
+	if (!params)
+		return errno ? errno : EIO;
+
+	memset(s, 0, sizeof(*s));
+	s->device = device;
+	s->capture = capture;
+
+	for (i = 0; i < PCM_FORMAT_MAX; i++)
+		if (pcm_params_format_test(params, i))
+			s->formats |= 1 << i;
+
+	s->min_rate = pcm_params_get_min(params, PCM_PARAM_RATE);
+	s->max_rate = pcm_params_get_max(params, PCM_PARAM_RATE);
+	for (i = 0; i < NUM_RATES; i++)
+		if ((caps_rates[i] >= s->min_rate) &&
+		    (caps_rates[i] <= s->max_rate) &&
+		    pcm_params_test(params, PCM_PARAM_RATE, caps_rates[i]))
+			s->rates |= 1 << i;
+
+	s->min_channels = pcm_params_get_min(params, PCM_PARAM_CHANNELS);
+	s->max_channels = pcm_params_get_max(params, PCM_PARAM_CHANNELS);
+	s->min_period_size = pcm_params_get_min(params, PCM_PARAM_PERIOD_SIZE);
+	s->max_period_size = pcm_params_get_max(params, PCM_PARAM_PERIOD_SIZE);
+	s->min_period_bytes = pcm_params_get_min(params, PCM_PARAM_PERIOD_BYTES);
+	s->max_period_bytes = pcm_params_get_max(params, PCM_PARAM_PERIOD_BYTES);
+	s->min_period_time = pcm_params_get_min(params, PCM_PARAM_PERIOD_TIME);
+	s->max_period_time = pcm_params_get_max(params, PCM_PARAM_PERIOD_TIME);
+	s->min_periods = pcm_params_get_min(params, PCM_PARAM_PERIODS);
+	s->max_periods = pcm_params_get_max(params, PCM_PARAM_PERIODS);
+	s->min_buffer_size = pcm_params_get_min(params, PCM_PARAM_BUFFER_SIZE);
+	s->max_buffer_size = pcm_params_get_max(params, PCM_PARAM_BUFFER_SIZE);
+	s->min_buffer_bytes = pcm_params_get_min(params, PCM_PARAM_BUFFER_BYTES);
+	s->max_buffer_bytes = pcm_params_get_max(params, PCM_PARAM_BUFFER_BYTES);
+	s->mmap = pcm_params_mmap_test(params);
+
+	pcm_params_free(params);
+	return 0;
+}
+
+int caps_probe(struct caps *caps, unsigned int card)
+{
+	DIR *dir;
+	struct dirent *de;
+	unsigned int c, device;
+	char dir_char;
+	int ret;
+
+	memset(caps, 0, sizeof(*caps));
+	caps->card = card;
+	/* ah_card_get_name() returns -errno, this file returns errno */
+	ret = ah_card_get_name(card, caps->id, sizeof(caps->id) - 1);
+	if (ret)
+		return -ret;
+
+	dir = opendir(ALSA_DEVICE_DIRECTORY);
+	if (!dir)
+		return errno;
+
+	while ((de = readdir(dir)) && (caps->count < CAPS_MAX_STREAMS)) {
+		if ((sscanf(de->d_name, "pcmC%uD%u%c", &c, &device,
+			    &dir_char) != 3) || (c != card) ||
+		    ((dir_char != 'p') && (dir_char != 'c')))
+			continue;
+
+		ret = caps_probe_stream(&caps->streams[caps->count], card,
+					device, dir_char == 'c');
+		if (ret)
+			fprintf(stderr, "Unable to probe %s (%s)\n",
+				de->d_name, strerror(ret));
+		else
+			caps->count++;
+	}
+	closedir(dir);
+
+	qsort(caps->streams, caps->count, sizeof(caps->streams[0]),
+	      caps_compare);
+	return 0;
+}
+
+static int caps_dir(char *path, size_t len, int create)
+{
+	const char *env;
+	char base[PATH_MAX];
+
+	env = getenv("AUDIO_TOOL_CAPS_DIR");
+	if (env) {
+		snprintf(path, len, "%s", env);
+		if (create && mkdir(path, 0755) && (errno != EEXIST))
+			return errno;
+		return 0;
+	}
+
+	env = getenv("XDG_CACHE_HOME");
+	if (env) {
+		snprintf(base, sizeof(base), "%s", env);
+	} else {
+		env = getenv("HOME");
+		if (!env)
+			return ENOENT;
+		snprintf(base, sizeof(base), "%s/.cache", env);
+	}
+	snprintf(path, len, "%s/audio-tool", base);
+
+	if (create && ((mkdir(base, 0755) && (errno != EEXIST)) ||
+		       (mkdir(path, 0755) && (errno != EEXIST))))
+		return errno;
+	return 0;
+}
+
+static int caps_path(const char *id, char *path, size_t len, int create)
+{
+	char dir[PATH_MAX];
+	int ret;
+
+	ret = caps_dir(dir, sizeof(dir), create);
+	if (ret)
+		return ret;
+	snprintf(path, len, "%s/%s.caps", dir, id);
+	return 0;
+}
+
+int caps_save(const struct caps *caps)
+{
+	const struct caps_stream *s;
+	char path[PATH_MAX];
+	FILE *f;
+	unsigned int i;
+	int ret;
+
+	ret = caps_path(caps->id, path, sizeof(path), 1);
+	if (ret)
+		return ret;
+
+	f = fopen(path, "wt");
+	if (!f)
+		return errno;
+
+	fprintf(f, "# audio-tool caps, card %u\n", caps->card);
+	fprintf(f, "version %d\n", CAPS_VERSION);
+	for (i = 0; i < caps->count; i++) {
+		s = &caps->streams[i];
+		fprintf(f, "stream %u %c %x %x %u %u %u %u %u %u %u %u %u %u "
+			"%u %u %u %u %u %u %d\n", s->device,
+			s->capture ? 'c' : 'p', s->formats, s->rates,
+			s->min_rate, s->max_rate,
+			s->min_channels, s->max_channels,
+			s->min_period_size, s->max_period_size,
+			s->min_period_bytes, s->max_period_bytes,
+			s->min_period_time, s->max_period_time,
+			s->min_periods, s->max_periods,
+			s->min_buffer_size, s->max_buffer_size,
+			s->min_buffer_bytes, s->max_buffer_bytes, s->mmap);
+	}
+
+	ret = ferror(f) ? EIO : 0;
+	if (fclose(f) && !ret)
+		ret = errno;
+	return ret;
+}
+
+int caps_load(struct caps *caps, unsigned int card)
+{
+	struct caps_stream *s;
+	char path[PATH_MAX], line[256];
+	char dir_char;
+	FILE *f;
+	int version = 0, ret;
+
+	memset(caps, 0, sizeof(*caps));
+	caps->card = card;
+	/* ah_card_get_name() returns -errno, this file returns errno */
+	ret = ah_card_get_name(card, caps->id, sizeof(caps->id) - 1);
+	if (ret)
+		return -ret;
+
+	ret = caps_path(caps->id, path, sizeof(path), 0);
+	if (ret)
+		return ret;
+
+	f = fopen(path, "rt");
+	if (!f)
+		return errno;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "version %d", &version) == 1)
+			continue;
+		if ((version != CAPS_VERSION) ||
+		    (caps->count == CAPS_MAX_STREAMS))
+			break;
+
+		s = &caps->streams[caps->count];
+		if (sscanf(line, "stream %u %c %x %x %u %u %u %u %u %u %u %u "
+			   "%u %u %u %u %u %u %u %u %d", &s->device, &dir_char,
+			   &s->formats, &s->rates,
+			   &s->min_rate, &s->max_rate,
+			   &s->min_channels, &s->max_channels,
+			   &s->min_period_size, &s->max_period_size,
+			   &s->min_period_bytes, &s->max_period_bytes,
+			   &s->min_period_time, &s->max_period_time,
+			   &s->min_periods, &s->max_periods,
+			   &s->min_buffer_size, &s->max_buffer_size,
+			   &s->min_buffer_bytes, &s->max_buffer_bytes,
+			   &s->mmap) != 21)
+			continue;
+		s->capture = (dir_char == 'c');
+		caps->count++;
+	}
+	fclose(f);
+
+	/* an old or foreign file is as good as none */
+	if (version != CAPS_VERSION) {
+		caps->count = 0;
+		return ENOENT;
+	}
+	return 0;
+}
+
+const struct caps_stream *caps_find(const struct caps *caps,
+				    unsigned int device, unsigned int flags)
+{
+	unsigned int i;
+	int capture = !!(flags & PCM_IN);
+
+	for (i = 0; i < caps->count; i++)
+		if ((caps->streams[i].device == device) &&
+		    (caps->streams[i].capture == capture))
+			return &caps->streams[i];
+	return NULL;
+}
+
+static int caps_rate_ok(const struct caps_stream *s, unsigned int rate)
+{
+	unsigned int i;
+
+	if ((rate < s->min_rate) || (rate > s->max_rate))
+		return 0;
+	/* only the standard rates were asked about */
+	for (i = 0; i < NUM_RATES; i++)
+		if (caps_rates[i] == rate)
+			return !!(s->rates & (1 << i));
+	return 1;
+}
+
+static const char *caps_format_name(enum pcm_format format)
+{
+	return sample_format_name(sample_format_from_pcm(format));
+}
+
+int caps_fit(unsigned int card, unsigned int device, unsigned int flags,
+	     struct pcm_config *config)
+{
+	static struct caps caps;
+	const struct caps_stream *s = NULL;
+	unsigned int frame_bytes, min, max, count, min_buffer, max_buffer;
+	uint64_t frames;
+	int ret;
+
+	if (!caps_load(&caps, card))
+		s = caps_find(&caps, device, flags);
+	if (!s) {
+		ret = caps_probe(&caps, card);
+		if (ret) {
+			fprintf(stderr, "Unable to probe card %u (%s)\n", card,
+				strerror(ret));
+			return -1;
+		}
+		ret = caps_save(&caps);
+		if (ret)
+			fprintf(stderr, "Unable to cache the capabilities of "
+				"card %u (%s)\n", card, strerror(ret));
+		s = caps_find(&caps, device, flags);
+	}
+	if (!s) {
+		fprintf(stderr, "No capabilities for PCM device %u\n", device);
+		return -1;
+	}
+
+	if (!(s->formats & (1 << config->format))) {
+		fprintf(stderr, "PCM device %u doesn't do %s\n", device,
+			caps_format_name(config->format));
+		return -1;
+	}
+	if (!caps_rate_ok(s, config->rate)) {
+		fprintf(stderr, "PCM device %u doesn't do %u Hz\n", device,
+			config->rate);
+		return -1;
+	}
+	if ((config->channels < s->min_channels) ||
+	    (config->channels > s->max_channels)) {
+		fprintf(stderr, "PCM device %u doesn't do %u channels\n", device,
+			config->channels);
+		return -1;
+	}
+	if ((flags & PCM_MMAP) && !s->mmap) {
+		fprintf(stderr, "PCM device %u can't be mmap()ed\n", device);
+		return -1;
+	}
+
+	/* the byte and time limits bound the size in frames too */
+	frame_bytes = config->channels *
+		sample_format_bytes(sample_format_from_pcm(config->format));
+	min = s->min_period_size;
+	if (min < (s->min_period_bytes + frame_bytes - 1) / frame_bytes)
+		min = (s->min_period_bytes + frame_bytes - 1) / frame_bytes;
+	/* rounded up, or the period would be shorter than allowed */
+	frames = ((uint64_t)s->min_period_time * config->rate + 999999) /
+		1000000;
+	if (min < frames)
+		min = frames;
+	max = s->max_period_size;
+	if (max > s->max_period_bytes / frame_bytes)
+		max = s->max_period_bytes / frame_bytes;
+	frames = (uint64_t)s->max_period_time * config->rate / 1000000;
+	if (max > frames)
+		max = frames;
+	if (min > max) {
+		fprintf(stderr, "PCM device %u has no period size for this "
+			"format\n", device);
+		return -1;
+	}
+
+	min_buffer = s->min_buffer_size;
+	if (min_buffer < (s->min_buffer_bytes + frame_bytes - 1) / frame_bytes)
+		min_buffer = (s->min_buffer_bytes + frame_bytes - 1) /
+			frame_bytes;
+	max_buffer = s->max_buffer_size;
+	if (max_buffer > s->max_buffer_bytes / frame_bytes)
+		max_buffer = s->max_buffer_bytes / frame_bytes;
+
+	count = (s->min_periods > 2) ? s->min_periods : 2;
+	if (count > s->max_periods)
+		count = s->max_periods;
+	if ((uint64_t)min * count < min_buffer) {
+		count = (min_buffer + min - 1) / min;
+		/* too many periods that short: make them longer instead */
+		if (count > s->max_periods) {
+			count = s->max_periods;
+			min = (min_buffer + count - 1) / count;
+		}
+	}
+	if ((min > max) || ((uint64_t)min * count > max_buffer)) {
+		fprintf(stderr, "PCM device %u has no buffer size for this "
+			"format\n", device);
+		return -1;
+	}
+
+	config->period_size = min;
+	config->period_count = count;
+	printf("PCM device %u: %u periods of %u frames\n", device, count, min);
+	return 0;
+}
+
+static void caps_print_range(const char *name, unsigned int min,
+			     unsigned int max, const char *unit)
+{
+	if (min == max)
+		printf("    %-12s %u%s\n", name, min, unit);
+	else
+		printf("    %-12s %u..%u%s\n", name, min, max, unit);
+}
+
+static void caps_print(const struct caps *caps)
+{
+	const struct caps_stream *s;
+	unsigned int i, j;
+
+	printf("card %u (%s):\n", caps->card, caps->id);
+	for (i = 0; i < caps->count; i++) {
+		s = &caps->streams[i];
+		printf("  pcmC%uD%u%c: %s%s\n", caps->card, s->device,
+		       s->capture ? 'c' : 'p',
+		       s->capture ? "capture" : "playback",
+		       s->mmap ? ", mmap" : "");
+
+		printf("    %-12s", "formats:");
+		for (j = 0; j < PCM_FORMAT_MAX; j++)
+			if (s->formats & (1 << j))
+				printf(" %s", caps_format_name(j));
+		printf("\n");
+
+		printf("    %-12s", "rates:");
+		for (j = 0; j < NUM_RATES; j++)
+			if (s->rates & (1 << j))
+				printf(" %u", caps_rates[j]);
+		printf(" (%u..%u)\n", s->min_rate, s->max_rate);
+
+		caps_print_range("channels:", s->min_channels,
+				 s->max_channels, "");
+		caps_print_range("period:", s->min_period_size,
+				 s->max_period_size, " frames");
+		caps_print_range("", s->min_period_bytes,
+				 s->max_period_bytes, " bytes");
+		caps_print_range("", s->min_period_time,
+				 s->max_period_time, " us");
+		caps_print_range("periods:", s->min_periods,
+				 s->max_periods, "");
+		caps_print_range("buffer:", s->min_buffer_size,
+				 s->max_buffer_size, " frames");
+		caps_print_range("", s->min_buffer_bytes,
+				 s->max_buffer_bytes, " bytes");
+	}
+}
+
+static int caps_card(unsigned int card)
+{
+	static struct caps caps;
+	int ret;
+
+	ret = caps_probe(&caps, card);
+	if (ret) {
+		fprintf(stderr, "Unable to probe card %u (%s)\n", card,
+			strerror(ret));
+		return ret;
+	}
+	caps_print(&caps);
+
+	ret = caps_save(&caps);
+	if (ret)
+		fprintf(stderr, "Unable to cache the capabilities of card %u "
+			"(%s)\n", card, strerror(ret));
+	return ret;
+}
+
+int caps_main(const struct audio_tool_config *config, int argc, char **argv)
+{
+	struct stat st;
+	char path[PATH_MAX];
+	unsigned int card;
+	int i, ret = 0;
+
+	/* named cards, else every card there is */
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			if (caps_card(atoi(argv[i])))
+				ret = 1;
+		return ret;
+	}
+
+	for (card = 0; card < (unsigned int)ah_card_max_count(); card++) {
+		snprintf(path, sizeof(path), SND_CONTROL_TEMPLATE, card);
+		if (!stat(path, &st) && caps_card(card))
+			ret = 1;
+	}
+
+	return ret;
+}
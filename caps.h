@@ -0,0 +1,101 @@
+/*
+ * caps.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_CAPS_H__
+#define __AUDIO_TOOL_CAPS_H__
+
+#include <tinyalsa/asoundlib.h>
+
+struct audio_tool_config;
+
+#define CAPS_ID_MAX 32
+#define CAPS_MAX_STREAMS 64
+
+/* What one stream (pcmC#D#p or pcmC#D#c) can do.  Sizes are in frames
+ * and times in us, as the driver reports them.
+ */
+struct caps_stream {
+	unsigned int device;
+	int capture;
+	unsigned int formats;		/* 1 << enum pcm_format */
+	unsigned int rates;		/* 1 << index into the standard rates */
+	unsigned int min_rate, max_rate;
+	unsigned int min_channels, max_channels;
+	unsigned int min_period_size, max_period_size;
+	unsigned int min_period_bytes, max_period_bytes;
+	unsigned int min_period_time, max_period_time;
+	unsigned int min_periods, max_periods;
+	unsigned int min_buffer_size, max_buffer_size;
+	unsigned int min_buffer_bytes, max_buffer_bytes;
+	int mmap;
+};
+
+struct caps {
+	unsigned int card;
+	char id[CAPS_ID_MAX];		/* the card's id, what the cache is keyed by */
+	unsigned int count;
+	struct caps_stream streams[CAPS_MAX_STREAMS];
+};
+
+/* Asks the driver what every stream of the card can do.  Streams that
+ * are busy are left out.  Returns 0 on success, errno on failure.
+ */
+int caps_probe(struct caps *caps, unsigned int card);
+
+/* Reads and writes the cache, a file per card id in $AUDIO_TOOL_CAPS_DIR,
+ * else $XDG_CACHE_HOME/audio-tool, else ~/.cache/audio-tool.  Return 0
+ * on success, errno on failure (ENOENT if the card was never probed).
+ */
+int caps_load(struct caps *caps, unsigned int card);
+int caps_save(const struct caps *caps);
+
+/* Returns the stream of the device in the direction of flags (PCM_IN or
+ * PCM_OUT), or NULL if there's none
+ */
+const struct caps_stream *caps_find(const struct caps *caps,
+				    unsigned int device, unsigned int flags);
+
+/* Checks the format, rate and channels of config against the cached
+ * capabilities (probing the card if it isn't cached yet), and sets its
+ * period size and count to the smallest the stream allows.  Prints why
+ * and returns -1 on failure.
+ */
+int caps_fit(unsigned int card, unsigned int device, unsigned int flags,
+	     struct pcm_config *config);
+
+int caps_main(const struct audio_tool_config *config, int argc, char **argv);
+
+#endif /* __AUDIO_TOOL_CAPS_H__ */
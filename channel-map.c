@@ -0,0 +1,211 @@
+/*
+ * channel-map.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channel-map.h"
+#include "simd.h"
+
+/* Masks are 32 bits wide */
+#define MAX_CHANNELS 32
+
+unsigned int channel_mask_count(uint32_t mask, unsigned int channels)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; (i < channels) && (i < MAX_CHANNELS); i++)
+		if (mask & (1U << i))
+			n++;
+
+	return n;
+}
+
+/* Lists the channels selected by mask; returns how many there are */
+static unsigned int mask_to_list(uint32_t mask, unsigned int channels,
+				 unsigned int *list)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; (i < channels) && (i < MAX_CHANNELS); i++)
+		if (mask & (1U << i))
+			list[n++] = i;
+
+	return n;
+}
+
+int channel_map_init(struct channel_map *map, unsigned int in_channels,
+		     uint32_t in_mask, unsigned int out_channels,
+		     uint32_t out_mask)
+{
+	unsigned int ins[MAX_CHANNELS], outs[MAX_CHANNELS];
+	unsigned int n, m, j, k, count;
+	void *mem;
+
+	memset(map, 0, sizeof(*map));
+	map->in_channels = in_channels;
+	map->out_channels = out_channels;
+
+	n = mask_to_list(in_mask, in_channels, ins);
+	m = mask_to_list(out_mask, out_channels, outs);
+	if (!n || !m || (out_channels > MAX_CHANNELS))
+		return EINVAL;
+
+	/* rows padded to whole vectors, and aligned for them */
+	map->stride = (in_channels + 3) & ~3;
+	if (posix_memalign(&mem, 16,
+			   out_channels * map->stride * sizeof(float)))
+		return ENOMEM;
+	map->gains = mem;
+	memset(map->gains, 0, out_channels * map->stride * sizeof(float));
+
+	map->select = malloc(out_channels * sizeof(int));
+	if (!map->select) {
+		free(map->gains);
+		map->gains = NULL;
+		return ENOMEM;
+	}
+	for (k = 0; k < out_channels; k++)
+		map->select[k] = -1;
+
+	for (k = 0; k < m; k++) {
+		if (n <= m) {
+			map->gains[outs[k] * map->stride + ins[k % n]] = 1.0f;
+			map->select[outs[k]] = ins[k % n];
+			continue;
+		}
+
+		count = 0;
+		for (j = k; j < n; j += m)
+			count++;
+		for (j = k; j < n; j += m)
+			map->gains[outs[k] * map->stride + ins[j]] = 1.0f / count;
+	}
+
+	map->is_select = (n <= m);
+	return 0;
+}
+
+void channel_map_deinit(struct channel_map *map)
+{
+	free(map->gains);
+	free(map->select);
+	map->gains = NULL;
+	map->select = NULL;
+}
+
+int channel_map_is_identity(const struct channel_map *map)
+{
+	unsigned int k;
+
+	if (!map->is_select || (map->in_channels != map->out_channels))
+		return 0;
+
+	for (k = 0; k < map->out_channels; k++)
+		if (map->select[k] != (int)k)
+			return 0;
+
+	return 1;
+}
+
+void channel_map_select(const struct channel_map *map, void *dst,
+			const void *src, unsigned int frames,
+			unsigned int sample_bytes)
+{
+	unsigned int in_ch = map->in_channels, out_ch = map->out_channels;
+	const int *select = map->select;
+	unsigned int f, k;
+
+	/* the common sample sizes get their own loops, so the copies are
+	 * plain loads and stores
+	 */
+	switch (sample_bytes) {
+	case 2: {
+		const int16_t *s = src;
+		int16_t *d = dst;
+
+		for (f = 0; f < frames; f++, s += in_ch, d += out_ch)
+			for (k = 0; k < out_ch; k++)
+				d[k] = (select[k] < 0) ? 0 : s[select[k]];
+		break;
+	}
+	case 4: {
+		const int32_t *s = src;
+		int32_t *d = dst;
+
+		for (f = 0; f < frames; f++, s += in_ch, d += out_ch)
+			for (k = 0; k < out_ch; k++)
+				d[k] = (select[k] < 0) ? 0 : s[select[k]];
+		break;
+	}
+	default: {
+		const uint8_t *s = src;
+		uint8_t *d = dst;
+
+		for (f = 0; f < frames; f++) {
+			for (k = 0; k < out_ch; k++, d += sample_bytes) {
+				if (select[k] < 0)
+					memset(d, 0, sample_bytes);
+				else
+					memcpy(d, s + select[k] * sample_bytes,
+					       sample_bytes);
+			}
+			s += in_ch * sample_bytes;
+		}
+		break;
+	}
+	}
+}
+
+void channel_map_mix(const struct channel_map *map, float *dst,
+		     const float *src, unsigned int frames)
+{
+	unsigned int in_ch = map->in_channels, out_ch = map->out_channels;
+	unsigned int f, k;
+
+	if (map->is_select) {
+		channel_map_select(map, dst, src, frames, sizeof(float));
+		return;
+	}
+
+	/* each output sample is one row of the matrix times the frame */
+	for (f = 0; f < frames; f++, src += in_ch, dst += out_ch)
+		for (k = 0; k < out_ch; k++)
+			dst[k] = simd_dot(map->gains + k * map->stride, src,
+					  in_ch);
+}
@@ -0,0 +1,91 @@
+/*
+ * channel-map.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_CHANNEL_MAP_H__
+#define __AUDIO_TOOL_CHANNEL_MAP_H__
+
+#include <stdint.h>
+
+/* Routes channels from one frame layout to another.
+ *
+ * in_mask picks the input channels that are used and out_mask the
+ * output channels that receive audio; other outputs are silent.  The
+ * n used inputs are connected to the m used outputs in order:
+ *
+ *   n == m   one to one (remap / extract, e.g. 2 of 8 TDM slots)
+ *   n < m    output k gets input k % n (duplicate, e.g. mono to all)
+ *   n > m    output k gets the average of inputs j with j % m == k
+ *            (downmix, e.g. stereo to mono)
+ *
+ * If every output is a copy of at most one input, the map is a
+ * selection and can be applied to samples of any format without
+ * conversion.  Otherwise it is a gain matrix applied to float frames.
+ */
+struct channel_map {
+	unsigned int in_channels;
+	unsigned int out_channels;
+
+	int *select;		/* input for each output, -1 for silence */
+	int is_select;
+
+	float *gains;		/* out_channels rows of 'stride' gains */
+	unsigned int stride;
+};
+
+/* Returns 0 on success, errno on failure (EINVAL if a mask selects no
+ * channels).
+ */
+int channel_map_init(struct channel_map *map, unsigned int in_channels,
+		     uint32_t in_mask, unsigned int out_channels,
+		     uint32_t out_mask);
+void channel_map_deinit(struct channel_map *map);
+
+/* True if frames pass through unchanged */
+int channel_map_is_identity(const struct channel_map *map);
+
+/* Applies a selection map to frames of sample_bytes-sized samples */
+void channel_map_select(const struct channel_map *map, void *dst,
+			const void *src, unsigned int frames,
+			unsigned int sample_bytes);
+
+/* Applies the map to float frames */
+void channel_map_mix(const struct channel_map *map, float *dst,
+		     const float *src, unsigned int frames);
+
+/* Number of channels a mask selects out of the given channels */
+unsigned int channel_mask_count(uint32_t mask, unsigned int channels);
+
+#endif /* __AUDIO_TOOL_CHANNEL_MAP_H__ */
@@ -36,8 +36,12 @@
 
 #include "config.h"
 #include "cmdline.h"
+#include "format-convert.h"
+#include "resampler.h"
+#include "xrun.h"
 
 #include <assert.h>
+#include <stdio.h>
 
 int parse_args(struct audio_tool_config *conf, int *argc, char*** argv)
 {
@@ -51,6 +55,7 @@ int parse_args(struct audio_tool_config *conf, int *argc, char*** argv)
 	if (!ret) {
 		conf->card = args_info.card_arg;
 		conf->device = args_info.device_arg;
+		conf->capture_device = args_info.capture_device_arg;
 		conf->period_size = args_info.periods_arg;
 		conf->num_periods = args_info.num_periods_arg;
 		conf->duration = args_info.time_arg;
@@ -58,6 +63,66 @@ int parse_args(struct audio_tool_config *conf, int *argc, char*** argv)
 		conf->channel_mask = (uint32_t) args_info.channel_mask_arg;
 		conf->bits = args_info.bits_arg;
 		conf->rate = args_info.rate_arg;
+		conf->mmap = args_info.mmap_flag;
+		conf->noirq = args_info.noirq_flag;
+		conf->io_thread = args_info.io_thread_flag;
+		conf->telemetry = args_info.telemetry_arg;
+		conf->histogram_file = args_info.histogram_file_given ?
+			args_info.histogram_file_arg : NULL;
+		conf->rt_priority = args_info.rt_priority_arg;
+		conf->cpu = args_info.cpu_arg;
+		conf->mlock = args_info.mlock_flag;
+		conf->low_latency = args_info.low_latency_flag;
+		conf->duplex_periods = args_info.duplex_periods_arg;
+		conf->link = args_info.link_flag;
+		conf->ring_periods = args_info.ring_periods_arg;
+		conf->rotate_size = args_info.rotate_size_arg;
+		conf->rotate_time = args_info.rotate_time_arg;
+		conf->dither = args_info.dither_flag;
+		conf->pcm_channels = args_info.pcm_channels_arg;
+		conf->pcm_rate = args_info.pcm_rate_arg;
+
+		conf->xrun_log = args_info.xrun_log_arg;
+		conf->xrun_policy = xrun_policy_parse(args_info.xrun_policy_arg);
+		if (conf->xrun_policy < 0) {
+			fprintf(stderr, "Error: '%s' is not an xrun policy\n",
+				args_info.xrun_policy_arg);
+			ret = 1;
+		}
+
+		conf->resample_quality =
+			resampler_quality_parse(args_info.resample_quality_arg);
+		if (conf->resample_quality < 0) {
+			fprintf(stderr, "Error: '%s' is not a resampler quality\n",
+				args_info.resample_quality_arg);
+			ret = 1;
+		}
+
+		conf->pcm_format = -1;
+		if (args_info.pcm_format_given) {
+			conf->pcm_format = sample_format_parse(args_info.pcm_format_arg);
+			if ((conf->pcm_format == SAMPLE_FORMAT_U8) ||
+			    (conf->pcm_format == SAMPLE_FORMAT_FLOAT_LE))
+				conf->pcm_format = -1;
+			if (conf->pcm_format < 0) {
+				fprintf(stderr, "Error: '%s' is not a PCM format\n",
+					args_info.pcm_format_arg);
+				ret = 1;
+			}
+		}
+
+		conf->file_format = -1;
+		if (args_info.file_format_given) {
+			conf->file_format = sample_format_parse(args_info.file_format_arg);
+			if ((conf->file_format == SAMPLE_FORMAT_S8) ||
+			    (conf->file_format == SAMPLE_FORMAT_S24_LE))
+				conf->file_format = -1;
+			if (conf->file_format < 0) {
+				fprintf(stderr, "Error: '%s' is not a file format\n",
+					args_info.file_format_arg);
+				ret = 1;
+			}
+		}
 
 		*argc = args_info.inputs_num;
 		*argv = args_info.inputs;
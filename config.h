@@ -42,6 +42,7 @@
 struct audio_tool_config {
 	int card;
 	int device;
+	int capture_device;	/* -1 for device */
 	int period_size;
 	int num_periods;
 	int duration;
@@ -49,6 +50,28 @@ struct audio_tool_config {
 	uint32_t channel_mask;
 	int bits;
 	int rate;
+	int mmap;
+	int noirq;
+	int io_thread;
+	int telemetry;		/* seconds between reports, 0 for none */
+	const char *histogram_file;	/* NULL for none */
+	int rt_priority;	/* SCHED_FIFO priority, 0 for none */
+	int cpu;		/* -1 for any */
+	int mlock;
+	int low_latency;	/* fit periods to the cached capabilities */
+	int xrun_policy;	/* enum pcm_xrun_policy */
+	int xrun_log;		/* xruns to keep and print */
+	int duplex_periods;	/* periods queued ahead of capture */
+	int link;
+	int ring_periods;
+	int rotate_size;
+	int rotate_time;
+	int pcm_format;		/* enum sample_format, -1 if not given */
+	int file_format;	/* enum sample_format, -1 if not given */
+	int dither;
+	int pcm_channels;	/* 0 for the file's channels */
+	int pcm_rate;		/* 0 for the file's rate */
+	int resample_quality;	/* enum resampler_quality */
 };
 
 #endif /* __OMAP_AUDIO_TOOL_CONFIG_H__ */
@@ -0,0 +1,499 @@
+/*
+ * duplex.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Full-duplex pass-through: whatever one PCM captures is played on
+ * another, e.g. a microphone to a headset, to test a path end to end.
+ *
+ * A single thread waits on both streams in an event loop and moves each
+ * captured period to playback as soon as it is read.  Playback is
+ * started with a few periods of silence queued ahead of capture, and
+ * that cushion is all the latency the engine adds: the streams run off
+ * the same clock, so it neither grows nor shrinks.  If it runs out
+ * anyway (an xrun on either side), both streams are stopped and started
+ * again from the same state.
+ *
+ * Optionally the two streams are linked, so that the driver starts
+ * them at the same instant rather than one system call apart.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tinyalsa/asoundlib.h>
+
+#include "config.h"
+#include "duplex.h"
+#include "histogram.h"
+#include "reactor.h"
+#include "rt-profile.h"
+#include "telemetry.h"
+#include "xrun.h"
+#include "caps.h"
+
+/* Longer than this without a period from capture is taken as a hang */
+#define DUPLEX_TIMEOUT_MS 1000
+
+struct duplex {
+	struct pcm *cap;
+	struct pcm *play;
+	unsigned int rate;
+	unsigned int period_size;
+	unsigned int period_bytes;
+	unsigned int buffer_size;	/* of playback */
+	unsigned int prefill;		/* periods of silence to start with */
+	int linked;
+
+	/* periods read from capture, waiting for room in playback */
+	char *queue;
+	unsigned int queue_periods;
+	unsigned int head;
+	unsigned int count;
+	char *silence;
+
+	uint64_t frames;		/* moved from capture to playback */
+	unsigned int restarts;
+	unsigned int dropped;		/* periods lost to a full queue */
+
+	struct histogram latency;	/* in frames */
+	struct rt_profile rt;
+	struct telemetry tm;
+
+	struct reactor reactor;
+	struct reactor_source cap_src;
+	struct reactor_source play_src;
+	struct reactor_source watchdog_src;
+	struct reactor_source signal_src;
+	uint64_t max_frames;		/* 0 for no limit */
+	int captured;			/* since the last watchdog tick */
+};
+
+static int duplex_stream_open(struct pcm **pcm, unsigned int card,
+			      unsigned int device, unsigned int flags,
+			      struct pcm_config *config)
+{
+	*pcm = pcm_open(card, device, flags, config);
+	if (!*pcm || !pcm_is_ready(*pcm)) {
+		fprintf(stderr, "Unable to open PCM device %u (%s)\n", device,
+			pcm_get_error(*pcm));
+		return -1;
+	}
+	return 0;
+}
+
+/* Both streams run with the same periods, so take the larger of the
+ * smallest each of them allows
+ */
+static int duplex_fit(const struct audio_tool_config *config,
+		      unsigned int capture_device, struct pcm_config *pcm_config)
+{
+	struct pcm_config play = *pcm_config;
+
+	if (caps_fit(config->card, capture_device, PCM_IN, pcm_config) ||
+	    caps_fit(config->card, config->device, PCM_OUT, &play))
+		return -1;
+
+	if (pcm_config->period_size < play.period_size)
+		pcm_config->period_size = play.period_size;
+	if (pcm_config->period_count < play.period_count)
+		pcm_config->period_count = play.period_count;
+	/* room for the silence playback starts with, and a period more */
+	if (pcm_config->period_count <= (unsigned int)config->duplex_periods)
+		pcm_config->period_count = config->duplex_periods + 1;
+	return 0;
+}
+
+/* Stops both streams, queues the silence and starts them again */
+static int duplex_start(struct duplex *d)
+{
+	unsigned int i;
+
+	pcm_stop(d->play);
+	pcm_stop(d->cap);
+	d->head = 0;
+	d->count = 0;
+
+	/* playback has a start threshold it never reaches, so it waits
+	 * for pcm_start() however much is queued
+	 */
+	if (pcm_prepare(d->cap)) {
+		fprintf(stderr, "Error preparing capture (%s)\n",
+			pcm_get_error(d->cap));
+		return -1;
+	}
+
+	/* after capture: preparing a linked stream prepares both, which
+	 * would throw the silence away
+	 */
+	for (i = 0; i < d->prefill; i++) {
+		if (pcm_write(d->play, d->silence, d->period_bytes)) {
+			fprintf(stderr, "Error queueing silence (%s)\n",
+				pcm_get_error(d->play));
+			return -1;
+		}
+	}
+
+	/* a linked capture starts playback with it */
+	if ((!d->linked && pcm_start(d->play)) || pcm_start(d->cap)) {
+		fprintf(stderr, "Error starting streams (%s, %s)\n",
+			pcm_get_error(d->play), pcm_get_error(d->cap));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int duplex_restart(struct duplex *d)
+{
+	d->restarts++;
+	return duplex_start(d);
+}
+
+/* Reads a period into the queue, dropping the oldest one if it's full */
+static int duplex_capture(struct duplex *d)
+{
+	unsigned int tail;
+	int ret;
+
+	if (d->count == d->queue_periods) {
+		d->head = (d->head + 1) % d->queue_periods;
+		d->count--;
+		d->dropped++;
+	}
+
+	/* capture fails on an overrun rather than restarting on its own,
+	 * which would leave playback out of step: both start over
+	 */
+	tail = (d->head + d->count) % d->queue_periods;
+	ret = pcm_read(d->cap, d->queue + tail * d->period_bytes,
+		       d->period_bytes);
+	if (ret == -EPIPE)
+		return ret;
+	if (ret) {
+		fprintf(stderr, "Error capturing (%s)\n",
+			pcm_get_error(d->cap));
+		return -1;
+	}
+
+	d->count++;
+	return 0;
+}
+
+/* Writes as many queued periods as playback has room for */
+static int duplex_flush(struct duplex *d)
+{
+	long play_delay, cap_delay;
+	int ret;
+
+	while (d->count) {
+		play_delay = pcm_get_delay(d->play);
+		if (play_delay < 0)
+			return -EPIPE;
+		if (play_delay + d->period_size > d->buffer_size)
+			break;
+
+		ret = pcm_write(d->play, d->queue + d->head * d->period_bytes,
+				d->period_bytes);
+		if (ret == -EPIPE)
+			return ret;
+		if (ret) {
+			fprintf(stderr, "Error playing (%s)\n",
+				pcm_get_error(d->play));
+			return -1;
+		}
+		d->head = (d->head + 1) % d->queue_periods;
+		d->count--;
+		d->frames += d->period_size;
+
+		/* the last frame just written was captured the capture delay
+		 * plus whatever is still queued ago, and will be heard after
+		 * the playback delay
+		 */
+		cap_delay = pcm_get_delay(d->cap);
+		if (cap_delay >= 0)
+			histogram_record(&d->latency, cap_delay +
+					 d->count * d->period_size +
+					 play_delay + d->period_size);
+	}
+
+	return 0;
+}
+
+/* Gets over an xrun if there was one, then waits on playback only if
+ * it is holding up the queue (its errors are reported either way)
+ */
+static int duplex_update(struct duplex *d, int ret)
+{
+	if (ret == -EPIPE)
+		ret = duplex_restart(d);
+	if (ret)
+		return EIO;
+
+	telemetry_sample(&d->tm);
+	if (d->max_frames && (d->frames >= d->max_frames))
+		reactor_stop(&d->reactor);
+	return reactor_set_events(&d->play_src, d->count ? EPOLLOUT : 0);
+}
+
+static int duplex_on_capture(struct reactor_source *src, uint32_t events)
+{
+	struct duplex *d = src->data;
+	int ret;
+
+	if (events & EPOLLERR) {
+		ret = -EPIPE;
+	} else {
+		d->captured = 1;
+		ret = duplex_capture(d);
+		if (!ret)
+			ret = duplex_flush(d);
+	}
+	return duplex_update(d, ret);
+}
+
+static int duplex_on_playback(struct reactor_source *src, uint32_t events)
+{
+	struct duplex *d = src->data;
+
+	return duplex_update(d, (events & EPOLLERR) ? -EPIPE : duplex_flush(d));
+}
+
+static int duplex_on_watchdog(struct reactor_source *src, uint32_t events)
+{
+	struct duplex *d = src->data;
+
+	if (d->captured) {
+		d->captured = 0;
+		return 0;
+	}
+	fprintf(stderr, "Warning: capture timed out, restarting\n");
+	return duplex_update(d, -EPIPE);
+}
+
+static int duplex_on_stats(struct reactor_source *src, uint32_t events)
+{
+	struct duplex *d = src->data;
+
+	printf("Duplex: %u restarts, %u periods dropped\n", d->restarts,
+	       d->dropped);
+	histogram_print(&d->latency, "latency", d->rate / 1000.0, "ms");
+	return 0;
+}
+
+static int duplex_on_signal(struct reactor_source *src, uint32_t events)
+{
+	reactor_stop(src->reactor);
+	return 0;
+}
+
+static int duplex_run(struct duplex *d, unsigned int stats_ms)
+{
+	struct reactor_source stats_src;
+	sigset_t signals;
+	int ret;
+
+	ret = reactor_init(&d->reactor);
+	if (ret)
+		return ret;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	ret = reactor_add_signals(&d->reactor, &d->signal_src, &signals,
+				  duplex_on_signal, d);
+	if (!ret)
+		ret = reactor_add_fd(&d->reactor, &d->cap_src,
+				     pcm_get_file_descriptor(d->cap), EPOLLIN,
+				     duplex_on_capture, d);
+	if (!ret)
+		ret = reactor_add_fd(&d->reactor, &d->play_src,
+				     pcm_get_file_descriptor(d->play), 0,
+				     duplex_on_playback, d);
+	if (!ret)
+		ret = reactor_add_timer(&d->reactor, &d->watchdog_src,
+					DUPLEX_TIMEOUT_MS, duplex_on_watchdog, d);
+	if (!ret && stats_ms)
+		ret = reactor_add_timer(&d->reactor, &stats_src, stats_ms,
+					duplex_on_stats, d);
+	if (!ret && duplex_start(d))
+		ret = EIO;
+	if (!ret)
+		ret = reactor_run(&d->reactor);
+	if (ret && (ret != EIO))
+		fprintf(stderr, "Error in the event loop (%s)\n", strerror(ret));
+
+	if (stats_ms)
+		reactor_remove(&stats_src);
+	reactor_remove(&d->watchdog_src);
+	reactor_remove(&d->signal_src);
+	reactor_deinit(&d->reactor);
+	return ret;
+}
+
+static void duplex_report(struct duplex *d)
+{
+	printf("Duplex: moved %llu frames, %u restarts, %u periods dropped\n",
+	       (unsigned long long)d->frames, d->restarts, d->dropped);
+	histogram_print(&d->latency, "latency", d->rate / 1000.0, "ms");
+	rt_profile_report(&d->rt, "duplex thread");
+	telemetry_report(&d->tm);
+	xrun_report(d->cap, "capture");
+	xrun_report(d->play, "playback");
+}
+
+static void usage(void)
+{
+	printf("Usage: audio-tool [options] duplex\n");
+}
+
+int duplex_main(const struct audio_tool_config *config, int argc, char **argv)
+{
+	struct duplex *d;
+	struct pcm_config pcm_config;
+	unsigned int capture_device, flags = 0;
+	int ret = 1;
+
+	if (argc > 1) {
+		usage();
+		return 1;
+	}
+
+	memset(&pcm_config, 0, sizeof(pcm_config));
+	pcm_config.channels = config->channels;
+	pcm_config.rate = config->rate;
+	pcm_config.period_size = config->period_size;
+	pcm_config.period_count = config->num_periods;
+	switch (config->bits) {
+	case 16: pcm_config.format = PCM_FORMAT_S16_LE; break;
+	case 24: pcm_config.format = PCM_FORMAT_S24_3LE; break;
+	case 32: pcm_config.format = PCM_FORMAT_S32_LE; break;
+	default:
+		fprintf(stderr, "Error: %d-bit samples are not supported\n",
+			config->bits);
+		return 1;
+	}
+	capture_device = (config->capture_device >= 0) ?
+		(unsigned int)config->capture_device : (unsigned int)config->device;
+	if (config->low_latency &&
+	    duplex_fit(config, capture_device, &pcm_config))
+		return 1;
+	/* a ready stream always has a whole period to give or take */
+	pcm_config.avail_min = pcm_config.period_size;
+	if ((config->duplex_periods < 1) ||
+	    ((unsigned int)config->duplex_periods >= pcm_config.period_count)) {
+		fprintf(stderr, "Error: --duplex-periods must be from 1 to "
+			"--num-periods - 1\n");
+		return 1;
+	}
+
+	/* the histogram is too big for the stack */
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		return 1;
+	d->rate = config->rate;
+	d->prefill = config->duplex_periods;
+	d->linked = config->link;
+	histogram_init(&d->latency);
+	rt_profile_init(&d->rt, config->rt_priority, config->cpu, config->mlock);
+	if (config->telemetry)
+		flags |= PCM_MONOTONIC;
+
+	if (duplex_stream_open(&d->cap, config->card, capture_device,
+			       PCM_IN | flags, &pcm_config))
+		goto done;
+	d->period_size = pcm_config.period_size;
+
+	pcm_config.start_threshold =
+		2 * pcm_config.period_size * pcm_config.period_count;
+	if (duplex_stream_open(&d->play, config->card, config->device,
+			       PCM_OUT | flags, &pcm_config))
+		goto done;
+	if (pcm_config.period_size != d->period_size) {
+		fprintf(stderr, "Error: playback and capture periods differ\n");
+		goto done;
+	}
+	if (xrun_setup(d->cap, PCM_XRUN_FAIL, config->xrun_log) ||
+	    xrun_setup(d->play, PCM_XRUN_FAIL, config->xrun_log))
+		goto done;
+
+	d->buffer_size = pcm_get_buffer_size(d->play);
+	d->period_bytes = pcm_frames_to_bytes(d->play, d->period_size);
+	/* the fitted count, which --low-latency may have changed */
+	d->queue_periods = pcm_config.period_count;
+	d->queue = malloc(d->queue_periods * d->period_bytes);
+	d->silence = calloc(1, d->period_bytes);
+	if (!d->queue || !d->silence) {
+		fprintf(stderr, "Unable to allocate buffers\n");
+		goto done;
+	}
+
+	if (d->linked && pcm_link(d->cap, d->play)) {
+		fprintf(stderr, "Error linking the streams (%s)\n",
+			pcm_get_error(d->cap));
+		goto done;
+	}
+
+	printf("Duplex: device %u to device %u, %u ch, %u hz, %u bit, "
+	       "period %u, %u periods queued%s\n", capture_device,
+	       config->device, pcm_config.channels, d->rate, config->bits,
+	       d->period_size, d->prefill, d->linked ? ", linked" : "");
+
+	rt_profile_prefault(&d->rt, d->queue, d->queue_periods * d->period_bytes);
+	if (rt_profile_enter(&d->rt))
+		goto done;
+	telemetry_init(&d->tm, d->play, d->rate, config->telemetry * 1000);
+
+	d->max_frames = (uint64_t)config->duration * d->rate;
+	rt_profile_start(&d->rt);
+	ret = duplex_run(d, config->telemetry * 1000) ? 1 : 0;
+	duplex_report(d);
+
+	if (d->linked)
+		pcm_unlink(d->cap);
+
+done:
+	if (d->play)
+		pcm_close(d->play);
+	if (d->cap)
+		pcm_close(d->cap);
+	free(d->queue);
+	free(d->silence);
+	free(d);
+	return ret;
+}
@@ -0,0 +1,131 @@
+/*
+ * fft.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+
+int fft_init(struct fft *f, unsigned int size)
+{
+	unsigned int i, j, bits;
+
+	memset(f, 0, sizeof(*f));
+	if ((size < 2) || (size & (size - 1)))
+		return EINVAL;
+
+	f->size = size;
+	f->cos = malloc(size / 2 * sizeof(float));
+	f->sin = malloc(size / 2 * sizeof(float));
+	f->reverse = malloc(size * sizeof(unsigned int));
+	if (!f->cos || !f->sin || !f->reverse) {
+		fft_deinit(f);
+		return ENOMEM;
+	}
+
+	for (i = 0; i < size / 2; i++) {
+		f->cos[i] = cos(2.0 * M_PI * i / size);
+		f->sin[i] = -sin(2.0 * M_PI * i / size);
+	}
+
+	for (bits = 0; (1u << bits) < size; bits++)
+		;
+	for (i = 0; i < size; i++) {
+		for (j = 0, f->reverse[i] = 0; j < bits; j++)
+			if (i & (1u << j))
+				f->reverse[i] |= 1u << (bits - 1 - j);
+	}
+
+	return 0;
+}
+
+void fft_deinit(struct fft *f)
+{
+	free(f->cos);
+	free(f->sin);
+	free(f->reverse);
+	memset(f, 0, sizeof(*f));
+}
+
+/* sign is 1 for the forward transform, -1 for the inverse */
+static void fft_transform(const struct fft *f, float *re, float *im, int sign)
+{
+	unsigned int n = f->size, i, j, k, half, step;
+	float wr, wi, tr, ti, t;
+
+	for (i = 0; i < n; i++) {
+		j = f->reverse[i];
+		if (j > i) {
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (half = 1; half < n; half *= 2) {
+		step = n / (2 * half);
+		for (i = 0; i < n; i += 2 * half) {
+			for (j = 0, k = 0; j < half; j++, k += step) {
+				wr = f->cos[k];
+				wi = sign * f->sin[k];
+				tr = re[i + j + half] * wr - im[i + j + half] * wi;
+				ti = re[i + j + half] * wi + im[i + j + half] * wr;
+				re[i + j + half] = re[i + j] - tr;
+				im[i + j + half] = im[i + j] - ti;
+				re[i + j] += tr;
+				im[i + j] += ti;
+			}
+		}
+	}
+}
+
+void fft_forward(const struct fft *f, float *re, float *im)
+{
+	fft_transform(f, re, im, 1);
+}
+
+void fft_inverse(const struct fft *f, float *re, float *im)
+{
+	float scale = 1.0f / f->size;
+	unsigned int i;
+
+	fft_transform(f, re, im, -1);
+	for (i = 0; i < f->size; i++) {
+		re[i] *= scale;
+		im[i] *= scale;
+	}
+}
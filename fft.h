@@ -0,0 +1,64 @@
+/*
+ * fft.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_FFT_H__
+#define __AUDIO_TOOL_FFT_H__
+
+/* In-place radix-2 complex FFT on split real/imaginary arrays
+ *
+ * The twiddle factors and the bit reversal permutation are computed
+ * once by fft_init(), so transforms of the same size don't touch libm.
+ */
+struct fft {
+	unsigned int size;		/* a power of two */
+	float *cos;			/* size / 2 twiddle factors */
+	float *sin;
+	unsigned int *reverse;		/* bit reversal permutation */
+};
+
+/* Returns 0 on success, errno on failure (EINVAL if size isn't a power
+ * of two)
+ */
+int fft_init(struct fft *f, unsigned int size);
+void fft_deinit(struct fft *f);
+
+/* Forward transform, unscaled */
+void fft_forward(const struct fft *f, float *re, float *im);
+
+/* Inverse transform, scaled by 1 / size */
+void fft_inverse(const struct fft *f, float *re, float *im);
+
+#endif /* __AUDIO_TOOL_FFT_H__ */
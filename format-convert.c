@@ -0,0 +1,460 @@
+/*
+ * format-convert.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <tinyalsa/asoundlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "format-convert.h"
+#include "wav-reader.h"
+
+/* Samples converted per pass through the intermediate buffer */
+#define BLOCK_SAMPLES 256
+
+/* Largest float below 2^31, so float to int32 can't overflow */
+#define FLOAT_S32_MAX 2147483520.0f
+#define FLOAT_S32_MIN -2147483648.0f
+#define S32_SCALE 2147483648.0f
+
+static const struct {
+	const char *name;
+	unsigned int bytes;
+	unsigned int bits;
+} formats[SAMPLE_FORMAT_MAX] = {
+	[SAMPLE_FORMAT_U8] = { "u8", 1, 8 },
+	[SAMPLE_FORMAT_S8] = { "s8", 1, 8 },
+	[SAMPLE_FORMAT_S16_LE] = { "s16", 2, 16 },
+	[SAMPLE_FORMAT_S24_3LE] = { "s24_3le", 3, 24 },
+	[SAMPLE_FORMAT_S24_LE] = { "s24", 4, 24 },
+	[SAMPLE_FORMAT_S32_LE] = { "s32", 4, 32 },
+	/* a float has 24 bits of mantissa */
+	[SAMPLE_FORMAT_FLOAT_LE] = { "float", 4, 24 },
+};
+
+int sample_format_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < SAMPLE_FORMAT_MAX; i++)
+		if (!strcmp(name, formats[i].name))
+			return i;
+
+	return -1;
+}
+
+const char *sample_format_name(enum sample_format format)
+{
+	return formats[format].name;
+}
+
+unsigned int sample_format_bytes(enum sample_format format)
+{
+	return formats[format].bytes;
+}
+
+unsigned int sample_format_bits(enum sample_format format)
+{
+	return formats[format].bits;
+}
+
+int sample_format_to_pcm(enum sample_format format, enum pcm_format *pcm_format)
+{
+	switch (format) {
+	case SAMPLE_FORMAT_S8: *pcm_format = PCM_FORMAT_S8; break;
+	case SAMPLE_FORMAT_S16_LE: *pcm_format = PCM_FORMAT_S16_LE; break;
+	case SAMPLE_FORMAT_S24_3LE: *pcm_format = PCM_FORMAT_S24_3LE; break;
+	case SAMPLE_FORMAT_S24_LE: *pcm_format = PCM_FORMAT_S24_LE; break;
+	case SAMPLE_FORMAT_S32_LE: *pcm_format = PCM_FORMAT_S32_LE; break;
+	default:
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+enum sample_format sample_format_from_pcm(enum pcm_format pcm_format)
+{
+	switch (pcm_format) {
+	case PCM_FORMAT_S8: return SAMPLE_FORMAT_S8;
+	case PCM_FORMAT_S24_3LE: return SAMPLE_FORMAT_S24_3LE;
+	case PCM_FORMAT_S24_LE: return SAMPLE_FORMAT_S24_LE;
+	case PCM_FORMAT_S32_LE: return SAMPLE_FORMAT_S32_LE;
+	default:
+	case PCM_FORMAT_S16_LE: return SAMPLE_FORMAT_S16_LE;
+	}
+}
+
+/* WAV stores 8-bit samples unsigned, and samples with fewer valid bits
+ * than their container in the MSBs, so the container size is all that
+ * matters.
+ */
+int sample_format_from_wav(unsigned int wav_format, unsigned int bits,
+			   enum sample_format *format)
+{
+	if (wav_format == WAV_FORMAT_IEEE_FLOAT) {
+		if (bits != 32)
+			return EINVAL;
+		*format = SAMPLE_FORMAT_FLOAT_LE;
+		return 0;
+	}
+
+	switch (bits) {
+	case 8: *format = SAMPLE_FORMAT_U8; break;
+	case 16: *format = SAMPLE_FORMAT_S16_LE; break;
+	case 24: *format = SAMPLE_FORMAT_S24_3LE; break;
+	case 32: *format = SAMPLE_FORMAT_S32_LE; break;
+	default:
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+int sample_format_to_wav(enum sample_format format, unsigned int *wav_format,
+			 unsigned int *bits)
+{
+	switch (format) {
+	case SAMPLE_FORMAT_U8:
+	case SAMPLE_FORMAT_S16_LE:
+	case SAMPLE_FORMAT_S24_3LE:
+	case SAMPLE_FORMAT_S32_LE:
+		*wav_format = WAV_FORMAT_PCM;
+		break;
+	case SAMPLE_FORMAT_FLOAT_LE:
+		*wav_format = WAV_FORMAT_IEEE_FLOAT;
+		break;
+	default:
+		return EINVAL;
+	}
+
+	*bits = 8 * sample_format_bytes(format);
+	return 0;
+}
+
+enum sample_format sample_format_playable(enum sample_format format)
+{
+	switch (format) {
+	case SAMPLE_FORMAT_U8:
+		return SAMPLE_FORMAT_S16_LE;
+	case SAMPLE_FORMAT_FLOAT_LE:
+		return SAMPLE_FORMAT_S32_LE;
+	default:
+		return format;
+	}
+}
+
+/*
+ * Source format to the 32-bit intermediate
+ */
+
+static void s16_to_s32(int32_t *dst, const void *src, unsigned int n)
+{
+	const int16_t *s = src;
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		/* interleaving zeros below each sample shifts it up 16 */
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(zero, v));
+		_mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(zero, v));
+	}
+#elif defined(HAVE_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t v = vld1q_s16(s + i);
+		vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 16));
+		vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = (int32_t)((uint32_t)s[i] << 16);
+}
+
+static void float_to_s32(int32_t *dst, const void *src, unsigned int n)
+{
+	const float *s = src;
+	unsigned int i = 0;
+	float v;
+
+#if defined(__SSE2__)
+	__m128 scale = _mm_set1_ps(S32_SCALE);
+	__m128 max = _mm_set1_ps(FLOAT_S32_MAX);
+	__m128 min = _mm_set1_ps(FLOAT_S32_MIN);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 f = _mm_mul_ps(_mm_loadu_ps(s + i), scale);
+		f = _mm_max_ps(_mm_min_ps(f, max), min);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(f));
+	}
+#elif defined(HAVE_NEON)
+#if !defined(__aarch64__)
+	/* vcvtq truncates, so add 0.5 away from zero first */
+	uint32x4_t sign = vdupq_n_u32(0x80000000);
+	uint32x4_t half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+#endif
+
+	for (; i + 4 <= n; i += 4) {
+		/* the conversions saturate; they round to nearest, as
+		 * lrintf() and the SSE2 one do */
+		float32x4_t f = vmulq_n_f32(vld1q_f32(s + i), S32_SCALE);
+#if defined(__aarch64__)
+		vst1q_s32(dst + i, vcvtnq_s32_f32(f));
+#else
+		uint32x4_t h = vorrq_u32(vandq_u32(vreinterpretq_u32_f32(f), sign),
+					 half);
+		f = vaddq_f32(f, vreinterpretq_f32_u32(h));
+		vst1q_s32(dst + i, vcvtq_s32_f32(f));
+#endif
+	}
+#endif
+	for (; i < n; i++) {
+		v = s[i] * S32_SCALE;
+		if (v > FLOAT_S32_MAX)
+			v = FLOAT_S32_MAX;
+		else if (v < FLOAT_S32_MIN)
+			v = FLOAT_S32_MIN;
+		dst[i] = lrintf(v);
+	}
+}
+
+static void to_s32(enum sample_format from, int32_t *dst, const void *src,
+		   unsigned int n)
+{
+	const uint8_t *b = src;
+	const int32_t *w = src;
+	unsigned int i;
+
+	switch (from) {
+	case SAMPLE_FORMAT_U8:
+		for (i = 0; i < n; i++)
+			dst[i] = (int32_t)((uint32_t)(b[i] ^ 0x80) << 24);
+		break;
+	case SAMPLE_FORMAT_S8:
+		for (i = 0; i < n; i++)
+			dst[i] = (int32_t)((uint32_t)b[i] << 24);
+		break;
+	case SAMPLE_FORMAT_S16_LE:
+		s16_to_s32(dst, src, n);
+		break;
+	case SAMPLE_FORMAT_S24_3LE:
+		for (i = 0; i < n; i++, b += 3)
+			dst[i] = (int32_t)((b[0] << 8) | (b[1] << 16) |
+					   ((uint32_t)b[2] << 24));
+		break;
+	case SAMPLE_FORMAT_S24_LE:
+		for (i = 0; i < n; i++)
+			dst[i] = (int32_t)((uint32_t)w[i] << 8);
+		break;
+	case SAMPLE_FORMAT_S32_LE:
+		memcpy(dst, src, n * sizeof(*dst));
+		break;
+	case SAMPLE_FORMAT_FLOAT_LE:
+		float_to_s32(dst, src, n);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * 32-bit intermediate to destination format
+ */
+
+static void s32_to_s16(void *dst, const int32_t *src, unsigned int n)
+{
+	int16_t *d = dst;
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i lo = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i)), 16);
+		__m128i hi = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), 16);
+		_mm_storeu_si128((__m128i *)(d + i), _mm_packs_epi32(lo, hi));
+	}
+#elif defined(HAVE_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x4_t lo = vshrn_n_s32(vld1q_s32(src + i), 16);
+		int16x4_t hi = vshrn_n_s32(vld1q_s32(src + i + 4), 16);
+		vst1q_s16(d + i, vcombine_s16(lo, hi));
+	}
+#endif
+	for (; i < n; i++)
+		d[i] = src[i] >> 16;
+}
+
+static void s32_to_float(void *dst, const int32_t *src, unsigned int n)
+{
+	float *d = dst;
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	__m128 scale = _mm_set1_ps(1.0f / S32_SCALE);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_ps(d + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+#elif defined(HAVE_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(d + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)),
+					     1.0f / S32_SCALE));
+#endif
+	for (; i < n; i++)
+		d[i] = src[i] * (1.0f / S32_SCALE);
+}
+
+static void from_s32(enum sample_format to, void *dst, const int32_t *src,
+		     unsigned int n)
+{
+	uint8_t *b = dst;
+	int32_t *w = dst;
+	unsigned int i;
+
+	switch (to) {
+	case SAMPLE_FORMAT_U8:
+		for (i = 0; i < n; i++)
+			b[i] = (src[i] >> 24) ^ 0x80;
+		break;
+	case SAMPLE_FORMAT_S8:
+		for (i = 0; i < n; i++)
+			b[i] = src[i] >> 24;
+		break;
+	case SAMPLE_FORMAT_S16_LE:
+		s32_to_s16(dst, src, n);
+		break;
+	case SAMPLE_FORMAT_S24_3LE:
+		for (i = 0; i < n; i++, b += 3) {
+			b[0] = src[i] >> 8;
+			b[1] = src[i] >> 16;
+			b[2] = src[i] >> 24;
+		}
+		break;
+	case SAMPLE_FORMAT_S24_LE:
+		for (i = 0; i < n; i++)
+			w[i] = src[i] >> 8;
+		break;
+	case SAMPLE_FORMAT_S32_LE:
+		memcpy(dst, src, n * sizeof(*src));
+		break;
+	case SAMPLE_FORMAT_FLOAT_LE:
+		s32_to_float(dst, src, n);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Adds TPDF dither of +/- 1 LSB at the given bit depth, plus half an LSB
+ * so that the truncation in from_s32() rounds to nearest.
+ */
+static void dither_s32(struct format_convert *fc, int32_t *buf,
+		       unsigned int n, unsigned int bits)
+{
+	unsigned int shift = 32 - bits;
+	int64_t half = (int64_t)1 << (shift - 1);
+	uint32_t seed = fc->seed;
+	int64_t v, r1, r2;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		/* two uniform values in [0, 1 LSB) from an LCG's high bits */
+		seed = seed * 1664525 + 1013904223;
+		r1 = seed >> bits;
+		seed = seed * 1664525 + 1013904223;
+		r2 = seed >> bits;
+
+		v = (int64_t)buf[i] + r1 - r2 + half;
+		if (v > INT32_MAX)
+			v = INT32_MAX;
+		else if (v < INT32_MIN)
+			v = INT32_MIN;
+		buf[i] = v;
+	}
+
+	fc->seed = seed;
+}
+
+void format_convert_init(struct format_convert *fc, enum sample_format from,
+			 enum sample_format to, int dither)
+{
+	fc->from = from;
+	fc->to = to;
+	fc->seed = 22222;
+
+	/* only requantizing to fewer bits needs dither */
+	fc->dither = dither && (to != SAMPLE_FORMAT_FLOAT_LE)
+		&& (sample_format_bits(to) < sample_format_bits(from));
+}
+
+void format_convert(struct format_convert *fc, void *dst, const void *src,
+		    unsigned int samples)
+{
+	int32_t buf[BLOCK_SAMPLES] __attribute__((aligned(16)));
+	unsigned int in_bytes = sample_format_bytes(fc->from);
+	unsigned int out_bytes = sample_format_bytes(fc->to);
+	const char *s = src;
+	char *d = dst;
+	unsigned int n;
+
+	if (format_convert_is_copy(fc)) {
+		memcpy(dst, src, samples * in_bytes);
+		return;
+	}
+
+	while (samples) {
+		n = (samples < BLOCK_SAMPLES) ? samples : BLOCK_SAMPLES;
+
+		to_s32(fc->from, buf, s, n);
+		if (fc->dither)
+			dither_s32(fc, buf, n, sample_format_bits(fc->to));
+		from_s32(fc->to, d, buf, n);
+
+		s += n * in_bytes;
+		d += n * out_bytes;
+		samples -= n;
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * format-convert.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_FORMAT_CONVERT_H__
+#define __AUDIO_TOOL_FORMAT_CONVERT_H__
+
+#include <stdint.h>
+#include <tinyalsa/asoundlib.h>
+
+/* Sample formats understood by the converter.  All are little-endian.
+ * S24_3LE is packed (3 bytes per sample), S24_LE is 24 bits in the low
+ * part of a 32-bit word (ALSA's S24_LE).
+ */
+enum sample_format {
+	SAMPLE_FORMAT_U8,
+	SAMPLE_FORMAT_S8,
+	SAMPLE_FORMAT_S16_LE,
+	SAMPLE_FORMAT_S24_3LE,
+	SAMPLE_FORMAT_S24_LE,
+	SAMPLE_FORMAT_S32_LE,
+	SAMPLE_FORMAT_FLOAT_LE,
+
+	SAMPLE_FORMAT_MAX,
+};
+
+/* Returns the format for a name such as "s16" or "float", or -1 */
+int sample_format_parse(const char *name);
+const char *sample_format_name(enum sample_format format);
+
+/* Bytes per sample, and bits of precision per sample */
+unsigned int sample_format_bytes(enum sample_format format);
+unsigned int sample_format_bits(enum sample_format format);
+
+/* Conversions to and from tinyalsa and WAV formats.
+ * Return 0 on success, EINVAL if there is no equivalent.
+ */
+int sample_format_to_pcm(enum sample_format format, enum pcm_format *pcm_format);
+enum sample_format sample_format_from_pcm(enum pcm_format pcm_format);
+int sample_format_from_wav(unsigned int wav_format, unsigned int bits,
+			   enum sample_format *format);
+int sample_format_to_wav(enum sample_format format, unsigned int *wav_format,
+			 unsigned int *bits);
+
+/* The PCM format to play samples of a format in, when not told: the
+ * same one if the PCM API has it, else the nearest one that loses nothing
+ */
+enum sample_format sample_format_playable(enum sample_format format);
+
+/* Converts interleaved samples between two formats.
+ *
+ * Samples go through a 32-bit intermediate, a block at a time, so that
+ * the block stays in L1.  The common conversions (S16 and FLOAT to and
+ * from the intermediate) have SSE2 and NEON kernels.  If dither is
+ * enabled and the destination has fewer bits than the source, TPDF
+ * dither of +/- 1 LSB of the destination is added before requantizing.
+ */
+struct format_convert {
+	enum sample_format from;
+	enum sample_format to;
+	int dither;
+	uint32_t seed;
+};
+
+void format_convert_init(struct format_convert *fc, enum sample_format from,
+			 enum sample_format to, int dither);
+
+/* True if the conversion is a plain copy */
+static inline int format_convert_is_copy(const struct format_convert *fc)
+{
+	return fc->from == fc->to;
+}
+
+void format_convert(struct format_convert *fc, void *dst, const void *src,
+		    unsigned int samples);
+
+#endif /* __AUDIO_TOOL_FORMAT_CONVERT_H__ */
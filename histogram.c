@@ -0,0 +1,112 @@
+/*
+ * histogram.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "histogram.h"
+
+void histogram_init(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+/* Highest value counted in bucket index */
+static uint64_t histogram_bucket_max(unsigned int index)
+{
+	unsigned int shift;
+
+	if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+		return index;
+
+	shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+	return ((uint64_t)(index % HISTOGRAM_SUB_BUCKETS +
+			   HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+uint64_t histogram_percentile(const struct histogram *h, double percentile)
+{
+	uint64_t rank, seen = 0, value;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+
+	rank = (uint64_t)(percentile / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > h->count)
+		rank = h->count;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen >= rank)
+			break;
+	}
+
+	value = histogram_bucket_max(i);
+	return (value > h->max) ? h->max : value;
+}
+
+void histogram_print(const struct histogram *h, const char *label,
+		     double scale, const char *unit)
+{
+	if (!h->count) {
+		printf("%s: no samples\n", label);
+		return;
+	}
+
+	printf("%s: n=%llu min=%.1f p50=%.1f p99=%.1f p99.9=%.1f max=%.1f "
+	       "mean=%.1f %s\n", label, (unsigned long long)h->count,
+	       h->min / scale, histogram_percentile(h, 50.0) / scale,
+	       histogram_percentile(h, 99.0) / scale,
+	       histogram_percentile(h, 99.9) / scale, h->max / scale,
+	       h->sum / h->count / scale, unit);
+}
+
+int histogram_dump(const struct histogram *h, FILE *file, const char *label)
+{
+	unsigned int i;
+
+	fprintf(file, "# %s\n", label);
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+		if (h->counts[i])
+			fprintf(file, "%llu %u\n",
+				(unsigned long long)histogram_bucket_max(i),
+				h->counts[i]);
+
+	return ferror(file) ? EIO : 0;
+}
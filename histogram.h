@@ -0,0 +1,113 @@
+/*
+ * histogram.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_HISTOGRAM_H__
+#define __AUDIO_TOOL_HISTOGRAM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Log-linear histogram of durations (or any non-negative integers)
+ *
+ * Values below 2 * HISTOGRAM_SUB_BUCKETS are counted exactly.  Above
+ * that, every power of two is split into HISTOGRAM_SUB_BUCKETS linear
+ * buckets, so a value is known to within 1 / HISTOGRAM_SUB_BUCKETS
+ * (under 1%) however large it is.  Values of 2^HISTOGRAM_MAX_BITS and
+ * above share the last bucket (the exact maximum is kept separately).
+ *
+ * The counts live in the structure itself: recording is O(1) and never
+ * allocates, so it is safe in a real-time loop.
+ */
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS \
+	((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram {
+	uint32_t counts[HISTOGRAM_BUCKETS];
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+};
+
+void histogram_init(struct histogram *h);
+
+static inline unsigned int histogram_index(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+		return value;
+	if (value >> HISTOGRAM_MAX_BITS)
+		return HISTOGRAM_BUCKETS - 1;
+
+	/* the top HISTOGRAM_SUB_BITS + 1 bits pick the bucket */
+	shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+	return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+		(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+static inline void histogram_record(struct histogram *h, uint64_t value)
+{
+	h->counts[histogram_index(value)]++;
+	if (!h->count || (value < h->min))
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += value;
+}
+
+/* Returns the highest value that falls in the same bucket as the given
+ * percentile (0 to 100), i.e. a bound that the percentile doesn't
+ * exceed
+ */
+uint64_t histogram_percentile(const struct histogram *h, double percentile);
+
+/* Prints count, min, p50, p99, p99.9, max and mean on one line, with the
+ * values divided by scale (e.g. 1000 to print ns as us)
+ */
+void histogram_print(const struct histogram *h, const char *label,
+		     double scale, const char *unit);
+
+/* Writes the non-empty buckets to file, one "upper-bound count" pair per
+ * line, after a "# label" line.  Returns 0 on success, errno on failure.
+ */
+int histogram_dump(const struct histogram *h, FILE *file, const char *label);
+
+#endif /* __AUDIO_TOOL_HISTOGRAM_H__ */
@@ -54,6 +54,7 @@ struct pcm;
                                    * second call to pcm_write will attempt to
                                    * restart the stream.
                                    */
+#define PCM_MONOTONIC  0x00000008 /* see pcm_get_htimestamp() */
 
 /* PCM runtime states */
 #define	PCM_STATE_OPEN		0
@@ -72,10 +73,39 @@ enum pcm_format {
     PCM_FORMAT_S32_LE,
     PCM_FORMAT_S8,
     PCM_FORMAT_S24_LE,
+    PCM_FORMAT_S24_3LE,
 
     PCM_FORMAT_MAX,
 };
 
+/* What pcm_write() and pcm_read() do when the stream has run out of data
+ * (playback) or room (capture).  The xrun is counted and logged either
+ * way.
+ */
+enum pcm_xrun_policy {
+    PCM_XRUN_RESTART = 0, /* prepare the stream and carry on (the default) */
+    PCM_XRUN_FAIL,        /* return -EPIPE; the next call restarts the
+                           * stream (same as PCM_NORESTART) */
+    PCM_XRUN_SILENCE,     /* playback: queue silence up to the start
+                           * threshold before the data, so the stream
+                           * starts again at once with that much margin.
+                           * Capture: same as PCM_XRUN_RESTART */
+    PCM_XRUN_SKIP,        /* drop (playback) or fill with silence (capture)
+                           * as many frames as the xrun lasted, so that
+                           * positions in the stream stay in step with
+                           * the clock */
+};
+
+/* One xrun, as seen when the transfer failed */
+struct pcm_xrun {
+    struct timespec tstamp;     /* CLOCK_MONOTONIC when it was caught */
+    unsigned long hw_ptr;       /* stream positions when it stopped */
+    unsigned long appl_ptr;
+    unsigned long lost;         /* frames the stream missed, from the stop
+                                 * to tstamp */
+    unsigned long skipped;      /* frames dropped or filled to make up */
+};
+
 /* Configuration for a stream */
 struct pcm_config {
     unsigned int channels;
@@ -95,6 +125,32 @@ struct pcm_config {
     unsigned int start_threshold;
     unsigned int stop_threshold;
     unsigned int silence_threshold;
+
+    /* Minimum number of frames available before pcm_wait() or poll() on
+     * the stream's file descriptor reports it ready.  0 means 1 frame.
+     * Event loops set it to the period size, so that a ready stream can
+     * always take or give a whole period without blocking.
+     */
+    unsigned int avail_min;
+};
+
+/* Hardware parameters that pcm_params_get_min() and pcm_params_get_max()
+ * report the range of
+ */
+enum pcm_param {
+    PCM_PARAM_SAMPLE_BITS,
+    PCM_PARAM_FRAME_BITS,
+    PCM_PARAM_CHANNELS,
+    PCM_PARAM_RATE,
+    PCM_PARAM_PERIOD_TIME,
+    PCM_PARAM_PERIOD_SIZE,
+    PCM_PARAM_PERIOD_BYTES,
+    PCM_PARAM_PERIODS,
+    PCM_PARAM_BUFFER_TIME,
+    PCM_PARAM_BUFFER_SIZE,
+    PCM_PARAM_BUFFER_BYTES,
+
+    PCM_PARAM_MAX,
 };
 
 /* Mixer control types */
@@ -116,26 +172,100 @@ struct pcm *pcm_open(unsigned int card, unsigned int device,
 int pcm_close(struct pcm *pcm);
 int pcm_is_ready(struct pcm *pcm);
 
+/* Returns the file descriptor of the stream, e.g. to poll() it along
+ * with other descriptors
+ */
+int pcm_get_file_descriptor(struct pcm *pcm);
+
+/* Links two streams, so that starting, stopping or preparing one does
+ * the same to the other.  Returns 0 on success, -1 on failure.
+ */
+int pcm_link(struct pcm *pcm1, struct pcm *pcm2);
+int pcm_unlink(struct pcm *pcm);
+
 /* Set and get config */
 int pcm_get_config(struct pcm *pcm, struct pcm_config *config);
 int pcm_set_config(struct pcm *pcm, struct pcm_config *config);
 
+/* Returns the number of xruns the stream recovered from */
+int pcm_get_underruns(struct pcm *pcm);
+
+/* Sets how pcm_write() and pcm_read() recover from xruns.  Returns 0 on
+ * success, -1 on failure.
+ */
+int pcm_set_xrun_policy(struct pcm *pcm, enum pcm_xrun_policy policy);
+
+/* Keeps the last 'size' xruns (0 for none) in a ring allocated here, so
+ * that logging them never allocates.  Returns 0 on success, -1 on
+ * failure.
+ */
+int pcm_set_xrun_log(struct pcm *pcm, unsigned int size);
+
+/* Copies up to 'max' of the logged xruns, oldest first, and returns how
+ * many were copied.  pcm_get_underruns() tells how many there were in
+ * all.
+ */
+unsigned int pcm_get_xruns(struct pcm *pcm, struct pcm_xrun *xruns,
+                           unsigned int max);
+
 /* Returns a human readable reason for the last error */
 const char *pcm_get_error(struct pcm *pcm);
 
+/* What a stream's hardware can do, as refined by the driver without
+ * committing to any configuration.  pcm_params_get() returns NULL (with
+ * errno set) if the stream can't be opened, e.g. EBUSY while another
+ * process has it.  The stream stays open until pcm_params_free().
+ */
+struct pcm_params;
+
+struct pcm_params *pcm_params_get(unsigned int card, unsigned int device,
+                                  unsigned int flags);
+void pcm_params_free(struct pcm_params *params);
+
+/* Returns the smallest and largest value the hardware allows */
+unsigned int pcm_params_get_min(struct pcm_params *params,
+                                enum pcm_param param);
+unsigned int pcm_params_get_max(struct pcm_params *params,
+                                enum pcm_param param);
+
+/* Each returns 1 if the hardware takes the format, the mmap() access or
+ * the value, 0 if not.  pcm_params_test() asks the driver, so it catches
+ * holes in a range (e.g. rates a codec can't clock).
+ */
+int pcm_params_format_test(struct pcm_params *params, enum pcm_format format);
+int pcm_params_mmap_test(struct pcm_params *params);
+int pcm_params_test(struct pcm_params *params, enum pcm_param param,
+                    unsigned int value);
+
 /* Returns the buffer size (int frames) that should be used for pcm_write. */
 unsigned int pcm_get_buffer_size(struct pcm *pcm);
 unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames);
 unsigned int pcm_bytes_to_frames(struct pcm *pcm, unsigned int bytes);
 
-/* Returns the pcm latency in ms */
+/* Returns the pcm latency in ms: how long a full buffer lasts */
 unsigned int pcm_get_latency(struct pcm *pcm);
 
+/* Returns how many frames it will take for the next frame written to
+ * be heard (playback), or how many frames ago the next frame read was
+ * recorded (capture), as reported by the driver.  Returns -1 on error.
+ */
+long pcm_get_delay(struct pcm *pcm);
+
+/* Returns the position of the hardware pointer, in frames since the
+ * start (modulo the ring boundary), and when it was there.  Fails if the
+ * stream isn't running.  The time stamp is on the same clock as
+ * pcm_get_htimestamp()'s.
+ */
+int pcm_get_hw_ptr(struct pcm *pcm, unsigned int *hw_ptr,
+                   struct timespec *tstamp);
+
 /* Returns available frames in pcm buffer and corresponding time stamp.
  * For an input stream, frames available are frames ready for the
  * application to read.
  * For an output stream, frames available are the number of empty frames available
  * for the application to write.
+ * The time stamp is on CLOCK_MONOTONIC if the stream was opened with
+ * PCM_MONOTONIC, CLOCK_REALTIME otherwise.
  */
 int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail,
                        struct timespec *tstamp);
@@ -151,10 +281,24 @@ int pcm_read(struct pcm *pcm, void *data, unsigned int count);
  * mmap() support.
  */
 int pcm_mmap_write(struct pcm *pcm, const void *data, unsigned int count);
+int pcm_mmap_read(struct pcm *pcm, void *data, unsigned int count);
 int pcm_mmap_begin(struct pcm *pcm, void **areas, unsigned int *offset,
                    unsigned int *frames);
 int pcm_mmap_commit(struct pcm *pcm, unsigned int offset, unsigned int frames);
 
+/* Returns the number of frames that can be written (playback) or read
+ * (capture) without blocking.
+ */
+int pcm_avail_update(struct pcm *pcm);
+
+/* Returns the stream state (PCM_STATE_*), or a negative value on error */
+int pcm_state(struct pcm *pcm);
+
+/* Prepare a PCM channel for transfers.  Does nothing if the channel is
+ * already prepared, so frames queued through the mmap() API are kept.
+ */
+int pcm_prepare(struct pcm *pcm);
+
 /* Start and stop a PCM channel that doesn't transfer data */
 int pcm_start(struct pcm *pcm);
 int pcm_stop(struct pcm *pcm);
@@ -0,0 +1,557 @@
+/*
+ * latency-test.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Measures the round trip latency of a loopback path: a stimulus is
+ * played on one PCM while another one captures, and the arrival of the
+ * stimulus is found by cross-correlation.
+ *
+ * Both streams are timestamped on CLOCK_MONOTONIC, so every played and
+ * captured frame can be placed in time.  The latency reported is from
+ * the moment a frame leaves the playback buffer to the moment it lands
+ * in the capture buffer, i.e. the path through the hardware.  Whatever
+ * the application queues on top of that is listed separately.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tinyalsa/asoundlib.h>
+
+#include "config.h"
+#include "latency-test.h"
+#include "fft.h"
+#include "rt-profile.h"
+
+/* Length of a trial: the stimulus, then silence while it comes back */
+#define TRIAL_MS 500
+
+/* Arrivals may be reported this early, to allow for timestamp error */
+#define EARLY_MS 1
+
+/* The MLS is 2^MLS_ORDER - 1 frames long */
+#define MLS_ORDER 12
+#define MLS_TAPS 0xe08
+
+/* Level of the stimulus, relative to full scale */
+#define STIMULUS_GAIN 0.5f
+
+/* A correlation peak below this many times the RMS of the correlation is
+ * not taken as an arrival
+ */
+#define MIN_PEAK_RATIO 8.0
+
+#define NSEC_PER_SEC 1000000000LL
+
+enum latency_stimulus {
+	LATENCY_PULSE,
+	LATENCY_MLS,
+};
+
+/* Where a stream was at a point in time */
+struct latency_anchor {
+	int64_t tstamp_ns;
+	double frame;
+};
+
+struct latency_stream {
+	struct pcm *pcm;
+	unsigned int buffer_size;
+	int16_t *period;
+	struct latency_anchor *anchors;	/* one per period */
+	unsigned int num_anchors;
+	unsigned int max_anchors;
+	uint64_t frames;		/* frames written or read */
+	int error;
+};
+
+struct latency_test {
+	unsigned int rate;
+	unsigned int channels;
+	unsigned int period_size;
+	unsigned int trials;
+	unsigned int trial_frames;
+	struct rt_profile rt;
+
+	float *stimulus;
+	unsigned int stimulus_frames;
+
+	struct latency_stream play;
+	struct latency_stream cap;
+	float *captured;		/* first channel of the capture */
+	uint64_t capture_frames;	/* size of captured */
+};
+
+static int64_t ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+/* Builds a maximum length sequence of +/-1 */
+static void latency_mls(float *out, unsigned int frames)
+{
+	unsigned int lfsr = 1, i;
+
+	for (i = 0; i < frames; i++) {
+		out[i] = (lfsr & 1) ? 1.0f : -1.0f;
+		lfsr = (lfsr >> 1) ^ ((lfsr & 1) ? MLS_TAPS : 0);
+	}
+}
+
+/* Records where the stream is now.  For playback, the frame is the one
+ * the hardware is about to play; for capture, the one it is about to
+ * record.
+ */
+static void latency_stream_anchor(struct latency_stream *s, int capture)
+{
+	struct latency_anchor *a;
+	struct timespec tstamp;
+	unsigned int avail;
+
+	if (s->num_anchors == s->max_anchors)
+		return;
+	if (pcm_get_htimestamp(s->pcm, &avail, &tstamp))
+		return;
+
+	a = &s->anchors[s->num_anchors++];
+	a->tstamp_ns = ts_to_ns(&tstamp);
+	if (capture)
+		a->frame = (double)s->frames + avail;
+	else
+		a->frame = (double)s->frames - (s->buffer_size - avail);
+}
+
+static void *latency_play_thread(void *arg)
+{
+	struct latency_test *t = arg;
+	struct latency_stream *s = &t->play;
+	uint64_t total = (uint64_t)(t->trials + 2) * t->trial_frames;
+	unsigned int i, c, pos, trial;
+	int16_t v;
+
+	if (rt_profile_enter(&t->rt)) {
+		s->error = 1;
+		return NULL;
+	}
+
+	/* a silent trial first, so capture is surely running at the first
+	 * stimulus, and one after, for the last one to come back
+	 */
+	while (s->frames < total) {
+		for (i = 0; i < t->period_size; i++) {
+			pos = (s->frames + i) % t->trial_frames;
+			trial = (s->frames + i) / t->trial_frames;
+			v = 0;
+			if ((trial >= 1) && (trial <= t->trials) &&
+			    (pos < t->stimulus_frames))
+				v = lrintf(t->stimulus[pos] * STIMULUS_GAIN * 32767.0f);
+			for (c = 0; c < t->channels; c++)
+				s->period[i * t->channels + c] = v;
+		}
+
+		if (pcm_write(s->pcm, s->period,
+			      pcm_frames_to_bytes(s->pcm, t->period_size))) {
+			fprintf(stderr, "Error playing (%s)\n",
+				pcm_get_error(s->pcm));
+			s->error = 1;
+			break;
+		}
+		s->frames += t->period_size;
+		latency_stream_anchor(s, 0);
+	}
+
+	return NULL;
+}
+
+static void *latency_capture_thread(void *arg)
+{
+	struct latency_test *t = arg;
+	struct latency_stream *s = &t->cap;
+	unsigned int i;
+
+	if (rt_profile_enter(&t->rt)) {
+		s->error = 1;
+		return NULL;
+	}
+
+	while (s->frames + t->period_size <= t->capture_frames) {
+		if (pcm_read(s->pcm, s->period,
+			     pcm_frames_to_bytes(s->pcm, t->period_size))) {
+			fprintf(stderr, "Error capturing (%s)\n",
+				pcm_get_error(s->pcm));
+			s->error = 1;
+			break;
+		}
+		for (i = 0; i < t->period_size; i++)
+			t->captured[s->frames + i] =
+				s->period[i * t->channels] / 32768.0f;
+		s->frames += t->period_size;
+		latency_stream_anchor(s, 1);
+	}
+
+	return NULL;
+}
+
+/* Returns the anchor closest to frame, or NULL if there is none */
+static const struct latency_anchor *
+latency_anchor_by_frame(const struct latency_stream *s, double frame)
+{
+	const struct latency_anchor *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < s->num_anchors; i++)
+		if (!best || (fabs(s->anchors[i].frame - frame) <
+			      fabs(best->frame - frame)))
+			best = &s->anchors[i];
+	return best;
+}
+
+/* Returns the anchor closest to tstamp_ns, or NULL if there is none */
+static const struct latency_anchor *
+latency_anchor_by_time(const struct latency_stream *s, int64_t tstamp_ns)
+{
+	const struct latency_anchor *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < s->num_anchors; i++)
+		if (!best || (llabs(s->anchors[i].tstamp_ns - tstamp_ns) <
+			      llabs(best->tstamp_ns - tstamp_ns)))
+			best = &s->anchors[i];
+	return best;
+}
+
+/* Cross-correlates window (trial_frames long) with the stimulus, whose
+ * spectrum is in sre/sim.  Returns the lag of the stimulus in window, in
+ * frames, or a negative value if it can't be found.
+ */
+static double latency_correlate(const struct latency_test *t,
+				const struct fft *f, const float *sre,
+				const float *sim, const float *window,
+				float *re, float *im, double *ratio)
+{
+	unsigned int lags = t->trial_frames - t->stimulus_frames + 1;
+	unsigned int i, peak = 0;
+	double sum2 = 0.0, a, b, c, den, sign;
+	float r, x, y;
+
+	memset(re, 0, f->size * sizeof(float));
+	memset(im, 0, f->size * sizeof(float));
+	memcpy(re, window, t->trial_frames * sizeof(float));
+	fft_forward(f, re, im);
+
+	/* window times the conjugate of the stimulus */
+	for (i = 0; i < f->size; i++) {
+		x = re[i];
+		y = im[i];
+		re[i] = x * sre[i] + y * sim[i];
+		im[i] = y * sre[i] - x * sim[i];
+	}
+	fft_inverse(f, re, im);
+
+	for (i = 0; i < lags; i++) {
+		r = fabsf(re[i]);
+		sum2 += (double)r * r;
+		if (r > fabsf(re[peak]))
+			peak = i;
+	}
+
+	*ratio = fabsf(re[peak]) / sqrt(sum2 / lags);
+	if (*ratio < MIN_PEAK_RATIO)
+		return -1.0;
+
+	/* fit a parabola through the peak for the fraction of a frame */
+	if ((peak == 0) || (peak == lags - 1))
+		return peak;
+	sign = (re[peak] < 0.0f) ? -1.0 : 1.0;
+	a = sign * re[peak - 1];
+	b = sign * re[peak];
+	c = sign * re[peak + 1];
+	den = a - 2.0 * b + c;
+	if (den >= 0.0)
+		return peak;
+	return peak + 0.5 * (a - c) / den;
+}
+
+static int latency_compare(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Finds each stimulus in the capture and prints the distribution */
+static int latency_analyze(struct latency_test *t, const char *name)
+{
+	const struct latency_anchor *pa, *ca;
+	unsigned int early = t->rate * EARLY_MS / 1000;
+	unsigned int size, i, found = 0;
+	float *sre, *sim, *re, *im;
+	double *results, frame, start, lag, ratio, mean = 0.0, var = 0.0;
+	int64_t emitted_ns;
+	struct fft f;
+	int ret;
+
+	for (size = 2; size < t->trial_frames + t->stimulus_frames; size *= 2)
+		;
+	ret = fft_init(&f, size);
+	if (ret)
+		return ret;
+
+	sre = calloc(4 * size, sizeof(float));
+	results = calloc(t->trials, sizeof(double));
+	if (!sre || !results) {
+		free(sre);
+		free(results);
+		fft_deinit(&f);
+		return ENOMEM;
+	}
+	sim = sre + size;
+	re = sim + size;
+	im = re + size;
+
+	memcpy(sre, t->stimulus, t->stimulus_frames * sizeof(float));
+	fft_forward(&f, sre, sim);
+
+	for (i = 1; i <= t->trials; i++) {
+		/* when trial i's stimulus left the playback buffer ... */
+		frame = (double)i * t->trial_frames;
+		pa = latency_anchor_by_frame(&t->play, frame);
+		if (!pa)
+			break;
+		emitted_ns = pa->tstamp_ns +
+			(int64_t)((frame - pa->frame) * NSEC_PER_SEC / t->rate);
+
+		/* ... and which captured frame was being recorded then */
+		ca = latency_anchor_by_time(&t->cap, emitted_ns);
+		if (!ca)
+			break;
+		frame = ca->frame +
+			(double)(emitted_ns - ca->tstamp_ns) * t->rate / NSEC_PER_SEC;
+
+		start = floor(frame) - early;
+		if ((start < 0.0) ||
+		    (start + t->trial_frames > (double)t->cap.frames)) {
+			printf("trial %u: not captured\n", i);
+			continue;
+		}
+
+		lag = latency_correlate(t, &f, sre, sim,
+					t->captured + (uint64_t)start,
+					re, im, &ratio);
+		if (lag < 0.0) {
+			printf("trial %u: no arrival (peak/rms %.1f)\n", i, ratio);
+			continue;
+		}
+
+		lag += start - frame;
+		results[found++] = lag * 1000.0 / t->rate;
+		printf("trial %u: %.3f ms (%.2f frames), peak/rms %.1f\n", i,
+		       lag * 1000.0 / t->rate, lag, ratio);
+	}
+
+	if (found) {
+		for (i = 0; i < found; i++)
+			mean += results[i];
+		mean /= found;
+		for (i = 0; i < found; i++)
+			var += (results[i] - mean) * (results[i] - mean);
+		var /= found;
+		qsort(results, found, sizeof(double), latency_compare);
+
+		printf("latency (%s, %u of %u trials): min %.3f ms, median %.3f ms, "
+		       "mean %.3f ms, max %.3f ms, stddev %.3f ms\n", name, found,
+		       t->trials, results[0], results[found / 2], mean,
+		       results[found - 1], sqrt(var));
+	} else {
+		printf("latency (%s): no arrivals in %u trials\n", name,
+		       t->trials);
+	}
+	printf("buffering adds up to %.3f ms playback, %.3f ms capture\n",
+	       t->play.buffer_size * 1000.0 / t->rate,
+	       t->period_size * 1000.0 / t->rate);
+
+	free(sre);
+	free(results);
+	fft_deinit(&f);
+	return found ? 0 : -1;
+}
+
+static int latency_stream_open(struct latency_stream *s, unsigned int card,
+			       unsigned int device, unsigned int flags,
+			       struct pcm_config *config, unsigned int anchors)
+{
+	memset(s, 0, sizeof(*s));
+	s->pcm = pcm_open(card, device, flags | PCM_MONOTONIC, config);
+	if (!s->pcm || !pcm_is_ready(s->pcm)) {
+		fprintf(stderr, "Unable to open PCM device %u (%s)\n", device,
+			pcm_get_error(s->pcm));
+		return -1;
+	}
+
+	s->buffer_size = pcm_get_buffer_size(s->pcm);
+	s->period = malloc(pcm_frames_to_bytes(s->pcm, config->period_size));
+	s->anchors = calloc(anchors, sizeof(*s->anchors));
+	s->max_anchors = anchors;
+	if (!s->period || !s->anchors) {
+		fprintf(stderr, "Unable to allocate buffers\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void latency_stream_close(struct latency_stream *s)
+{
+	if (s->pcm)
+		pcm_close(s->pcm);
+	free(s->period);
+	free(s->anchors);
+}
+
+static void usage(void)
+{
+	printf("Usage: audio-tool [options] latency [pulse|mls] [trials]\n");
+}
+
+int latency_test_main(const struct audio_tool_config *config, int argc, char **argv)
+{
+	struct latency_test t;
+	struct pcm_config pcm_config;
+	enum latency_stimulus stimulus = LATENCY_MLS;
+	unsigned int capture_device, anchors;
+	pthread_t play_thread, cap_thread;
+	int ret = 1;
+
+	memset(&t, 0, sizeof(t));
+	t.trials = 20;
+
+	if (argc > 3) {
+		usage();
+		return 1;
+	}
+	if (argc > 1) {
+		if (!strcmp(argv[1], "pulse")) {
+			stimulus = LATENCY_PULSE;
+		} else if (strcmp(argv[1], "mls")) {
+			usage();
+			return 1;
+		}
+	}
+	if (argc > 2)
+		t.trials = atoi(argv[2]);
+	if (!t.trials) {
+		usage();
+		return 1;
+	}
+
+	memset(&pcm_config, 0, sizeof(pcm_config));
+	pcm_config.channels = config->channels;
+	pcm_config.rate = config->rate;
+	pcm_config.period_size = config->period_size;
+	pcm_config.period_count = config->num_periods;
+	pcm_config.format = PCM_FORMAT_S16_LE;
+
+	t.rate = config->rate;
+	t.channels = config->channels;
+	t.trial_frames = t.rate * TRIAL_MS / 1000;
+	rt_profile_init(&t.rt, config->rt_priority, config->cpu, config->mlock);
+
+	t.stimulus_frames = (stimulus == LATENCY_MLS) ? (1u << MLS_ORDER) - 1 : 1;
+	if (t.stimulus_frames >= t.trial_frames / 2) {
+		fprintf(stderr, "Error: the rate is too low for the stimulus\n");
+		return 1;
+	}
+	t.stimulus = malloc(t.stimulus_frames * sizeof(float));
+	if (!t.stimulus)
+		return 1;
+	if (stimulus == LATENCY_MLS)
+		latency_mls(t.stimulus, t.stimulus_frames);
+	else
+		t.stimulus[0] = 1.0f;
+
+	/* capture starts first and runs a trial longer than playback */
+	t.capture_frames = (uint64_t)(t.trials + 4) * t.trial_frames;
+	t.captured = malloc(t.capture_frames * sizeof(float));
+	anchors = t.capture_frames / config->period_size + 1;
+
+	capture_device = (config->capture_device >= 0) ?
+		(unsigned int)config->capture_device : (unsigned int)config->device;
+	if (!t.captured ||
+	    latency_stream_open(&t.play, config->card, config->device, PCM_OUT,
+				&pcm_config, anchors))
+		goto done;
+	t.period_size = pcm_config.period_size;
+	if (latency_stream_open(&t.cap, config->card, capture_device, PCM_IN,
+				&pcm_config, anchors))
+		goto done;
+	if (pcm_config.period_size != t.period_size) {
+		fprintf(stderr, "Error: playback and capture periods differ\n");
+		goto done;
+	}
+	rt_profile_prefault(&t.rt, t.captured, t.capture_frames * sizeof(float));
+
+	printf("Measuring latency: %u trials of %s, %u ch, %u hz, period %u, "
+	       "capture device %u\n", t.trials,
+	       (stimulus == LATENCY_MLS) ? "MLS" : "a pulse", t.channels, t.rate,
+	       t.period_size, capture_device);
+
+	if (pthread_create(&cap_thread, NULL, latency_capture_thread, &t)) {
+		fprintf(stderr, "Unable to start capture thread\n");
+		goto done;
+	}
+	if (pthread_create(&play_thread, NULL, latency_play_thread, &t)) {
+		fprintf(stderr, "Unable to start playback thread\n");
+		pthread_join(cap_thread, NULL);
+		goto done;
+	}
+	pthread_join(play_thread, NULL);
+	pthread_join(cap_thread, NULL);
+
+	if (!t.play.error && !t.cap.error)
+		ret = latency_analyze(&t, (stimulus == LATENCY_MLS) ?
+				      "MLS" : "pulse") ? 1 : 0;
+
+done:
+	latency_stream_close(&t.play);
+	latency_stream_close(&t.cap);
+	free(t.captured);
+	free(t.stimulus);
+	return ret;
+}
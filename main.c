@@ -44,6 +44,10 @@
 #include "tinycap.h"
 #include "tinymix.h"
 #include "pulse-generator.h"
+#include "latency-test.h"
+#include "duplex.h"
+#include "multi.h"
+#include "caps.h"
 #include "tone-generator.h"
 #include "save.h"
 #include "restore.h"
@@ -91,6 +95,14 @@ int main(int argc, char* argv[])
 			ret = tinymix_main(&config, argc, argv, tinymix);
 		} else if (strcmp(argv[0], "pulse") == 0) {
 			ret = pulse_generator_main(&config, argc, argv);
+		} else if (strcmp(argv[0], "latency") == 0) {
+			ret = latency_test_main(&config, argc, argv);
+		} else if (strcmp(argv[0], "duplex") == 0) {
+			ret = duplex_main(&config, argc, argv);
+		} else if (strcmp(argv[0], "multi") == 0) {
+			ret = multi_main(&config, argc, argv);
+		} else if (strcmp(argv[0], "caps") == 0) {
+			ret = caps_main(&config, argc, argv);
 		} else if (strcmp(argv[0], "tone") == 0) {
 			ret = tone_generator_main(&config, argc, argv);
 		} else if (strcmp(argv[0], "save") == 0) {
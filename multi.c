@@ -0,0 +1,832 @@
+/*
+ * multi.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Runs several streams at once, on different ports, to test the way
+ * they interact: e.g. a tone on the Tones port during Multimedia
+ * playback, while capturing on another port.
+ *
+ * All the streams are served by one thread, from an event loop: a
+ * stream is only woken up when it can take or give a whole period, so
+ * none of them ever blocks the others.  Playback streams are filled
+ * before anything is started, then all the streams are started one
+ * after the other, from a common time origin.  Each logs what happens
+ * to it (start, xruns, end) against that origin, and the logs are
+ * merged into one timeline at the end, so an xrun on one port can be
+ * lined up with what the others were doing.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <tinyalsa/asoundlib.h>
+
+#include "config.h"
+#include "multi.h"
+#include "histogram.h"
+#include "pipeline.h"
+#include "reactor.h"
+#include "rt-profile.h"
+#include "tone-generator.h"
+#include "wav-reader.h"
+#include "wav-writer.h"
+#include "xrun.h"
+
+/* Events logged per stream; any more are counted but not kept */
+#define MULTI_MAX_EVENTS 256
+
+/* Seconds of each file to read ahead before starting */
+#define PREFETCH_SECONDS 1
+
+#define NSEC_PER_SEC 1000000000LL
+
+enum multi_kind {
+	MULTI_PLAY,
+	MULTI_TONE,
+	MULTI_CAP,
+};
+
+enum multi_event_type {
+	MULTI_EVENT_START,
+	MULTI_EVENT_XRUN,
+	MULTI_EVENT_END,
+	MULTI_EVENT_ERROR,
+};
+
+static const char *multi_event_names[] = {
+	[MULTI_EVENT_START] = "start",
+	[MULTI_EVENT_XRUN] = "xrun",
+	[MULTI_EVENT_END] = "end",
+	[MULTI_EVENT_ERROR] = "error",
+};
+
+struct multi_event {
+	int64_t ns;		/* since the common start */
+	uint64_t frame;
+	unsigned int stream;
+	enum multi_event_type type;
+};
+
+struct multi;
+
+struct multi_stream {
+	struct multi *m;
+	unsigned int index;
+	const char *spec;
+	enum multi_kind kind;
+	unsigned int device;
+	const char *path;
+
+	struct pcm *pcm;
+	struct pcm_config pcm_config;
+	unsigned int period_bytes;
+	char *buf;
+	uint64_t max_frames;	/* 0 for no limit */
+	uint64_t frames;	/* played or captured */
+
+	/* play */
+	struct wav_reader wav;
+	int have_wav;
+	struct pipeline pipeline;
+	int have_pipeline;
+	const char *data;
+	uint64_t data_frames;	/* left in the file */
+	int drained;
+
+	/* tone */
+	struct tone tone;
+	struct oscillator osc;
+	uint32_t channel_mask;
+	int bits;
+
+	/* cap */
+	struct wav_writer writer;
+	int have_writer;
+
+	struct reactor_source src;
+	struct reactor_source drain_src;	/* polls playback's last periods */
+	int draining;
+	int done;
+	int error;
+	int underruns;
+	int restart;		/* playback to start again after an xrun */
+	struct histogram intervals;	/* ns between periods */
+	int64_t last_ns;
+
+	struct multi_event events[MULTI_MAX_EVENTS];
+	unsigned int num_events;
+	unsigned int lost_events;
+};
+
+struct multi {
+	struct multi_stream *streams;
+	unsigned int num_streams;
+
+	unsigned int active;	/* streams not done yet */
+	int64_t start_ns;
+
+	struct reactor reactor;
+	struct reactor_source signal_src;
+	struct reactor_source stats_src;
+	struct rt_profile rt;
+};
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void multi_log(struct multi_stream *s, enum multi_event_type type,
+		      int64_t ns)
+{
+	struct multi_event *e;
+
+	if (s->num_events == MULTI_MAX_EVENTS) {
+		s->lost_events++;
+		return;
+	}
+	e = &s->events[s->num_events++];
+	e->ns = ns - s->m->start_ns;
+	e->frame = s->frames;
+	e->stream = s->index;
+	e->type = type;
+}
+
+/* Splits "kind:device:args" into its fields.  Returns 0 on success, -1
+ * if the spec is malformed.
+ */
+static int multi_parse(struct multi_stream *s, char *spec)
+{
+	char *kind = spec, *device, *args, *end;
+
+	s->spec = strdup(spec);
+	device = strchr(kind, ':');
+	if (!device)
+		return -1;
+	*device++ = '\0';
+	args = strchr(device, ':');
+	if (!args)
+		return -1;
+	*args++ = '\0';
+
+	s->device = strtoul(device, &end, 0);
+	if ((end == device) || *end)
+		return -1;
+
+	if (!strcmp(kind, "play"))
+		s->kind = MULTI_PLAY;
+	else if (!strcmp(kind, "tone"))
+		s->kind = MULTI_TONE;
+	else if (!strcmp(kind, "cap"))
+		s->kind = MULTI_CAP;
+	else
+		return -1;
+
+	s->path = args;
+	return *args ? 0 : -1;
+}
+
+static int multi_format(int bits, enum pcm_format *format)
+{
+	switch (bits) {
+	case 16: *format = PCM_FORMAT_S16_LE; break;
+	case 24: *format = PCM_FORMAT_S24_3LE; break;
+	case 32: *format = PCM_FORMAT_S32_LE; break;
+	default:
+		fprintf(stderr, "Error: %d-bit samples are not supported\n", bits);
+		return -1;
+	}
+	return 0;
+}
+
+static int multi_setup_play(struct multi_stream *s,
+			    const struct audio_tool_config *config)
+{
+	struct pipeline_params params;
+	enum sample_format format;
+	int ret;
+
+	ret = wav_reader_open(&s->wav, s->path);
+	if (ret == EINVAL) {
+		fprintf(stderr, "Error: '%s' is not a valid wave file (%s)\n",
+			s->path, s->wav.error);
+		return -1;
+	} else if (ret) {
+		fprintf(stderr, "Unable to open file '%s' (%s)\n", s->path,
+			strerror(ret));
+		return -1;
+	}
+	s->have_wav = 1;
+	if (sample_format_from_wav(s->wav.format, s->wav.bits, &format)) {
+		fprintf(stderr, "Error: '%s' has unsupported %u-bit samples\n",
+			s->path, s->wav.bits);
+		return -1;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.in_channels = s->wav.channels;
+	params.in_mask = ~0;
+	params.in_format = format;
+	params.in_rate = s->wav.rate;
+	params.out_channels = config->pcm_channels ?
+		(unsigned int)config->pcm_channels : s->wav.channels;
+	params.out_mask = config->channel_mask;
+	params.out_rate = config->pcm_rate ?
+		(unsigned int)config->pcm_rate : s->wav.rate;
+	if (config->pcm_format >= 0)
+		params.out_format = config->pcm_format;
+	else
+		params.out_format = sample_format_playable(format);
+	params.quality = config->resample_quality;
+	params.dither = config->dither;
+
+	ret = pipeline_init(&s->pipeline, &params);
+	if (ret) {
+		fprintf(stderr, "Unable to convert '%s' (%s)\n", s->path,
+			strerror(ret));
+		return -1;
+	}
+	s->have_pipeline = 1;
+
+	sample_format_to_pcm(params.out_format, &s->pcm_config.format);
+	s->pcm_config.channels = params.out_channels;
+	s->pcm_config.rate = params.out_rate;
+	s->data = s->wav.data;
+	s->data_frames = s->wav.data_bytes / s->wav.block_align;
+	wav_reader_prefetch(&s->wav, (size_t)PREFETCH_SECONDS * s->wav.rate *
+			    s->wav.block_align);
+	return 0;
+}
+
+static int multi_setup_tone(struct multi_stream *s,
+			    const struct audio_tool_config *config)
+{
+	char *wave = (char *)s->path, *freq, *vol;
+	const char *vol_db = "0";
+
+	freq = strchr(wave, ':');
+	if (!freq) {
+		fprintf(stderr, "Error: '%s' has no frequency\n", s->spec);
+		return -1;
+	}
+	*freq++ = '\0';
+	vol = strchr(freq, ':');
+	if (vol) {
+		*vol++ = '\0';
+		vol_db = vol;
+	}
+
+	if (multi_format(config->bits, &s->pcm_config.format))
+		return -1;
+	s->bits = config->bits;
+	s->channel_mask = config->channel_mask;
+	if (tone_init(&s->tone, wave, freq, vol_db, s->pcm_config.rate))
+		return -1;
+	oscillator_init(&s->osc, s->tone.table, s->tone.scale, s->tone.volume,
+			s->pcm_config.channels, s->channel_mask, s->bits);
+	return 0;
+}
+
+static int multi_setup_cap(struct multi_stream *s,
+			   const struct audio_tool_config *config)
+{
+	struct wav_writer_params params;
+	int ret;
+
+	if (multi_format(config->bits, &s->pcm_config.format))
+		return -1;
+
+	memset(&params, 0, sizeof(params));
+	params.format = WAV_FORMAT_PCM;
+	params.channels = s->pcm_config.channels;
+	params.rate = s->pcm_config.rate;
+	params.bits = config->bits;
+	params.max_bytes = s->max_frames * params.channels * params.bits / 8;
+	params.preallocate = (params.max_bytes != 0);
+
+	ret = wav_writer_open(&s->writer, s->path, &params);
+	if (ret) {
+		fprintf(stderr, "Unable to create file '%s' (%s)\n", s->path,
+			strerror(ret));
+		return -1;
+	}
+	s->have_writer = 1;
+	return 0;
+}
+
+static int multi_open(struct multi_stream *s,
+		      const struct audio_tool_config *config)
+{
+	int ret;
+
+	memset(&s->pcm_config, 0, sizeof(s->pcm_config));
+	s->pcm_config.channels = config->channels;
+	s->pcm_config.rate = config->rate;
+	s->pcm_config.period_size = config->period_size;
+	s->pcm_config.period_count = config->num_periods;
+	/* a ready stream always has a whole period to give or take */
+	s->pcm_config.avail_min = config->period_size;
+	s->max_frames = (uint64_t)config->duration * config->rate;
+
+	switch (s->kind) {
+	case MULTI_PLAY:
+		ret = multi_setup_play(s, config);
+		break;
+	case MULTI_TONE:
+		ret = multi_setup_tone(s, config);
+		break;
+	default:
+		ret = multi_setup_cap(s, config);
+		break;
+	}
+	if (ret)
+		return -1;
+
+	/* playback waits for the start line however full it is */
+	if (s->kind != MULTI_CAP)
+		s->pcm_config.start_threshold =
+			2 * config->period_size * config->num_periods;
+
+	s->pcm = pcm_open(config->card, s->device,
+			  (s->kind == MULTI_CAP) ? PCM_IN : PCM_OUT,
+			  &s->pcm_config);
+	if (!s->pcm || !pcm_is_ready(s->pcm)) {
+		fprintf(stderr, "Unable to open PCM device %u (%s)\n",
+			s->device, pcm_get_error(s->pcm));
+		return -1;
+	}
+	if (xrun_setup(s->pcm, config->xrun_policy, config->xrun_log))
+		return -1;
+
+	s->period_bytes = pcm_frames_to_bytes(s->pcm, s->pcm_config.period_size);
+	s->buf = calloc(1, s->period_bytes);
+	if (!s->buf) {
+		fprintf(stderr, "Unable to allocate buffer\n");
+		return -1;
+	}
+	rt_profile_prefault(&s->m->rt, s->buf, s->period_bytes);
+	return 0;
+}
+
+static void multi_close(struct multi_stream *s)
+{
+	if (s->pcm)
+		pcm_close(s->pcm);
+	if (s->have_pipeline)
+		pipeline_deinit(&s->pipeline);
+	if (s->have_wav)
+		wav_reader_close(&s->wav);
+	if (s->have_writer && wav_writer_close(&s->writer))
+		fprintf(stderr, "Error finishing '%s'\n", s->path);
+	free(s->buf);
+	free((char *)s->spec);
+}
+
+/* Fills the buffer with the next period of the file.  Returns the
+ * number of frames that came from the file, 0 at the end.
+ */
+static unsigned int multi_fill_play(struct multi_stream *s)
+{
+	unsigned int period = s->pcm_config.period_size, done = 0;
+	unsigned int in, out;
+
+	while (done < period) {
+		if (!s->data_frames && !s->drained) {
+			pipeline_drain(&s->pipeline);
+			s->drained = 1;
+		}
+		in = (s->data_frames < UINT32_MAX) ? s->data_frames : UINT32_MAX;
+		out = period - done;
+		pipeline_process(&s->pipeline, s->data, &in,
+				 s->buf + pcm_frames_to_bytes(s->pcm, done), &out);
+		s->data += in * s->wav.block_align;
+		s->data_frames -= in;
+		done += out;
+		if (!out && !in)
+			break;
+	}
+
+	if (done < period)
+		memset(s->buf + pcm_frames_to_bytes(s->pcm, done), 0,
+		       pcm_frames_to_bytes(s->pcm, period - done));
+	return done;
+}
+
+/* Moves one period.  Returns the number of frames it carried (short
+ * only for the last period of a file), 0 at the end, -1 on error.
+ */
+static int multi_period(struct multi_stream *s)
+{
+	unsigned int period = s->pcm_config.period_size, frames = period;
+	unsigned int done, count;
+
+	switch (s->kind) {
+	case MULTI_PLAY:
+		frames = multi_fill_play(s);
+		if (!frames)
+			return 0;
+		break;
+	case MULTI_TONE:
+		/* the oscillator renders at most UINT16_MAX frames a call */
+		for (done = 0; done < period; done += count) {
+			count = period - done;
+			if (count > UINT16_MAX)
+				count = UINT16_MAX;
+			oscillator_render(&s->osc,
+					  s->buf + pcm_frames_to_bytes(s->pcm, done),
+					  count);
+		}
+		break;
+	case MULTI_CAP:
+		if (pcm_read(s->pcm, s->buf, s->period_bytes)) {
+			fprintf(stderr, "[%u] Error capturing (%s)\n", s->index,
+				pcm_get_error(s->pcm));
+			return -1;
+		}
+		if (wav_writer_write(&s->writer, s->buf, s->period_bytes)) {
+			fprintf(stderr, "[%u] Error writing '%s'\n", s->index,
+				s->path);
+			return -1;
+		}
+		return period;
+	}
+
+	if (pcm_write(s->pcm, s->buf, s->period_bytes)) {
+		fprintf(stderr, "[%u] Error playing (%s)\n", s->index,
+			pcm_get_error(s->pcm));
+		return -1;
+	}
+	return frames;
+}
+
+static void multi_finish(struct multi_stream *s, int64_t ns)
+{
+	/* not started, or already finished */
+	if (s->done || ((s->src.fd < 0) && !s->draining))
+		return;
+	multi_log(s, MULTI_EVENT_END, ns);
+	if (s->draining)
+		reactor_remove(&s->drain_src);
+	else
+		reactor_remove(&s->src);
+	s->done = 1;
+	if (!--s->m->active)
+		reactor_stop(&s->m->reactor);
+}
+
+/* Finishes a draining playback stream once the hardware has played
+ * everything that was queued
+ */
+static int multi_on_drain(struct reactor_source *src, uint32_t events)
+{
+	struct multi_stream *s = src->data;
+	int avail = pcm_avail_update(s->pcm);
+
+	if ((avail < 0) || (avail >= (int)pcm_get_buffer_size(s->pcm)) ||
+	    (pcm_state(s->pcm) != PCM_STATE_RUNNING))
+		multi_finish(s, now_ns());
+	return 0;
+}
+
+/* Ends a stream that has nothing more to give.  pcm_close() would drop
+ * what playback still has queued, so it is polled once a period until
+ * that has played; the PCM itself can't be waited on, as it stays
+ * writable the whole time.
+ */
+static void multi_end(struct multi_stream *s, int64_t ns)
+{
+	unsigned int ms = 1000 * s->pcm_config.period_size / s->pcm_config.rate;
+
+	/* if it can't be polled, it is cut short */
+	if ((s->kind == MULTI_CAP) || s->draining ||
+	    reactor_add_timer(&s->m->reactor, &s->drain_src, ms ? ms : 1,
+			      multi_on_drain, s)) {
+		multi_finish(s, ns);
+		return;
+	}
+
+	reactor_remove(&s->src);
+	s->draining = 1;
+}
+
+static int multi_on_stream(struct reactor_source *src, uint32_t events)
+{
+	struct multi_stream *s = src->data;
+	int64_t ns;
+	int ret, underruns;
+
+	/* on an xrun, the transfer itself recovers, as the policy says */
+	ret = multi_period(s);
+	ns = now_ns();
+
+	underruns = pcm_get_underruns(s->pcm);
+	if (underruns != s->underruns) {
+		s->underruns = underruns;
+		s->restart = (s->kind != MULTI_CAP);
+		multi_log(s, MULTI_EVENT_XRUN, ns);
+	}
+
+	if (ret < 0) {
+		s->error = 1;
+		multi_log(s, MULTI_EVENT_ERROR, ns);
+		multi_finish(s, ns);
+		return 0;
+	}
+	if (!ret) {
+		multi_end(s, ns);
+		return 0;
+	}
+
+	histogram_record(&s->intervals, ns - s->last_ns);
+	s->last_ns = ns;
+	s->frames += ret;
+
+	/* playback is refilled after an underrun, but its start threshold
+	 * is out of reach (and with the skip policy, the refill may not
+	 * have come yet)
+	 */
+	if (s->restart && (pcm_state(s->pcm) == PCM_STATE_PREPARED)) {
+		s->restart = 0;
+		if (pcm_start(s->pcm)) {
+			fprintf(stderr, "[%u] Error restarting (%s)\n",
+				s->index, pcm_get_error(s->pcm));
+			s->error = 1;
+			multi_finish(s, ns);
+			return 0;
+		}
+	}
+
+	if (s->max_frames && (s->frames >= s->max_frames))
+		multi_end(s, ns);
+	return 0;
+}
+
+static int multi_on_signal(struct reactor_source *src, uint32_t events)
+{
+	reactor_stop(src->reactor);
+	return 0;
+}
+
+static int multi_on_stats(struct reactor_source *src, uint32_t events)
+{
+	struct multi *m = src->data;
+	struct multi_stream *s;
+	unsigned int i;
+
+	for (i = 0; i < m->num_streams; i++) {
+		s = &m->streams[i];
+		printf("[%u] %llu frames, %d xruns%s\n", i,
+		       (unsigned long long)s->frames, pcm_get_underruns(s->pcm),
+		       s->done ? ", done" : "");
+	}
+	return 0;
+}
+
+/* Fills playback, then starts every stream and watches it.  Returns 0
+ * on success, -1 on failure.
+ */
+static int multi_start(struct multi *m)
+{
+	struct multi_stream *s;
+	unsigned int i, p;
+	int ret;
+
+	for (i = 0; i < m->num_streams; i++) {
+		s = &m->streams[i];
+		for (p = 0; (s->kind != MULTI_CAP) &&
+			    (p < s->pcm_config.period_count); p++) {
+			ret = multi_period(s);
+			if (ret < 0)
+				return -1;
+			if (!ret)
+				break;
+			s->frames += ret;
+		}
+	}
+
+	m->start_ns = now_ns();
+	for (i = 0; i < m->num_streams; i++) {
+		s = &m->streams[i];
+		if (pcm_start(s->pcm)) {
+			fprintf(stderr, "[%u] Error starting (%s)\n", i,
+				pcm_get_error(s->pcm));
+			return -1;
+		}
+		s->last_ns = now_ns();
+		s->underruns = pcm_get_underruns(s->pcm);
+		multi_log(s, MULTI_EVENT_START, s->last_ns);
+
+		if (reactor_add_fd(&m->reactor, &s->src,
+				   pcm_get_file_descriptor(s->pcm),
+				   (s->kind == MULTI_CAP) ? EPOLLIN : EPOLLOUT,
+				   multi_on_stream, s)) {
+			fprintf(stderr, "[%u] Unable to watch the stream\n", i);
+			return -1;
+		}
+		m->active++;
+	}
+	return 0;
+}
+
+static int multi_run(struct multi *m, unsigned int stats_ms)
+{
+	sigset_t signals;
+	unsigned int i;
+	int ret;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	ret = reactor_init(&m->reactor);
+	if (!ret)
+		ret = reactor_add_signals(&m->reactor, &m->signal_src, &signals,
+					  multi_on_signal, m);
+	if (!ret && stats_ms)
+		ret = reactor_add_timer(&m->reactor, &m->stats_src, stats_ms,
+					multi_on_stats, m);
+	if (ret) {
+		fprintf(stderr, "Unable to set up the event loop (%s)\n",
+			strerror(ret));
+		reactor_deinit(&m->reactor);
+		return -1;
+	}
+
+	if (!rt_profile_enter(&m->rt) && !multi_start(m)) {
+		rt_profile_start(&m->rt);
+		ret = reactor_run(&m->reactor);
+		if (ret)
+			fprintf(stderr, "Error in the event loop (%s)\n",
+				strerror(ret));
+	} else {
+		ret = -1;
+	}
+
+	/* interrupted streams end here */
+	for (i = 0; i < m->num_streams; i++)
+		multi_finish(&m->streams[i], now_ns());
+
+	if (stats_ms)
+		reactor_remove(&m->stats_src);
+	reactor_remove(&m->signal_src);
+	reactor_deinit(&m->reactor);
+	return ret ? -1 : 0;
+}
+
+static int multi_event_cmp(const void *a, const void *b)
+{
+	const struct multi_event *x = a, *y = b;
+
+	if (x->ns != y->ns)
+		return (x->ns < y->ns) ? -1 : 1;
+	return (int)x->stream - (int)y->stream;
+}
+
+static void multi_report(struct multi *m)
+{
+	struct multi_stream *s;
+	struct multi_event *events, *e;
+	unsigned int i, n = 0;
+	char label[64];
+
+	for (i = 0; i < m->num_streams; i++) {
+		s = &m->streams[i];
+		printf("[%u] %s: %llu frames, %u xruns%s\n", i, s->spec,
+		       (unsigned long long)s->frames, pcm_get_underruns(s->pcm),
+		       s->error ? ", failed" : "");
+		snprintf(label, sizeof(label), "[%u] period interval", i);
+		histogram_print(&s->intervals, label, 1000000.0, "ms");
+		snprintf(label, sizeof(label), "[%u]", i);
+		xrun_report(s->pcm, label);
+		n += s->num_events;
+	}
+	rt_profile_report(&m->rt, "event loop");
+
+	events = malloc(n * sizeof(*events));
+	if (!events)
+		return;
+	for (n = 0, i = 0; i < m->num_streams; i++) {
+		s = &m->streams[i];
+		memcpy(events + n, s->events, s->num_events * sizeof(*events));
+		n += s->num_events;
+		if (s->lost_events)
+			printf("[%u] %u events not logged\n", i, s->lost_events);
+	}
+	qsort(events, n, sizeof(*events), multi_event_cmp);
+
+	printf("Timeline:\n");
+	for (e = events; e < events + n; e++)
+		printf("%12.3f ms  [%u] %s at frame %llu\n", e->ns / 1000000.0,
+		       e->stream, multi_event_names[e->type],
+		       (unsigned long long)e->frame);
+	free(events);
+}
+
+static void usage(void)
+{
+	printf("Usage: audio-tool [options] multi <stream>...\n");
+	printf("\n");
+	printf("stream:\n");
+	printf("    play:<device>:<file.wav>\n");
+	printf("    tone:<device>:<wave_type>:<frequency>[:<vol_db>]\n");
+	printf("    cap:<device>:<file.wav>\n");
+}
+
+int multi_main(const struct audio_tool_config *config, int argc, char **argv)
+{
+	struct multi m;
+	struct multi_stream *s;
+	unsigned int i;
+	int ret = 1;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+
+	memset(&m, 0, sizeof(m));
+	rt_profile_init(&m.rt, config->rt_priority, config->cpu, config->mlock);
+	m.num_streams = argc - 1;
+	/* each stream holds a histogram: too big for the stack */
+	m.streams = calloc(m.num_streams, sizeof(*m.streams));
+	if (!m.streams)
+		return 1;
+
+	for (i = 0; i < m.num_streams; i++) {
+		s = &m.streams[i];
+		s->m = &m;
+		s->index = i;
+		s->src.fd = -1;
+		histogram_init(&s->intervals);
+		if (multi_parse(s, argv[i + 1])) {
+			fprintf(stderr, "Error: '%s' is not a stream\n",
+				argv[i + 1]);
+			usage();
+			goto done;
+		}
+		if ((s->kind != MULTI_PLAY) && !config->duration)
+			printf("[%u] %s runs until interrupted\n", i, s->spec);
+	}
+
+	for (i = 0; i < m.num_streams; i++) {
+		s = &m.streams[i];
+		if (multi_open(s, config))
+			goto done;
+		printf("[%u] %s: device %u, %u ch, %u hz, %s, period %u\n",
+		       i, s->spec, s->device, s->pcm_config.channels,
+		       s->pcm_config.rate, sample_format_name(
+			       sample_format_from_pcm(s->pcm_config.format)),
+		       s->pcm_config.period_size);
+	}
+
+	ret = multi_run(&m, config->telemetry * 1000) ? 1 : 0;
+	for (i = 0; i < m.num_streams; i++)
+		if (m.streams[i].error)
+			ret = 1;
+	multi_report(&m);
+
+done:
+	for (i = 0; i < m.num_streams; i++)
+		multi_close(&m.streams[i]);
+	free(m.streams);
+	return ret;
+}
@@ -0,0 +1,206 @@
+/*
+ * noirq-scheduler.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <tinyalsa/asoundlib.h>
+
+#include "noirq-scheduler.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+/* Don't trust a rate measured over less than this */
+#define RATE_SPAN_NS 50000000LL
+
+/* How far the measured rate may stray from the nominal one before the
+ * measurement is thrown away as bogus (e.g. across a pause)
+ */
+#define MAX_DRIFT 0.05
+
+/* Shortest sleep, so a pointer that lags the prediction doesn't make us
+ * spin
+ */
+#define MIN_SLEEP_NS 100000LL
+
+static int64_t ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static void ns_to_ts(int64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ts_to_ns(&now);
+}
+
+void noirq_scheduler_init(struct noirq_scheduler *s, struct pcm *pcm,
+			  unsigned int rate)
+{
+	memset(s, 0, sizeof(*s));
+	s->pcm = pcm;
+	s->rate = rate;
+	s->buffer_size = pcm_get_buffer_size(pcm);
+	s->ns_per_frame = (double)NSEC_PER_SEC / rate;
+}
+
+/* Folds a new (timestamp, room) sample into the rate estimate.  The
+ * rate is measured from the first sample after the start, so the error
+ * of a single pointer reading shrinks as the stream runs.
+ */
+static void noirq_scheduler_update(struct noirq_scheduler *s,
+				   const struct timespec *tstamp,
+				   unsigned int avail)
+{
+	double nominal = (double)NSEC_PER_SEC / s->rate;
+	uint64_t played = s->written + avail - s->buffer_size;
+	int64_t span;
+	double measured;
+
+	if (!s->have_first) {
+		s->first_tstamp = *tstamp;
+		s->first_played = played;
+		s->have_first = 1;
+		return;
+	}
+
+	span = ts_to_ns(tstamp) - ts_to_ns(&s->first_tstamp);
+	if ((span < RATE_SPAN_NS) || (played <= s->first_played))
+		return;
+
+	measured = span / (double)(played - s->first_played);
+	if ((measured > nominal * (1.0 - MAX_DRIFT)) &&
+	    (measured < nominal * (1.0 + MAX_DRIFT)))
+		s->ns_per_frame = measured;
+}
+
+int noirq_scheduler_wait(struct noirq_scheduler *s, unsigned int frames,
+			 int timeout_ms)
+{
+	struct timespec tstamp, wake;
+	int64_t deadline = -1, now, t;
+	unsigned int avail, error;
+	int predicted = -1;
+	int ret;
+
+	if (frames > s->buffer_size)
+		frames = s->buffer_size;
+	if (timeout_ms >= 0)
+		deadline = now_ns() + timeout_ms * 1000000LL;
+
+	for (;;) {
+		if (pcm_get_htimestamp(s->pcm, &avail, &tstamp)) {
+			switch (pcm_state(s->pcm)) {
+			case PCM_STATE_XRUN:
+				return -EPIPE;
+			case PCM_STATE_SUSPENDED:
+				return -ESTRPIPE;
+			case PCM_STATE_DISCONNECTED:
+				return -ENODEV;
+			case PCM_STATE_RUNNING:
+			case PCM_STATE_DRAINING:
+				return -EIO;
+			default:
+				/* not started yet: whoever writes starts it */
+				return 1;
+			}
+		}
+
+		noirq_scheduler_update(s, &tstamp, avail);
+
+		if (predicted >= 0) {
+			error = (predicted > (int)avail) ?
+				predicted - avail : avail - predicted;
+			s->error_sum += error;
+			if (error > s->error_max)
+				s->error_max = error;
+			if (avail < frames)
+				s->early++;
+			predicted = -1;
+		}
+
+		if (avail >= frames)
+			return 1;
+
+		/* when the hardware pointer will have made enough room */
+		t = ts_to_ns(&tstamp) + (int64_t)((frames - avail) * s->ns_per_frame);
+		now = now_ns();
+		if (t < now + MIN_SLEEP_NS)
+			t = now + MIN_SLEEP_NS;
+		if ((deadline >= 0) && (t > deadline)) {
+			if (now >= deadline)
+				return 0;
+			t = deadline;
+		}
+
+		predicted = avail + (t - ts_to_ns(&tstamp)) / s->ns_per_frame;
+		ns_to_ts(t, &wake);
+		/* on a signal, the loop just looks again */
+		ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+		if (ret && (ret != EINTR))
+			return -ret;
+		s->wakeups++;
+	}
+}
+
+int noirq_scheduler_recover(struct noirq_scheduler *s)
+{
+	s->xruns++;
+	s->written = 0;
+	s->have_first = 0;
+
+	if (pcm_stop(s->pcm) || pcm_prepare(s->pcm))
+		return -EIO;
+	return 0;
+}
+
+void noirq_scheduler_report(const struct noirq_scheduler *s)
+{
+	printf("noirq: %u wakeups, %u early, prediction error %.1f avg %u max "
+	       "frames, measured rate %.1f hz, %u xruns\n", s->wakeups,
+	       s->early, s->wakeups ? (double)s->error_sum / s->wakeups : 0.0,
+	       s->error_max, NSEC_PER_SEC / s->ns_per_frame, s->xruns);
+}
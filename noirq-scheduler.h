@@ -0,0 +1,100 @@
+/*
+ * noirq-scheduler.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_NOIRQ_SCHEDULER_H__
+#define __AUDIO_TOOL_NOIRQ_SCHEDULER_H__
+
+#include <stdint.h>
+#include <time.h>
+
+struct pcm;
+
+/* Schedules refills of a playback stream opened with PCM_NOIRQ.
+ *
+ * Without period interrupts poll() never wakes up, so instead the
+ * position of the hardware pointer is predicted from the stream's
+ * timestamps (pcm_get_htimestamp()) and the thread sleeps with
+ * clock_nanosleep() until enough room is expected.  The consumption
+ * rate is measured as the stream runs, so a card whose clock is a
+ * little off doesn't make every prediction early or late.
+ *
+ * The PCM must be opened with PCM_MONOTONIC so that its timestamps are
+ * on the clock we sleep on.
+ */
+struct noirq_scheduler {
+	struct pcm *pcm;
+	unsigned int rate;
+	unsigned int buffer_size;
+	double ns_per_frame;		/* measured consumption rate */
+
+	uint64_t written;		/* frames committed since the start */
+	struct timespec first_tstamp;
+	uint64_t first_played;
+	int have_first;
+
+	/* statistics */
+	unsigned int wakeups;
+	unsigned int early;		/* wakeups that found too little room */
+	unsigned int xruns;
+	uint64_t error_sum;		/* |predicted - actual| room, in frames */
+	unsigned int error_max;
+};
+
+void noirq_scheduler_init(struct noirq_scheduler *s, struct pcm *pcm,
+			  unsigned int rate);
+
+/* Sleeps until there is room for at least frames frames.  Returns the
+ * same as pcm_wait(): 1 when there is room (or the stream isn't running
+ * yet), 0 on timeout and a negative errno on error (-EPIPE on xrun).
+ */
+int noirq_scheduler_wait(struct noirq_scheduler *s, unsigned int frames,
+			 int timeout_ms);
+
+/* Tells the scheduler that frames frames were written */
+static inline void noirq_scheduler_commit(struct noirq_scheduler *s,
+					  unsigned int frames)
+{
+	s->written += frames;
+}
+
+/* Gets the stream ready to restart after an xrun.  Returns 0 on success,
+ * -EIO on failure (see pcm_get_error()).
+ */
+int noirq_scheduler_recover(struct noirq_scheduler *s);
+
+void noirq_scheduler_report(const struct noirq_scheduler *s);
+
+#endif /* __AUDIO_TOOL_NOIRQ_SCHEDULER_H__ */
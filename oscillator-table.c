@@ -35,180 +35,671 @@
 #include <stdint.h>
 #include <limits.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "oscillator-table.h"
 
 /*#define CHECK_MATH*/
 
-typedef void (*write_to_buffer_func_t)(void *out, uint16_t frame, uint8_t channels,
-				       uint8_t channel, int16_t value);
+/* Frames looked up and scaled per pass, before being written out */
+#define BLOCK_FRAMES 64
 
-inline void write_s16_to_s8(void *out, uint16_t frame, uint8_t channels,
-				       uint8_t channel, int16_t value)
-{
-	int8_t *dest = out;
-	dest[frame * channels + channel] = value >> 8;
-}
+/* Interpolation weights are Q14, so that both a weight and 1.0 minus it
+ * fit in an int16_t.
+ */
+#define WEIGHT_SHIFT 14
+#define WEIGHT_ONE (1 << WEIGHT_SHIFT)
+#define GAIN_SHIFT 15
+
+/* The 32-bit path works in 64 bits, with Q30 weights and a Q31 gain */
+#define WEIGHT32_SHIFT 30
+#define WEIGHT32_ONE (1 << WEIGHT32_SHIFT)
+#define GAIN32_SHIFT 31
 
-inline void write_s16_to_s16(void *out, uint16_t frame, uint8_t channels,
-				       uint8_t channel, int16_t value)
+static inline int8_t s16_to_s8(int16_t value)
 {
-	int16_t *dest = out;
-	dest[frame * channels + channel] = value;
+	return value >> 8;
 }
 
-inline void write_s16_to_s24(void *out, uint16_t frame, uint8_t channels,
-				       uint8_t channel, int16_t value)
+/* Only for tables without 32-bit data.  The top bits are repeated in
+ * the new low ones, so 0x7FFF scales to 0x7FFFFF without a divide.
+ */
+static inline int32_t s16_to_s24(int16_t value)
 {
-	union s24_t {
-		int32_t v;
-		unsigned char c[4];
-	} val;
-	int64_t tmp = value;
-	unsigned char *d;
-
-	/* scale 0x7FFF to 0x7FFFFF */
-	tmp = (tmp * 0x7FFFFF) / 0x7FFF;
-	assert( tmp <= (int64_t)0x7FFFFF );
-	assert( (tmp >= 0) || (-tmp <= (int64_t)0x7FFFFF ) );
-	val.v = tmp;
-	d = out;
-	d += 3 * (frame * channels + channel);
-	d[0] = val.c[0];
-	d[1] = val.c[1];
-	d[2] = val.c[2];
+	return ((int32_t)value * 0x100) | ((value & 0x7FFF) >> 7);
 }
 
-inline void write_s16_to_s32(void *out, uint16_t frame, uint8_t channels,
-				       uint8_t channel, int16_t value)
+static inline int32_t s16_to_s32(int16_t value)
 {
-	int32_t *dest = out;
-	int64_t tmp = value;
-	int32_t v;
-
-	/* scale 0x7FFF to 0x7FFFFFFF */
-	tmp = (tmp * 0x7FFFFFFF) / 0x7FFF;
-	assert( tmp <= (int64_t)0x7FFFFFFF );
-	assert( (tmp >= 0) || (-tmp <= (int64_t)0x7FFFFFFF ) );
-	v = tmp;
-	dest[frame * channels + channel] = v;
+	return ((int32_t)value * 0x10000) | ((value & 0x7FFF) << 1) |
+		((value & 0x7FFF) >> 14);
 }
 
+static void oscillator_select(struct oscillator *osc);
+
 /**
- * \brief render an oscillator table to an output buffer, using the freq specified
+ * \brief set up an oscillator at the start of its wave
  *
- * \param out The output buffer (PCM16)
+ * \param osc The oscillator
  * \param tbl The source oscillator table
- * \param offset the frame offset of the wave as rendered on the output
- * \param count the number of frames to render this cycle
  * \param wave_scale specification of the desired output wavelength
+ * \param vol_frac An integer fraction (/ USHRT_MAX) for attenuating the signal
  * \param channels number of output channels in the buffer (range: [1,32])
  * \param clannel_mask mask indicating which channels to write to
- * \param vol_frac An integer fraction for attenuating the signal
- * \param format output bits (should be 8, 16, 24, or 32)
+ * \param bits output bits (8, 16, 24, or 32)
  *
- * \returns non-zero on error.
+ * 24- and 32-bit output is rendered from the table's 32-bit data, when
+ * it has some.
  */
-int oscillator_table_render(void *out, struct wave_table *tbl, uint32_t offset,
-		uint16_t count, const struct wave_scale wave_scale, uint8_t channels,
-		uint32_t channel_mask, uint16_t vol_frac, int bits)
+void oscillator_init(struct oscillator *osc, const struct wave_table *tbl,
+		const struct wave_scale wave_scale, uint16_t vol_frac,
+		uint8_t channels, uint32_t channel_mask, int bits)
 {
-	int32_t num;
-	const int32_t denom = USHRT_MAX;
-	uint32_t tbl_len, wave_len;
-	uint32_t k, frame, f_reg, r_reg;
-	uint32_t p;
-	int16_t val;
-	int32_t a, b;
-	uint8_t ch;
-	int32_t chbit;
-	char interpolate = 1;
-	int16_t shift;
-	uint32_t f;
-#ifdef CHECK_MATH
-	uint32_t ck_p, ck_tbl_len, ck_wave_len;
-#endif
-	write_to_buffer_func_t write_to_buffer;
+	uint64_t tbl_len, wave_len;
+	unsigned ch;
 
-	assert( out );
 	assert( tbl );
+	assert( IS_POWER_OF_TWO(tbl->length) );
 	assert( channels > 0 );
-	assert( 0 == (bits % 8) );
-	assert( bits > 0 );
-	assert( bits <= 32 );
+	assert( channels <= 32 );
+	assert( (bits == 8) || (bits == 16) || (bits == 24) || (bits == 32) );
+
+	tbl_len = (uint64_t)tbl->length << wave_scale.sub_shift;
+	wave_len = ((uint64_t)wave_scale.length << wave_scale.sub_shift) | wave_scale.sub;
+	assert( wave_len > 0 );
+
+	osc->tbl = tbl;
+	osc->phase = 0;
+	osc->wave_len = wave_len;
+	osc->step = (tbl_len << 32) / wave_len;
+	osc->step_rem = (tbl_len << 32) % wave_len;
+	osc->rem = 0;
+	osc->wide = (bits >= 24) && tbl->data32;
+	/* stepping over more than 4 entries, neighbours are too far apart
+	 * for a line between them to mean anything at 16 bits.  At 32 bits
+	 * the nearest entry can be out by far more than the noise floor, so
+	 * that always interpolates. */
+	osc->interpolate = osc->wide || ((osc->step >> 32) <= 4);
+	osc->unity = (vol_frac == USHRT_MAX);
+	osc->gain = ((uint32_t)vol_frac << GAIN_SHIFT) / USHRT_MAX;
+	osc->gain32 = ((uint64_t)vol_frac << GAIN32_SHIFT) / USHRT_MAX;
+
+	osc->channels = channels;
+	osc->channel_mask = channel_mask;
+	osc->bits = bits;
+	for (ch = 0 ; ch < channels ; ++ch)
+		osc->keep[ch] = ((channel_mask >> ch) & 1) ? -1 : 0;
+	oscillator_select(osc);
+}
+
+void oscillator_seek(struct oscillator *osc, uint32_t frame)
+{
+	uint64_t rem = (uint64_t)frame * osc->step_rem;
+
+	/* Wraps at 2^64, a multiple of the table's length << 32, so the
+	 * phase stays right however far in the frame is. */
+	osc->phase = (uint64_t)frame * osc->step + rem / osc->wave_len;
+	osc->rem = rem % osc->wave_len;
+}
+
+/* Looks up the entries either side of the phase for each frame, and the
+ * weight of the second.  The lookups are a gather, which neither SSE2
+ * nor NEON has, so this part is scalar.
+ */
+static void oscillator_lookup(struct oscillator *osc, int16_t *a, int16_t *b,
+		int16_t *w, unsigned n)
+{
+	const int16_t *data = osc->tbl->data;
+	const uint32_t mask = osc->tbl->mask;
+	uint64_t phase = osc->phase;
+	uint32_t rem = osc->rem;
+	uint32_t p;
+	unsigned k;
+
+	for (k = 0 ; k < n ; ++k) {
+		p = (phase >> 32) & mask;
+		a[k] = data[p];
+		/* the last entry's neighbour is the first */
+		b[k] = data[(p + 1) & mask];
+		w[k] = (uint32_t)phase >> (32 - WEIGHT_SHIFT);
+		phase += osc->step;
+		rem += osc->step_rem;
+		if (rem >= osc->wave_len) {
+			rem -= osc->wave_len;
+			++phase;
+		}
+	}
+	osc->phase = phase;
+	osc->rem = rem;
+}
+
+/* Looks up the entry at the phase for each frame, without interpolating */
+static void oscillator_lookup_nearest(struct oscillator *osc, int16_t *a,
+		unsigned n)
+{
+	const int16_t *data = osc->tbl->data;
+	const uint32_t mask = osc->tbl->mask;
+	uint64_t phase = osc->phase;
+	uint32_t rem = osc->rem;
+	unsigned k;
+
+	for (k = 0 ; k < n ; ++k) {
+		a[k] = data[(phase >> 32) & mask];
+		phase += osc->step;
+		rem += osc->step_rem;
+		if (rem >= osc->wave_len) {
+			rem -= osc->wave_len;
+			++phase;
+		}
+	}
+	osc->phase = phase;
+	osc->rem = rem;
+}
+
+/* As oscillator_lookup(), from the 32-bit data */
+static void oscillator_lookup32(struct oscillator *osc, int32_t *a, int32_t *b,
+		int32_t *w, unsigned n)
+{
+	const int32_t *data = osc->tbl->data32;
+	const uint32_t mask = osc->tbl->mask;
+	uint64_t phase = osc->phase;
+	uint32_t rem = osc->rem;
+	uint32_t p;
+	unsigned k;
+
+	for (k = 0 ; k < n ; ++k) {
+		p = (phase >> 32) & mask;
+		a[k] = data[p];
+		b[k] = data[(p + 1) & mask];
+		w[k] = (uint32_t)phase >> (32 - WEIGHT32_SHIFT);
+		phase += osc->step;
+		rem += osc->step_rem;
+		if (rem >= osc->wave_len) {
+			rem -= osc->wave_len;
+			++phase;
+		}
+	}
+	osc->phase = phase;
+	osc->rem = rem;
+}
+
+/* As oscillator_lookup_nearest(), from the 32-bit data */
+static void oscillator_lookup_nearest32(struct oscillator *osc, int32_t *a,
+		unsigned n)
+{
+	const int32_t *data = osc->tbl->data32;
+	const uint32_t mask = osc->tbl->mask;
+	uint64_t phase = osc->phase;
+	uint32_t rem = osc->rem;
+	unsigned k;
+
+	for (k = 0 ; k < n ; ++k) {
+		a[k] = data[(phase >> 32) & mask];
+		phase += osc->step;
+		rem += osc->step_rem;
+		if (rem >= osc->wave_len) {
+			rem -= osc->wave_len;
+			++phase;
+		}
+	}
+	osc->phase = phase;
+	osc->rem = rem;
+}
+
+/* The reference: what the vector paths below must match bit for bit */
+static void oscillator_mix_c(const struct oscillator *osc, int16_t *out,
+		const int16_t *a, const int16_t *b, const int16_t *w, unsigned n)
+{
+	int32_t val;
+	unsigned k;
+
+	for (k = 0 ; k < n ; ++k) {
+		val = ((int32_t)a[k] * (WEIGHT_ONE - w[k]) +
+		       (int32_t)b[k] * w[k]) >> WEIGHT_SHIFT;
+		if (!osc->unity)
+			val = (val * osc->gain) >> GAIN_SHIFT;
+		out[k] = val;
+	}
+}
+
+#if defined(__SSE2__)
+static void oscillator_mix(const struct oscillator *osc, int16_t *out,
+		const int16_t *a, const int16_t *b, const int16_t *w, unsigned n)
+{
+	const __m128i one = _mm_set1_epi16(WEIGHT_ONE);
+	/* (gain, 0) pairs, so madd() gives val * gain */
+	const __m128i gain = _mm_set1_epi32((uint16_t)osc->gain);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i va, vb, vw1, vw0, lo, hi, val;
+	unsigned k;
+
+	for (k = 0 ; k + 8 <= n ; k += 8) {
+		va = _mm_loadu_si128((const __m128i*)(a + k));
+		vb = _mm_loadu_si128((const __m128i*)(b + k));
+		vw1 = _mm_loadu_si128((const __m128i*)(w + k));
+		vw0 = _mm_sub_epi16(one, vw1);
+		/* a * (1 - w) + b * w, four frames at a time */
+		lo = _mm_madd_epi16(_mm_unpacklo_epi16(va, vb),
+				    _mm_unpacklo_epi16(vw0, vw1));
+		hi = _mm_madd_epi16(_mm_unpackhi_epi16(va, vb),
+				    _mm_unpackhi_epi16(vw0, vw1));
+		lo = _mm_srai_epi32(lo, WEIGHT_SHIFT);
+		hi = _mm_srai_epi32(hi, WEIGHT_SHIFT);
+		if (!osc->unity) {
+			val = _mm_packs_epi32(lo, hi);
+			lo = _mm_madd_epi16(_mm_unpacklo_epi16(val, zero), gain);
+			hi = _mm_madd_epi16(_mm_unpackhi_epi16(val, zero), gain);
+			lo = _mm_srai_epi32(lo, GAIN_SHIFT);
+			hi = _mm_srai_epi32(hi, GAIN_SHIFT);
+		}
+		_mm_storeu_si128((__m128i*)(out + k), _mm_packs_epi32(lo, hi));
+	}
+	oscillator_mix_c(osc, out + k, a + k, b + k, w + k, n - k);
+}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+static void oscillator_mix(const struct oscillator *osc, int16_t *out,
+		const int16_t *a, const int16_t *b, const int16_t *w, unsigned n)
+{
+	const int16x4_t one = vdup_n_s16(WEIGHT_ONE);
+	const int16x4_t gain = vdup_n_s16(osc->gain);
+	int16x4_t va, vb, vw1, val;
+	int32x4_t acc;
+	unsigned k;
+
+	for (k = 0 ; k + 4 <= n ; k += 4) {
+		va = vld1_s16(a + k);
+		vb = vld1_s16(b + k);
+		vw1 = vld1_s16(w + k);
+		/* a * (1 - w) + b * w */
+		acc = vmull_s16(va, vsub_s16(one, vw1));
+		acc = vmlal_s16(acc, vb, vw1);
+		val = vshrn_n_s32(acc, WEIGHT_SHIFT);
+		if (!osc->unity)
+			val = vshrn_n_s32(vmull_s16(val, gain), GAIN_SHIFT);
+		vst1_s16(out + k, val);
+	}
+	oscillator_mix_c(osc, out + k, a + k, b + k, w + k, n - k);
+}
+#else
+#define oscillator_mix oscillator_mix_c
+#endif
+
+/* Copies a block of mono samples to the channels in the mask, and zeros
+ * to the others.  The format is picked once per block, not per sample,
+ * and keep[ch] is all ones or all zeros, so there's no branch per sample.
+ */
+static void oscillator_write(void *out, uint32_t frame, const int16_t *val,
+		unsigned n, uint8_t channels, const int32_t *keep, int bits)
+{
+	unsigned k, ch, i = frame * channels;
+	int32_t v;
 
 	switch (bits) {
-	case 8: write_to_buffer = write_s16_to_s8; break;
-	case 16: write_to_buffer = write_s16_to_s16; break;
-	case 24: write_to_buffer = write_s16_to_s24; break;
-	case 32: write_to_buffer = write_s16_to_s32; break;
+	case 8: {
+		int8_t *dest = out;
+		for (k = 0 ; k < n ; ++k) {
+			v = s16_to_s8(val[k]);
+			for (ch = 0 ; ch < channels ; ++ch, ++i)
+				dest[i] = v & keep[ch];
+		}
+		break;
 	}
+	case 16: {
+		int16_t *dest = out;
+		for (k = 0 ; k < n ; ++k) {
+			v = val[k];
+			for (ch = 0 ; ch < channels ; ++ch, ++i)
+				dest[i] = v & keep[ch];
+		}
+		break;
+	}
+	case 24: {
+		unsigned char *dest = out;
+		for (k = 0 ; k < n ; ++k) {
+			v = s16_to_s24(val[k]);
+			for (ch = 0 ; ch < channels ; ++ch, ++i) {
+				int32_t s = v & keep[ch];
+				dest[3 * i] = s;
+				dest[3 * i + 1] = s >> 8;
+				dest[3 * i + 2] = s >> 16;
+			}
+		}
+		break;
+	}
+	case 32: {
+		int32_t *dest = out;
+		for (k = 0 ; k < n ; ++k) {
+			v = s16_to_s32(val[k]);
+			for (ch = 0 ; ch < channels ; ++ch, ++i)
+				dest[i] = v & keep[ch];
+		}
+		break;
+	}
+	}
+}
+
+/* As oscillator_write(), for 32-bit samples and 24- or 32-bit output */
+static void oscillator_write32(void *out, uint32_t frame, const int32_t *val,
+		unsigned n, uint8_t channels, const int32_t *keep, int bits)
+{
+	unsigned k, ch, i = frame * channels;
+	int32_t v;
 
-	num = vol_frac;
-	tbl_len = tbl->length << wave_scale.sub_shift;
-	wave_len = (wave_scale.length << wave_scale.sub_shift) | wave_scale.sub;
+	if (bits == 24) {
+		unsigned char *dest = out;
+		for (k = 0 ; k < n ; ++k) {
+			v = val[k] >> 8;
+			for (ch = 0 ; ch < channels ; ++ch, ++i) {
+				int32_t s = v & keep[ch];
+				dest[3 * i] = s;
+				dest[3 * i + 1] = s >> 8;
+				dest[3 * i + 2] = s >> 16;
+			}
+		}
+	} else {
+		int32_t *dest = out;
+		for (k = 0 ; k < n ; ++k) {
+			v = val[k];
+			for (ch = 0 ; ch < channels ; ++ch, ++i)
+				dest[i] = v & keep[ch];
+		}
+	}
+}
+
+/* Scales a block by the gain, as oscillator_mix_c() does */
+static void oscillator_gain(const struct oscillator *osc, int16_t *val,
+		unsigned n)
+{
+	unsigned k;
+
+	if (osc->unity)
+		return;
+	for (k = 0 ; k < n ; ++k)
+		val[k] = ((int32_t)val[k] * osc->gain) >> GAIN_SHIFT;
+}
+
+/* Interpolates and scales a block of 32-bit samples.  Neither SSE2 nor
+ * NEON multiplies 64-bit lanes, so this is left to the compiler.
+ */
+static void oscillator_mix32(const struct oscillator *osc, int32_t *out,
+		const int32_t *a, const int32_t *b, const int32_t *w, unsigned n)
+{
+	int64_t val;
+	unsigned k;
+
+	for (k = 0 ; k < n ; ++k) {
+		val = ((int64_t)a[k] * (WEIGHT32_ONE - w[k]) +
+		       (int64_t)b[k] * w[k]) >> WEIGHT32_SHIFT;
+		if (!osc->unity)
+			val = (val * osc->gain32) >> GAIN32_SHIFT;
+		out[k] = val;
+	}
+}
+
+/* Scales a block of 32-bit samples by the gain */
+static void oscillator_gain32(const struct oscillator *osc, int32_t *val,
+		unsigned n)
+{
+	unsigned k;
+
+	if (osc->unity)
+		return;
+	for (k = 0 ; k < n ; ++k)
+		val[k] = ((int64_t)val[k] * osc->gain32) >> GAIN32_SHIFT;
+}
+
+/* Computes the next n mono samples.  interpolate is a constant in each
+ * kernel, so the branch on it folds away.
+ */
+static inline void oscillator_block(struct oscillator *osc, int16_t *val,
+		unsigned n, const int interpolate)
+{
+	int16_t a[BLOCK_FRAMES], b[BLOCK_FRAMES], w[BLOCK_FRAMES];
 #ifdef CHECK_MATH
-	ck_tbl_len = (uint64_t)tbl->length << wave_scale.sub_shift;
-	ck_wave_len = ((uint64_t)wave_scale.length << wave_scale.sub_shift) | wave_scale.sub;
+	int16_t ck_val[BLOCK_FRAMES];
+	unsigned i;
 #endif
-	if ( (tbl_len / wave_len) > 4 )
-		interpolate = 0;
-
-	for (k=0 ; k < count ; ++k) {
-		/* This bit of code is over-optimized for 32-bit processors.
-		 * See the "CHECK_MATH" section for grokkable code.
-		 * Why?  Because it was a fun challenge.
-		 *
-		 * Strategy: Break "frame" into 8-bit chunks, and build
-		 * up "p", being careful to preserve remainders.
-		 */
-		assert( (1<<16) > tbl->mask ); /* uncomment code if this fails */
-		assert( wave_len == (wave_len & 0xFFFFFF) );
-		assert( tbl_len == (tbl_len & 0xFFFFFF) );
-		frame = offset + k;
-		p = 0;
-		f_reg = 0;
-		r_reg = 0;
-		for (shift=24 ; shift >= 0 ; shift -= 8) {
-			f = (frame >> shift) & 0xFF;
-			f_reg = f * tbl_len;
-			r_reg = (r_reg << 8) + f_reg % wave_len;
-			p = (p << 8) + f_reg / wave_len + r_reg / wave_len;
-			r_reg %= wave_len;
-		}
-		p &= tbl->mask;
+
+	if (!interpolate) {
+		oscillator_lookup_nearest(osc, val, n);
+		oscillator_gain(osc, val, n);
+		return;
+	}
+
+	oscillator_lookup(osc, a, b, w, n);
+	oscillator_mix(osc, val, a, b, w, n);
 #ifdef CHECK_MATH
-		ck_p = ((uint64_t)(offset + k) * ck_tbl_len) / ck_wave_len;
-		ck_p &= tbl->mask;
-		assert( p == ck_p );
+	oscillator_mix_c(osc, ck_val, a, b, w, n);
+	for (i = 0 ; i < n ; ++i)
+		assert( val[i] == ck_val[i] );
 #endif
-		if (interpolate) {
-			/* interpolate */
-			int32_t water;
-			a = tbl->data[p];
-			b = tbl->data[p + 1];
-			assert( (int32_t)r_reg >= 0 );
-			assert( (int32_t)wave_len >= 0 );
-			/* water down r_reg and wave_len if they will overflow */
-			water = 4;
-			while ((r_reg >> water) > 0x7FFF)
-				++water;
-			val = a + ((b-a) * ((int32_t)r_reg >> water)) / ((int32_t)wave_len >> water);
-			if (a < b)
-				assert( a <= val && val <= b );
-			else
-				assert( a >= val && val >= b );
-		} else {
-			val = tbl->data[p];
+}
+
+/* As oscillator_block(), at 32 bits from the table's 32-bit data */
+static inline void oscillator_block32(struct oscillator *osc, int32_t *val,
+		unsigned n, const int interpolate)
+{
+	int32_t a[BLOCK_FRAMES], b[BLOCK_FRAMES], w[BLOCK_FRAMES];
+
+	if (!interpolate) {
+		oscillator_lookup_nearest32(osc, val, n);
+		oscillator_gain32(osc, val, n);
+		return;
+	}
+
+	oscillator_lookup32(osc, a, b, w, n);
+	oscillator_mix32(osc, val, a, b, w, n);
+}
+
+/* The generic kernel: any channel count and mask */
+static void oscillator_render_generic(struct oscillator *osc, void *out,
+		unsigned count)
+{
+	int16_t val[BLOCK_FRAMES];
+	int32_t val32[BLOCK_FRAMES];
+	unsigned k, n;
+
+	for (k = 0 ; k < count ; k += n) {
+		n = count - k;
+		if (n > BLOCK_FRAMES)
+			n = BLOCK_FRAMES;
+		if (osc->wide) {
+			oscillator_block32(osc, val32, n, osc->interpolate);
+			oscillator_write32(out, k, val32, n, osc->channels,
+					   osc->keep, osc->bits);
+			continue;
 		}
-		val = (val * num) / denom;
-		for (ch = 0, chbit=1 ; ch < channels ; ++ch, chbit <<= 1) {
-			if ( channel_mask & chbit )
-				write_to_buffer(out, k, channels, ch, val);
-			else
-				write_to_buffer(out, k, channels, ch, 0);
+		oscillator_block(osc, val, n, osc->interpolate);
+		oscillator_write(out, k, val, n, osc->channels, osc->keep,
+				 osc->bits);
+	}
+}
+
+/* Specialized kernels, for every channel in the mask and a fixed format
+ * and channel count, so the compiler sees constant strides and loop
+ * counts.  STORE_<bits> puts sample v in channel c of the frame at d.
+ */
+#define BYTES_8		1
+#define BYTES_16	2
+#define BYTES_24	3
+#define BYTES_32	4
+
+#define STORE_8(d, c, v)	(((int8_t *)(d))[c] = (v))
+#define STORE_16(d, c, v)	(((int16_t *)(d))[c] = (v))
+#define STORE_24(d, c, v)						\
+	do {								\
+		(d)[3 * (c)] = (v);					\
+		(d)[3 * (c) + 1] = (v) >> 8;				\
+		(d)[3 * (c) + 2] = (v) >> 16;				\
+	} while (0)
+#define STORE_32(d, c, v)	(((int32_t *)(d))[c] = (v))
+
+/* How each format's samples are computed, and what it stores.  The 24-
+ * and 32-bit kernels work from the 32-bit data, so they're only picked
+ * for tables that have it.
+ */
+#define SAMPLE_8	int16_t
+#define SAMPLE_16	int16_t
+#define SAMPLE_24	int32_t
+#define SAMPLE_32	int32_t
+
+#define BLOCK_8		oscillator_block
+#define BLOCK_16	oscillator_block
+#define BLOCK_24	oscillator_block32
+#define BLOCK_32	oscillator_block32
+
+#define CONVERT_8(v)	s16_to_s8(v)
+#define CONVERT_16(v)	(v)
+#define CONVERT_24(v)	((v) >> 8)
+#define CONVERT_32(v)	(v)
+
+#define OSCILLATOR_KERNEL(bits, ch, interp)				\
+static void oscillator_render_##bits##_##ch##_##interp(			\
+		struct oscillator *osc, void *out, unsigned count)	\
+{									\
+	SAMPLE_##bits val[BLOCK_FRAMES];				\
+	unsigned char *d = out;						\
+	unsigned k, n, f, c;						\
+	int32_t v;							\
+									\
+	for (k = 0 ; k < count ; k += n) {				\
+		n = count - k;						\
+		if (n > BLOCK_FRAMES)					\
+			n = BLOCK_FRAMES;				\
+		BLOCK_##bits(osc, val, n, interp);			\
+		for (f = 0 ; f < n ; ++f, d += (ch) * BYTES_##bits) {	\
+			v = CONVERT_##bits(val[f]);			\
+			for (c = 0 ; c < (ch) ; ++c)			\
+				STORE_##bits(d, c, v);			\
+		}							\
+	}								\
+}
+
+#define OSCILLATOR_KERNELS(bits, ch)					\
+	OSCILLATOR_KERNEL(bits, ch, 0)					\
+	OSCILLATOR_KERNEL(bits, ch, 1)
+
+/* 32-bit data is always interpolated */
+#define OSCILLATOR_KERNELS_WIDE(bits, ch)				\
+	OSCILLATOR_KERNEL(bits, ch, 1)
+
+#define OSCILLATOR_KERNELS_FOR(bits, each)				\
+	each(bits, 1)							\
+	each(bits, 2)							\
+	each(bits, 4)							\
+	each(bits, 6)							\
+	each(bits, 8)							\
+	each(bits, 16)
+
+OSCILLATOR_KERNELS_FOR(8, OSCILLATOR_KERNELS)
+OSCILLATOR_KERNELS_FOR(16, OSCILLATOR_KERNELS)
+OSCILLATOR_KERNELS_FOR(24, OSCILLATOR_KERNELS_WIDE)
+OSCILLATOR_KERNELS_FOR(32, OSCILLATOR_KERNELS_WIDE)
+
+struct oscillator_kernel {
+	int bits;
+	uint8_t channels;
+	int interpolate;
+	oscillator_render_func render;
+	const char *name;
+};
+
+#define KERNEL(bits, ch, interp)					\
+	{ bits, ch, interp, oscillator_render_##bits##_##ch##_##interp,	\
+	  "s" #bits "x" #ch KERNEL_SUFFIX_##interp }
+
+#define KERNEL_SUFFIX_0 ""
+#define KERNEL_SUFFIX_1 ", interpolated"
+
+#define KERNELS_FOR(bits)						\
+	KERNEL(bits, 1, 0), KERNEL(bits, 1, 1),				\
+	KERNEL(bits, 2, 0), KERNEL(bits, 2, 1),				\
+	KERNEL(bits, 4, 0), KERNEL(bits, 4, 1),				\
+	KERNEL(bits, 6, 0), KERNEL(bits, 6, 1),				\
+	KERNEL(bits, 8, 0), KERNEL(bits, 8, 1),				\
+	KERNEL(bits, 16, 0), KERNEL(bits, 16, 1)
+
+#define KERNELS_WIDE_FOR(bits)						\
+	KERNEL(bits, 1, 1), KERNEL(bits, 2, 1), KERNEL(bits, 4, 1),	\
+	KERNEL(bits, 6, 1), KERNEL(bits, 8, 1), KERNEL(bits, 16, 1)
+
+static const struct oscillator_kernel g_kernels[] = {
+	KERNELS_FOR(8),
+	KERNELS_FOR(16),
+	KERNELS_WIDE_FOR(24),
+	KERNELS_WIDE_FOR(32),
+};
+
+/* Picks the kernel for the layout, once, rather than per sample */
+static void oscillator_select(struct oscillator *osc)
+{
+	const uint32_t all = (osc->channels == 32) ? ~0 :
+		((1U << osc->channels) - 1);
+	unsigned k;
+
+	osc->render = oscillator_render_generic;
+	osc->kernel = "generic";
+
+	if ((osc->channel_mask & all) != all)
+		return;
+	if ((osc->bits >= 24) && !osc->wide)
+		return;
+	for (k = 0 ; k < STATIC_ARRAY_SIZE(g_kernels) ; ++k) {
+		if ((g_kernels[k].bits == osc->bits) &&
+		    (g_kernels[k].channels == osc->channels) &&
+		    (g_kernels[k].interpolate == osc->interpolate)) {
+			osc->render = g_kernels[k].render;
+			osc->kernel = g_kernels[k].name;
+			return;
 		}
 	}
+}
 
+/**
+ * \brief render the next frames of an oscillator to an output buffer
+ *
+ * \param osc The oscillator, advanced by count frames
+ * \param out The output buffer
+ * \param count the number of frames to render this cycle
+ *
+ * \returns non-zero on error.
+ */
+int oscillator_render(struct oscillator *osc, void *out, uint16_t count)
+{
+	assert( out );
+	assert( osc->render );
+
+	osc->render(osc, out, count);
 	return 0;
 }
 
+/**
+ * \brief render an oscillator table to an output buffer, using the freq specified
+ *
+ * \param out The output buffer (PCM16)
+ * \param tbl The source oscillator table
+ * \param offset the frame offset of the wave as rendered on the output
+ * \param count the number of frames to render this cycle
+ * \param wave_scale specification of the desired output wavelength
+ * \param channels number of output channels in the buffer (range: [1,32])
+ * \param clannel_mask mask indicating which channels to write to
+ * \param vol_frac An integer fraction for attenuating the signal
+ * \param format output bits (should be 8, 16, 24, or 32)
+ *
+ * \returns non-zero on error.
+ */
+int oscillator_table_render(void *out, struct wave_table *tbl, uint32_t offset,
+		uint16_t count, const struct wave_scale wave_scale, uint8_t channels,
+		uint32_t channel_mask, uint16_t vol_frac, int bits)
+{
+	struct oscillator osc;
+
+	oscillator_init(&osc, tbl, wave_scale, vol_frac, channels,
+			channel_mask, bits);
+	oscillator_seek(&osc, offset);
+	return oscillator_render(&osc, out, count);
+}
@@ -33,6 +33,7 @@ struct wave_table {
 	uint16_t length; /* Must be a power of two */
 	uint16_t mask;   /* = length - 1 */
 	int16_t *data;
+	int32_t *data32; /* the same wave at 32 bits, or NULL */
 };
 
 struct wave_scale {
@@ -53,6 +54,63 @@ struct wave_scale {
 		.data = (t_data),					\
 	}
 
+/* A table with a native 32-bit copy, which 24- and 32-bit output is
+ * rendered from rather than scaled up from 16 bits */
+#define DECLARE_TABLE_S32(t_name, t_data, t_data32)			\
+	{								\
+		.name = (t_name),					\
+		.length = STATIC_ARRAY_SIZE(t_data),			\
+		.mask = STATIC_ARRAY_SIZE(t_data) - 1,			\
+		.data = (t_data),					\
+		.data32 = (t_data32),					\
+	}
+
+struct oscillator;
+
+typedef void (*oscillator_render_func)(struct oscillator *osc, void *out,
+		unsigned count);
+
+/* A running oscillator: the position in the table is a 32.32 fixed
+ * point phase, so each frame costs an add instead of a divide.  The
+ * step's remainder is carried too, so the phase never drifts from
+ * frame * table length / wave length.
+ */
+struct oscillator {
+	const struct wave_table *tbl;
+	uint64_t phase;     /* table entries, 32.32 */
+	uint64_t step;      /* phase added per frame */
+	uint32_t rem;       /* phase remainder, / wave_len */
+	uint32_t step_rem;  /* remainder added per frame */
+	uint32_t wave_len;
+	int interpolate;
+	int16_t gain;       /* Q15 */
+	int32_t gain32;     /* Q31, for the 32-bit path */
+	int unity;          /* gain is 1.0, so skip it */
+	int wide;           /* rendering from the table's 32-bit data */
+
+	/* output layout, and the kernel specialized for it */
+	uint8_t channels;
+	uint32_t channel_mask;
+	int bits;
+	int32_t keep[32];   /* all ones for the channels in the mask */
+	oscillator_render_func render;
+	const char *kernel;
+};
+
+/* Picks the render kernel for the layout, so it's done once rather than
+ * for every period
+ */
+void oscillator_init(struct oscillator *osc, const struct wave_table *tbl,
+		const struct wave_scale wave_scale, uint16_t vol_frac,
+		uint8_t channels, uint32_t channel_mask, int bits);
+
+/* Moves the phase to where the given frame of the wave starts */
+void oscillator_seek(struct oscillator *osc, uint32_t frame);
+
+/* Renders the next count frames and advances the phase */
+int oscillator_render(struct oscillator *osc, void *out, uint16_t count);
+
+/* Renders count frames from frame offset, without keeping any state */
 int oscillator_table_render(void *out, struct wave_table *tbl, uint32_t offset,
 		uint16_t count, const struct wave_scale wave_scale, uint8_t channels,
 		uint32_t channel_mask, uint16_t vol_frac, int bits);
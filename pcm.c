@@ -34,6 +34,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <poll.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -146,7 +147,13 @@ struct pcm {
     int fd;
     unsigned int flags;
     int running:1;
+    int prepared:1;
     int underruns;
+    enum pcm_xrun_policy xrun_policy;
+    struct pcm_xrun *xrun_log;  /* ring of the last xrun_log_size xruns */
+    unsigned int xrun_log_size;
+    unsigned long skip_frames;  /* still to drop or fill after an xrun */
+    void *silence;              /* a period, for PCM_XRUN_SILENCE */
     unsigned int buffer_size;
     unsigned int boundary;
     char error[PCM_ERROR_MAX];
@@ -163,6 +170,11 @@ unsigned int pcm_get_buffer_size(struct pcm *pcm)
     return pcm->buffer_size;
 }
 
+int pcm_get_underruns(struct pcm *pcm)
+{
+    return pcm->underruns;
+}
+
 const char* pcm_get_error(struct pcm *pcm)
 {
     return pcm->error;
@@ -184,6 +196,128 @@ static int oops(struct pcm *pcm, int e, const char *fmt, ...)
     return -1;
 }
 
+int pcm_set_xrun_policy(struct pcm *pcm, enum pcm_xrun_policy policy)
+{
+    if ((policy == PCM_XRUN_SILENCE) && !(pcm->flags & PCM_IN) &&
+        !pcm->silence) {
+        pcm->silence = calloc(1, pcm_frames_to_bytes(pcm,
+                                                     pcm->config.period_size));
+        if (!pcm->silence)
+            return oops(pcm, ENOMEM, "cannot allocate silence");
+    }
+
+    pcm->xrun_policy = policy;
+    pcm->skip_frames = 0;
+    return 0;
+}
+
+int pcm_set_xrun_log(struct pcm *pcm, unsigned int size)
+{
+    struct pcm_xrun *log = NULL;
+
+    if (size) {
+        log = calloc(size, sizeof(*log));
+        if (!log)
+            return oops(pcm, ENOMEM, "cannot allocate xrun log");
+    }
+
+    free(pcm->xrun_log);
+    pcm->xrun_log = log;
+    pcm->xrun_log_size = size;
+    return 0;
+}
+
+unsigned int pcm_get_xruns(struct pcm *pcm, struct pcm_xrun *xruns,
+                           unsigned int max)
+{
+    unsigned int kept, first, i;
+
+    kept = pcm->underruns;
+    if (kept > pcm->xrun_log_size)
+        kept = pcm->xrun_log_size;
+    if (kept > max)
+        kept = max;
+
+    first = pcm->underruns - kept;
+    for (i = 0; i < kept; i++)
+        xruns[i] = pcm->xrun_log[(first + i) % pcm->xrun_log_size];
+    return kept;
+}
+
+/* Counts and logs an xrun, before the stream is prepared again.  Returns
+ * the number of frames the stream missed while it was stopped.
+ */
+static unsigned long pcm_xrun(struct pcm *pcm)
+{
+    struct snd_pcm_status status;
+    struct pcm_xrun *x = NULL;
+    unsigned long lost = 0;
+    long long ns;
+
+    if (pcm->xrun_log_size) {
+        x = &pcm->xrun_log[pcm->underruns % pcm->xrun_log_size];
+        memset(x, 0, sizeof(*x));
+        clock_gettime(CLOCK_MONOTONIC, &x->tstamp);
+    }
+    pcm->underruns++;
+
+    memset(&status, 0, sizeof(status));
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_STATUS, &status) == 0) {
+        /* trigger_tstamp is when the stream stopped, tstamp is now */
+        ns = (status.tstamp.tv_sec - status.trigger_tstamp.tv_sec) *
+            1000000000LL + status.tstamp.tv_nsec -
+            status.trigger_tstamp.tv_nsec;
+        if (ns > 0)
+            lost = ns * pcm->config.rate / 1000000000LL;
+
+        /* captured frames never read are thrown away with the buffer */
+        if (pcm->flags & PCM_IN)
+            lost += (status.hw_ptr - status.appl_ptr + pcm->boundary) %
+                pcm->boundary;
+
+        if (x) {
+            x->hw_ptr = status.hw_ptr;
+            x->appl_ptr = status.appl_ptr;
+            x->lost = lost;
+        }
+    }
+
+    /* the mmap calls leave recovery to the caller */
+    if ((pcm->xrun_policy == PCM_XRUN_SKIP) && !(pcm->flags & PCM_MMAP)) {
+        pcm->skip_frames += lost;
+        if (x)
+            x->skipped = lost;
+    }
+    return lost;
+}
+
+/* Queues silence up to the start threshold, less the frames about to be
+ * written.  Returns 0 on success, -1 on failure.
+ */
+static int pcm_refill(struct pcm *pcm, unsigned int frames)
+{
+    struct snd_xferi x;
+    unsigned int fill;
+
+    /* a start threshold past the buffer is never reached this way */
+    fill = pcm->config.start_threshold;
+    if (fill > pcm->buffer_size)
+        fill = pcm->buffer_size;
+    if (frames >= fill)
+        return 0;
+    fill -= frames;
+
+    while (fill) {
+        x.buf = pcm->silence;
+        x.frames = (fill < pcm->config.period_size) ?
+            fill : pcm->config.period_size;
+        if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x))
+            return oops(pcm, errno, "cannot write silence");
+        fill -= x.frames;
+    }
+    return 0;
+}
+
 static unsigned int pcm_format_to_alsa(enum pcm_format format)
 {
     switch (format) {
@@ -193,6 +327,8 @@ static unsigned int pcm_format_to_alsa(enum pcm_format format)
         return SNDRV_PCM_FORMAT_S8;
     case PCM_FORMAT_S24_LE:
         return SNDRV_PCM_FORMAT_S24_LE;
+    case PCM_FORMAT_S24_3LE:
+        return SNDRV_PCM_FORMAT_S24_3LE;
     default:
     case PCM_FORMAT_S16_LE:
         return SNDRV_PCM_FORMAT_S16_LE;
@@ -203,7 +339,12 @@ static unsigned int pcm_format_to_bits(enum pcm_format format)
 {
     switch (format) {
     case PCM_FORMAT_S32_LE:
+    case PCM_FORMAT_S24_LE:
         return 32;
+    case PCM_FORMAT_S24_3LE:
+        return 24;
+    case PCM_FORMAT_S8:
+        return 8;
     default:
     case PCM_FORMAT_S16_LE:
         return 16;
@@ -222,11 +363,136 @@ unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames)
         (pcm_format_to_bits(pcm->config.format) >> 3);
 }
 
+struct pcm_params {
+    int fd;
+    struct snd_pcm_hw_params hw;
+};
+
+static const int pcm_param_to_alsa[PCM_PARAM_MAX] = {
+    [PCM_PARAM_SAMPLE_BITS] = SNDRV_PCM_HW_PARAM_SAMPLE_BITS,
+    [PCM_PARAM_FRAME_BITS] = SNDRV_PCM_HW_PARAM_FRAME_BITS,
+    [PCM_PARAM_CHANNELS] = SNDRV_PCM_HW_PARAM_CHANNELS,
+    [PCM_PARAM_RATE] = SNDRV_PCM_HW_PARAM_RATE,
+    [PCM_PARAM_PERIOD_TIME] = SNDRV_PCM_HW_PARAM_PERIOD_TIME,
+    [PCM_PARAM_PERIOD_SIZE] = SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+    [PCM_PARAM_PERIOD_BYTES] = SNDRV_PCM_HW_PARAM_PERIOD_BYTES,
+    [PCM_PARAM_PERIODS] = SNDRV_PCM_HW_PARAM_PERIODS,
+    [PCM_PARAM_BUFFER_TIME] = SNDRV_PCM_HW_PARAM_BUFFER_TIME,
+    [PCM_PARAM_BUFFER_SIZE] = SNDRV_PCM_HW_PARAM_BUFFER_SIZE,
+    [PCM_PARAM_BUFFER_BYTES] = SNDRV_PCM_HW_PARAM_BUFFER_BYTES,
+};
+
+static inline int param_test_mask(struct snd_pcm_hw_params *p, int n,
+                                  unsigned int bit)
+{
+    struct snd_mask *m = param_to_mask(p, n);
+
+    return !!(m->bits[bit >> 5] & (1 << (bit & 31)));
+}
+
+struct pcm_params *pcm_params_get(unsigned int card, unsigned int device,
+                                  unsigned int flags)
+{
+    struct pcm_params *params;
+    char fn[256];
+    int e;
+
+    params = calloc(1, sizeof(*params));
+    if (!params)
+        return NULL;
+
+    snprintf(fn, sizeof(fn), "/dev/snd/pcmC%uD%u%c", card, device,
+             flags & PCM_IN ? 'c' : 'p');
+
+    /* don't wait for a busy stream to be let go */
+    params->fd = open(fn, O_RDWR | O_NONBLOCK);
+    if (params->fd < 0)
+        goto fail;
+
+    param_init(&params->hw);
+    if (ioctl(params->fd, SNDRV_PCM_IOCTL_HW_REFINE, &params->hw))
+        goto fail_close;
+
+    return params;
+
+fail_close:
+    e = errno;
+    close(params->fd);
+    errno = e;
+fail:
+    free(params);
+    return NULL;
+}
+
+void pcm_params_free(struct pcm_params *params)
+{
+    if (!params)
+        return;
+    close(params->fd);
+    free(params);
+}
+
+unsigned int pcm_params_get_min(struct pcm_params *params,
+                                enum pcm_param param)
+{
+    struct snd_interval *i;
+
+    if (!params || param >= PCM_PARAM_MAX)
+        return 0;
+    i = param_to_interval(&params->hw, pcm_param_to_alsa[param]);
+    return i->openmin ? i->min + 1 : i->min;
+}
+
+unsigned int pcm_params_get_max(struct pcm_params *params,
+                                enum pcm_param param)
+{
+    struct snd_interval *i;
+
+    if (!params || param >= PCM_PARAM_MAX)
+        return 0;
+    i = param_to_interval(&params->hw, pcm_param_to_alsa[param]);
+    return i->openmax ? i->max - 1 : i->max;
+}
+
+int pcm_params_format_test(struct pcm_params *params, enum pcm_format format)
+{
+    if (!params || format >= PCM_FORMAT_MAX)
+        return 0;
+    return param_test_mask(&params->hw, SNDRV_PCM_HW_PARAM_FORMAT,
+                           pcm_format_to_alsa(format));
+}
+
+int pcm_params_mmap_test(struct pcm_params *params)
+{
+    if (!params)
+        return 0;
+    return param_test_mask(&params->hw, SNDRV_PCM_HW_PARAM_ACCESS,
+                           SNDRV_PCM_ACCESS_MMAP_INTERLEAVED);
+}
+
+int pcm_params_test(struct pcm_params *params, enum pcm_param param,
+                    unsigned int value)
+{
+    struct snd_pcm_hw_params hw;
+
+    if (!params || param >= PCM_PARAM_MAX)
+        return 0;
+
+    hw = params->hw;
+    param_set_int(&hw, pcm_param_to_alsa[param], value);
+    return !ioctl(params->fd, SNDRV_PCM_IOCTL_HW_REFINE, &hw);
+}
+
 static int pcm_sync_ptr(struct pcm *pcm, int flags) {
     if (pcm->sync_ptr) {
         pcm->sync_ptr->flags = flags;
         if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_SYNC_PTR, pcm->sync_ptr) < 0)
             return -1;
+    } else if (flags & SNDRV_PCM_SYNC_PTR_HWSYNC) {
+        /* a mapped status page is only brought up to date on request,
+         * which matters without period interrupts; this fails when the
+         * stream isn't running, and the state then says why */
+        ioctl(pcm->fd, SNDRV_PCM_IOCTL_HWSYNC);
     }
     return 0;
 }
@@ -286,21 +552,25 @@ static void pcm_hw_munmap_status(struct pcm *pcm) {
 }
 
 static int pcm_areas_copy(struct pcm *pcm, unsigned int pcm_offset,
-                          const char *src, unsigned int src_offset,
+                          char *buf, unsigned int buf_offset,
                           unsigned int frames)
 {
     int size_bytes = pcm_frames_to_bytes(pcm, frames);
     int pcm_offset_bytes = pcm_frames_to_bytes(pcm, pcm_offset);
-    int src_offset_bytes = pcm_frames_to_bytes(pcm, src_offset);
+    int buf_offset_bytes = pcm_frames_to_bytes(pcm, buf_offset);
 
     /* interleaved only atm */
-    memcpy((char*)pcm->mmap_buffer + pcm_offset_bytes,
-           src + src_offset_bytes, size_bytes);
+    if (pcm->flags & PCM_IN)
+        memcpy(buf + buf_offset_bytes,
+               (char*)pcm->mmap_buffer + pcm_offset_bytes, size_bytes);
+    else
+        memcpy((char*)pcm->mmap_buffer + pcm_offset_bytes,
+               buf + buf_offset_bytes, size_bytes);
     return 0;
 }
 
-static int pcm_mmap_write_areas(struct pcm *pcm, const char *src,
-                                unsigned int offset, unsigned int size)
+static int pcm_mmap_transfer_areas(struct pcm *pcm, char *buf,
+                                   unsigned int offset, unsigned int size)
 {
     void *pcm_areas;
     int commit;
@@ -309,7 +579,7 @@ static int pcm_mmap_write_areas(struct pcm *pcm, const char *src,
     while (size > 0) {
         frames = size;
         pcm_mmap_begin(pcm, &pcm_areas, &pcm_offset, &frames);
-        pcm_areas_copy(pcm, pcm_offset, src, offset, frames);
+        pcm_areas_copy(pcm, pcm_offset, buf, offset, frames);
         commit = pcm_mmap_commit(pcm, pcm_offset, frames);
         if (commit < 0) {
             oops(pcm, commit, "failed to commit %d frames\n", frames);
@@ -359,9 +629,47 @@ int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail,
     return 0;
 }
 
+int pcm_get_hw_ptr(struct pcm *pcm, unsigned int *hw_ptr,
+                   struct timespec *tstamp)
+{
+    if (!pcm_is_ready(pcm))
+        return -1;
+
+    pcm_sync_ptr(pcm, SNDRV_PCM_SYNC_PTR_HWSYNC);
+
+    if ((pcm->mmap_status->state != PCM_STATE_RUNNING) &&
+            (pcm->mmap_status->state != PCM_STATE_DRAINING))
+        return -1;
+
+    *tstamp = pcm->mmap_status->tstamp;
+    if (tstamp->tv_sec == 0 && tstamp->tv_nsec == 0)
+        return -1;
+
+    *hw_ptr = pcm->mmap_status->hw_ptr;
+    return 0;
+}
+
+unsigned int pcm_get_latency(struct pcm *pcm)
+{
+    return pcm->buffer_size * 1000 / pcm->config.rate;
+}
+
+long pcm_get_delay(struct pcm *pcm)
+{
+    snd_pcm_sframes_t delay;
+
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_DELAY, &delay) < 0) {
+        oops(pcm, errno, "cannot get delay");
+        return -1;
+    }
+    return delay;
+}
+
 int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
 {
     struct snd_xferi x;
+    unsigned long skip;
+    int refill = 0;
 
     if (pcm->flags & PCM_IN)
         return -EINVAL;
@@ -371,9 +679,20 @@ int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
                         pcm_format_to_bits(pcm->config.format) / 8);
 
     for (;;) {
+        if (pcm->skip_frames) {
+            /* drop what should have played during the xrun */
+            skip = (pcm->skip_frames < x.frames) ? pcm->skip_frames : x.frames;
+            x.buf = (char *)x.buf + pcm_frames_to_bytes(pcm, skip);
+            x.frames -= skip;
+            pcm->skip_frames -= skip;
+            if (!x.frames)
+                return 0;
+        }
         if (!pcm->running) {
-            if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_PREPARE))
-                return oops(pcm, errno, "cannot prepare channel");
+            if (pcm_prepare(pcm))
+                return -1;
+            if (refill && pcm_refill(pcm, x.frames))
+                return -1;
             if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x))
                 return oops(pcm, errno, "cannot write initial data");
             pcm->running = 1;
@@ -381,13 +700,16 @@ int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
         }
         if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x)) {
             pcm->running = 0;
+            pcm->prepared = 0;
             if (errno == EPIPE) {
                 /* we failed to make our window -- try to restart if we are
                  * allowed to do so.  Otherwise, simply allow the EPIPE error to
                  * propagate up to the app level */
-                pcm->underruns++;
-                if (pcm->flags & PCM_NORESTART)
+                pcm_xrun(pcm);
+                if ((pcm->flags & PCM_NORESTART) ||
+                    (pcm->xrun_policy == PCM_XRUN_FAIL))
                     return -EPIPE;
+                refill = (pcm->xrun_policy == PCM_XRUN_SILENCE);
                 continue;
             }
             return oops(pcm, errno, "cannot write stream data");
@@ -399,6 +721,7 @@ int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
 int pcm_read(struct pcm *pcm, void *data, unsigned int count)
 {
     struct snd_xferi x;
+    unsigned long skip;
 
     if (!(pcm->flags & PCM_IN))
         return -EINVAL;
@@ -408,6 +731,16 @@ int pcm_read(struct pcm *pcm, void *data, unsigned int count)
                         pcm_format_to_bits(pcm->config.format) / 8);
 
     for (;;) {
+        if (pcm->skip_frames) {
+            /* stand in for what wasn't captured during the xrun */
+            skip = (pcm->skip_frames < x.frames) ? pcm->skip_frames : x.frames;
+            memset(x.buf, 0, pcm_frames_to_bytes(pcm, skip));
+            x.buf = (char *)x.buf + pcm_frames_to_bytes(pcm, skip);
+            x.frames -= skip;
+            pcm->skip_frames -= skip;
+            if (!x.frames)
+                return 0;
+        }
         if (!pcm->running) {
             if (pcm_start(pcm) < 0) {
                 fprintf(stderr, "start error");
@@ -416,9 +749,12 @@ int pcm_read(struct pcm *pcm, void *data, unsigned int count)
         }
         if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_READI_FRAMES, &x)) {
             pcm->running = 0;
+            pcm->prepared = 0;
             if (errno == EPIPE) {
                     /* we failed to make our window -- try to restart */
-                pcm->underruns++;
+                pcm_xrun(pcm);
+                if (pcm->xrun_policy == PCM_XRUN_FAIL)
+                    return -EPIPE;
                 continue;
             }
             return oops(pcm, errno, "cannot read stream data");
@@ -448,6 +784,8 @@ int pcm_close(struct pcm *pcm)
     pcm->running = 0;
     pcm->buffer_size = 0;
     pcm->fd = -1;
+    free(pcm->xrun_log);
+    free(pcm->silence);
     free(pcm);
     return 0;
 }
@@ -540,7 +878,8 @@ struct pcm *pcm_open(unsigned int card, unsigned int device,
     memset(&sparams, 0, sizeof(sparams));
     sparams.tstamp_mode = SNDRV_PCM_TSTAMP_ENABLE;
     sparams.period_step = 1;
-    sparams.avail_min = 1;
+    pcm->config.avail_min = sparams.avail_min =
+        config->avail_min ? config->avail_min : 1;
 
     if (!config->start_threshold)
         pcm->config.start_threshold = sparams.start_threshold =
@@ -573,6 +912,15 @@ struct pcm *pcm_open(unsigned int card, unsigned int device,
         goto fail;
     }
 
+    if (flags & PCM_MONOTONIC) {
+        int arg = SNDRV_PCM_TSTAMP_TYPE_MONOTONIC;
+
+        if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_TTSTAMP, &arg)) {
+            oops(pcm, errno, "cannot set timestamp type");
+            goto fail;
+        }
+    }
+
     rc = pcm_hw_mmap_status(pcm);
     if (rc < 0) {
         oops(pcm, rc, "mmap status failed");
@@ -596,11 +944,46 @@ int pcm_is_ready(struct pcm *pcm)
     return pcm->fd >= 0;
 }
 
-int pcm_start(struct pcm *pcm)
+int pcm_get_file_descriptor(struct pcm *pcm)
 {
+    return pcm->fd;
+}
+
+int pcm_link(struct pcm *pcm1, struct pcm *pcm2)
+{
+    if (ioctl(pcm1->fd, SNDRV_PCM_IOCTL_LINK, pcm2->fd) < 0)
+        return oops(pcm1, errno, "cannot link channels");
+    return 0;
+}
+
+int pcm_unlink(struct pcm *pcm)
+{
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_UNLINK) < 0)
+        return oops(pcm, errno, "cannot unlink channel");
+    return 0;
+}
+
+int pcm_prepare(struct pcm *pcm)
+{
+    if (pcm->prepared)
+        return 0;
+
     if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_PREPARE) < 0)
         return oops(pcm, errno, "cannot prepare channel");
 
+    pcm->prepared = 1;
+    return 0;
+}
+
+int pcm_start(struct pcm *pcm)
+{
+    /* Don't prepare a stream that is already prepared: that would reset
+     * the application pointer and throw away frames that were queued with
+     * pcm_mmap_begin()/pcm_mmap_commit() before starting.
+     */
+    if (pcm_prepare(pcm))
+        return -1;
+
     if (pcm->flags & PCM_MMAP)
 	    pcm_sync_ptr(pcm, 0);
 
@@ -616,6 +999,7 @@ int pcm_stop(struct pcm *pcm)
     if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_DROP) < 0)
         return oops(pcm, errno, "cannot stop channel");
 
+    pcm->prepared = 0;
     pcm->running = 0;
     return 0;
 }
@@ -719,22 +1103,23 @@ int pcm_wait(struct pcm *pcm, int timeout)
     int err;
 
     pfd.fd = pcm->fd;
-    pfd.events = POLLOUT | POLLERR | POLLNVAL;
+    pfd.events = (pcm->flags & PCM_IN ? POLLIN : POLLOUT) | POLLERR | POLLNVAL;
 
     do {
         /* let's wait for avail or timeout */
+        pfd.revents = 0;
         err = poll(&pfd, 1, timeout);
-        if (err < 0)
+        if (err < 0) {
+            /* have we been interrupted ? */
+            if (errno == EINTR)
+                continue;
             return -errno;
+        }
 
         /* timeout ? */
         if (err == 0)
             return 0;
 
-        /* have we been interrupted ? */
-        if (errno == -EINTR)
-            continue;
-
         /* check for any errors */
         if (pfd.revents & (POLLERR | POLLNVAL)) {
             switch (pcm_state(pcm)) {
@@ -754,7 +1139,7 @@ int pcm_wait(struct pcm *pcm, int timeout)
     return 1;
 }
 
-int pcm_mmap_write(struct pcm *pcm, const void *buffer, unsigned int bytes)
+static int pcm_mmap_transfer(struct pcm *pcm, void *buffer, unsigned int bytes)
 {
     int err = 0, frames, avail;
     unsigned int offset = 0, count;
@@ -766,16 +1151,18 @@ int pcm_mmap_write(struct pcm *pcm, const void *buffer, unsigned int bytes)
 
     while (count > 0) {
 
-        /* get the available space for writing new frames */
+        /* get the available space for writing new frames, or the
+         * number of captured frames that are ready to be read */
         avail = pcm_avail_update(pcm);
         if (avail < 0) {
             fprintf(stderr, "cannot determine available mmap frames");
             return err;
         }
 
-        /* start the audio if we reach the threshold */
-	    if (!pcm->running &&
-            (pcm->buffer_size - avail) >= pcm->config.start_threshold) {
+        /* start playback once we reach the threshold, capture at once */
+        if (!pcm->running &&
+            ((pcm->flags & PCM_IN) ||
+             (pcm->buffer_size - avail) >= pcm->config.start_threshold)) {
             if (pcm_start(pcm) < 0) {
                fprintf(stderr, "start error: hw 0x%x app 0x%x avail 0x%x\n",
                     (unsigned int)pcm->mmap_status->hw_ptr,
@@ -783,9 +1170,11 @@ int pcm_mmap_write(struct pcm *pcm, const void *buffer, unsigned int bytes)
                     avail);
                 return -errno;
             }
+            continue;
         }
 
-        /* sleep until we have space to write new frames */
+        /* sleep until we have space to write new frames or new
+         * frames to read */
         if (pcm->running &&
             (unsigned int)avail < pcm->mmap_control->avail_min) {
             int time = -1;
@@ -796,7 +1185,10 @@ int pcm_mmap_write(struct pcm *pcm, const void *buffer, unsigned int bytes)
 
             err = pcm_wait(pcm, time);
             if (err < 0) {
+                if (err == -EPIPE)
+                    pcm_xrun(pcm);
                 pcm->running = 0;
+                pcm->prepared = 0;
                 fprintf(stderr, "wait error: hw 0x%x app 0x%x avail 0x%x\n",
                     (unsigned int)pcm->mmap_status->hw_ptr,
                     (unsigned int)pcm->mmap_control->appl_ptr,
@@ -814,10 +1206,11 @@ int pcm_mmap_write(struct pcm *pcm, const void *buffer, unsigned int bytes)
         if (!frames)
             break;
 
-        /* copy frames from buffer */
-        frames = pcm_mmap_write_areas(pcm, buffer, offset, frames);
+        /* copy frames from or to the buffer */
+        frames = pcm_mmap_transfer_areas(pcm, buffer, offset, frames);
         if (frames < 0) {
-            fprintf(stderr, "write error: hw 0x%x app 0x%x avail 0x%x\n",
+            fprintf(stderr, "%s error: hw 0x%x app 0x%x avail 0x%x\n",
+                    (pcm->flags & PCM_IN) ? "read" : "write",
                     (unsigned int)pcm->mmap_status->hw_ptr,
                     (unsigned int)pcm->mmap_control->appl_ptr,
                     avail);
@@ -830,3 +1223,19 @@ int pcm_mmap_write(struct pcm *pcm, const void *buffer, unsigned int bytes)
 
     return 0;
 }
+
+int pcm_mmap_write(struct pcm *pcm, const void *data, unsigned int count)
+{
+    if ((~pcm->flags) & PCM_MMAP || (pcm->flags & PCM_IN))
+        return -EINVAL;
+
+    return pcm_mmap_transfer(pcm, (void*)data, count);
+}
+
+int pcm_mmap_read(struct pcm *pcm, void *data, unsigned int count)
+{
+    if ((~pcm->flags) & (PCM_IN | PCM_MMAP))
+        return -EINVAL;
+
+    return pcm_mmap_transfer(pcm, data, count);
+}
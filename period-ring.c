@@ -0,0 +1,215 @@
+/*
+ * period-ring.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <semaphore.h>
+
+#include "period-ring.h"
+
+int period_ring_init(struct period_ring *ring, unsigned int periods,
+		     unsigned int period_bytes)
+{
+	long page_size = sysconf(_SC_PAGE_SIZE);
+	void *data;
+	int ret;
+
+	if (!periods || !period_bytes)
+		return EINVAL;
+
+	memset(ring, 0, sizeof(*ring));
+
+	ret = posix_memalign(&data, page_size, (size_t)periods * period_bytes);
+	if (ret)
+		return ret;
+
+	ring->lengths = calloc(periods, sizeof(unsigned int));
+	if (!ring->lengths) {
+		free(data);
+		return ENOMEM;
+	}
+
+	/* touch every page now, not on the audio thread */
+	memset(data, 0, (size_t)periods * period_bytes);
+
+	ring->data = data;
+	ring->periods = periods;
+	ring->period_bytes = period_bytes;
+	ring->low_water = periods;
+	sem_init(&ring->filled, 0, 0);
+	sem_init(&ring->emptied, 0, periods);
+
+	return 0;
+}
+
+void period_ring_deinit(struct period_ring *ring)
+{
+	sem_destroy(&ring->filled);
+	sem_destroy(&ring->emptied);
+	free(ring->lengths);
+	free(ring->data);
+	ring->data = NULL;
+	ring->lengths = NULL;
+}
+
+static int sem_wait_or_try(sem_t *sem, int block)
+{
+	int ret;
+
+	if (!block)
+		return sem_trywait(sem);
+
+	do {
+		ret = sem_wait(sem);
+	} while (ret && errno == EINTR);
+
+	return ret;
+}
+
+unsigned int period_ring_fill(struct period_ring *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)
+		- __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+void *period_ring_write_begin(struct period_ring *ring, int block)
+{
+	if (sem_wait_or_try(&ring->emptied, block)) {
+		ring->overflows++;
+		return NULL;
+	}
+
+	return ring->data + (size_t)(ring->head % ring->periods)
+		* ring->period_bytes;
+}
+
+void period_ring_write_commit(struct period_ring *ring, unsigned int bytes)
+{
+	unsigned int fill;
+
+	ring->lengths[ring->head % ring->periods] = bytes;
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+
+	fill = period_ring_fill(ring);
+	if (fill > ring->high_water)
+		ring->high_water = fill;
+
+	sem_post(&ring->filled);
+}
+
+void period_ring_write_eof(struct period_ring *ring)
+{
+	__atomic_store_n(&ring->eof, 1, __ATOMIC_RELEASE);
+	sem_post(&ring->filled);
+}
+
+void *period_ring_read_begin(struct period_ring *ring, unsigned int *bytes,
+			     int block)
+{
+	unsigned int fill, slot;
+	int streaming;
+
+	/* the ring is empty before the first fill and as it drains after
+	 * eof, neither of which says anything about keeping up */
+	streaming = ring->tail && !__atomic_load_n(&ring->eof, __ATOMIC_ACQUIRE);
+
+	fill = period_ring_fill(ring);
+	if (streaming && (fill < ring->low_water))
+		ring->low_water = fill;
+
+	if (sem_trywait(&ring->filled)) {
+		if (streaming)
+			ring->dry++;
+		if (sem_wait_or_try(&ring->filled, block))
+			return NULL;
+	}
+
+	if (ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+		/* woken up by write_eof(); keep the wake-up for the next call */
+		sem_post(&ring->filled);
+		return NULL;
+	}
+
+	slot = ring->tail % ring->periods;
+	*bytes = ring->lengths[slot];
+	return ring->data + (size_t)slot * ring->period_bytes;
+}
+
+void period_ring_read_commit(struct period_ring *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+	sem_post(&ring->emptied);
+}
+
+void *period_ring_read_begin_block(struct period_ring *ring, unsigned int max,
+				   unsigned int *periods, unsigned int *bytes,
+				   int block)
+{
+	unsigned int slot, n, head;
+	char *data;
+
+	data = period_ring_read_begin(ring, bytes, block);
+	if (!data)
+		return NULL;
+
+	slot = ring->tail % ring->periods;
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	/* Every slot between tail and head has been posted to 'filled', so
+	 * the trywait for it can't fail.  Short slots end the block.
+	 */
+	for (n = 1 ; (n < max) && (slot + n < ring->periods)
+		     && (ring->tail + n != head)
+		     && (ring->lengths[slot + n - 1] == ring->period_bytes) ; ++n) {
+		sem_trywait(&ring->filled);
+		*bytes += ring->lengths[slot + n];
+	}
+
+	*periods = n;
+	return data;
+}
+
+void period_ring_read_commit_block(struct period_ring *ring,
+				   unsigned int periods)
+{
+	unsigned int n;
+
+	__atomic_store_n(&ring->tail, ring->tail + periods, __ATOMIC_RELEASE);
+	for (n = 0 ; n < periods ; ++n)
+		sem_post(&ring->emptied);
+}
@@ -0,0 +1,109 @@
+/*
+ * period-ring.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_PERIOD_RING_H__
+#define __AUDIO_TOOL_PERIOD_RING_H__
+
+#include <semaphore.h>
+
+/* Single-producer/single-consumer ring of audio periods
+ *
+ * The slot indices are only ever advanced by one side each, so the
+ * data path is lock-free.  The semaphores are only used to put a side
+ * to sleep when there is nothing for it to do; a non-blocking caller
+ * never sleeps.
+ *
+ * All slots are period_bytes long and live in one page-aligned
+ * allocation, so consecutive slots are contiguous in memory.
+ */
+struct period_ring {
+	char *data;
+	unsigned int *lengths;
+	unsigned int periods;
+	unsigned int period_bytes;
+
+	unsigned int head;	/* slots produced, written by producer only */
+	unsigned int tail;	/* slots consumed, written by consumer only */
+	int eof;
+
+	sem_t filled;
+	sem_t emptied;
+
+	/* Statistics */
+	unsigned int high_water;	/* max fill seen by the producer */
+	unsigned int low_water;		/* min fill seen by the consumer, while
+					   streaming */
+	unsigned int dry;		/* times the consumer found it empty */
+	unsigned int overflows;		/* times the producer found it full */
+};
+
+/* Returns 0 on success, errno on failure */
+int period_ring_init(struct period_ring *ring, unsigned int periods,
+		     unsigned int period_bytes);
+void period_ring_deinit(struct period_ring *ring);
+
+/* Producer side.  write_begin() returns a free slot, or NULL (counted as
+ * an overflow) if the ring is full and block is zero.  write_commit() publishes the slot with the
+ * number of valid bytes in it.  write_eof() tells the consumer that no
+ * more slots will follow.
+ */
+void *period_ring_write_begin(struct period_ring *ring, int block);
+void period_ring_write_commit(struct period_ring *ring, unsigned int bytes);
+void period_ring_write_eof(struct period_ring *ring);
+
+/* Consumer side.  read_begin() returns the oldest filled slot and its
+ * length, or NULL once the producer signaled the end of the stream (or if
+ * the ring is empty and block is zero).  read_commit() releases the slot.
+ */
+void *period_ring_read_begin(struct period_ring *ring, unsigned int *bytes,
+			     int block);
+void period_ring_read_commit(struct period_ring *ring);
+
+/* Like read_begin()/read_commit(), but also claims the full slots that
+ * directly follow the first one in memory (at most max slots in total),
+ * so that they can be handled as one large contiguous block.  *periods is
+ * set to the number of slots claimed and *bytes to their total length.
+ */
+void *period_ring_read_begin_block(struct period_ring *ring, unsigned int max,
+				   unsigned int *periods, unsigned int *bytes,
+				   int block);
+void period_ring_read_commit_block(struct period_ring *ring,
+				   unsigned int periods);
+
+/* Number of filled slots */
+unsigned int period_ring_fill(struct period_ring *ring);
+
+#endif /* __AUDIO_TOOL_PERIOD_RING_H__ */
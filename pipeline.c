@@ -0,0 +1,230 @@
+/*
+ * pipeline.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+
+/* Frames per pass through the float stage */
+#define BLOCK_FRAMES 256
+
+int pipeline_init(struct pipeline *p, const struct pipeline_params *params)
+{
+	unsigned int in_ch = params->in_channels, out_ch = params->out_channels;
+	int ret;
+
+	memset(p, 0, sizeof(*p));
+	p->in_channels = in_ch;
+	p->out_channels = out_ch;
+	p->in_frame_bytes = in_ch * sample_format_bytes(params->in_format);
+	p->out_frame_bytes = out_ch * sample_format_bytes(params->out_format);
+
+	format_convert_init(&p->convert, params->in_format, params->out_format,
+			    params->dither);
+
+	ret = channel_map_init(&p->map, in_ch, params->in_mask, out_ch,
+			       params->out_mask);
+	if (ret)
+		return ret;
+
+	p->remap = !channel_map_is_identity(&p->map);
+	p->resample = (params->in_rate != params->out_rate);
+	p->use_float = p->resample || (p->remap && !p->map.is_select);
+
+	if (p->remap) {
+		/* holds a block of input as float, or of selected channels
+		 * as raw samples, which may be more channels than came in */
+		unsigned int ch = (in_ch > out_ch) ? in_ch : out_ch;
+		unsigned int bytes = sample_format_bytes(params->in_format);
+
+		if (bytes < sizeof(float))
+			bytes = sizeof(float);
+		p->map_buf = malloc(BLOCK_FRAMES * ch * bytes);
+		if (!p->map_buf) {
+			ret = ENOMEM;
+			goto fail;
+		}
+	}
+
+	if (!p->use_float)
+		return 0;
+
+	if (p->resample) {
+		ret = resampler_init(&p->resampler, out_ch, params->in_rate,
+				     params->out_rate, params->quality);
+		if (ret) {
+			p->resample = 0;
+			goto fail;
+		}
+	}
+
+	p->in_buf = malloc(2 * BLOCK_FRAMES * out_ch * sizeof(float));
+	if (!p->in_buf) {
+		ret = ENOMEM;
+		goto fail;
+	}
+	p->out_buf = p->in_buf + BLOCK_FRAMES * out_ch;
+
+	format_convert_init(&p->convert_in, params->in_format,
+			    SAMPLE_FORMAT_FLOAT_LE, 0);
+	format_convert_init(&p->convert_out, SAMPLE_FORMAT_FLOAT_LE,
+			    params->out_format, params->dither);
+	return 0;
+
+fail:
+	pipeline_deinit(p);
+	return ret;
+}
+
+void pipeline_deinit(struct pipeline *p)
+{
+	if (p->resample)
+		resampler_deinit(&p->resampler);
+	channel_map_deinit(&p->map);
+	free(p->map_buf);
+	free(p->in_buf);
+	p->map_buf = NULL;
+	p->in_buf = NULL;
+	p->resample = 0;
+}
+
+/* Formats (and picks channels) without going through float */
+static void pipeline_direct(struct pipeline *p, const char *s, char *d,
+			    unsigned int frames)
+{
+	unsigned int sample_bytes = p->in_frame_bytes / p->in_channels;
+	unsigned int n;
+
+	if (!p->remap) {
+		format_convert(&p->convert, d, s, frames * p->in_channels);
+		return;
+	}
+
+	while (frames) {
+		n = (frames < BLOCK_FRAMES) ? frames : BLOCK_FRAMES;
+		channel_map_select(&p->map, p->map_buf, s, n, sample_bytes);
+		format_convert(&p->convert, d, p->map_buf, n * p->out_channels);
+		s += n * p->in_frame_bytes;
+		d += n * p->out_frame_bytes;
+		frames -= n;
+	}
+}
+
+/* Converts the next block of input to float and maps its channels */
+static void pipeline_load(struct pipeline *p, const char *s, unsigned int n)
+{
+	if (p->remap) {
+		format_convert(&p->convert_in, p->map_buf, s, n * p->in_channels);
+		channel_map_mix(&p->map, p->in_buf, p->map_buf, n);
+	} else {
+		format_convert(&p->convert_in, p->in_buf, s, n * p->in_channels);
+	}
+
+	p->in_pos = 0;
+	p->in_len = n;
+}
+
+void pipeline_process(struct pipeline *p, const void *src,
+		      unsigned int *in_frames, void *dst,
+		      unsigned int *out_frames)
+{
+	unsigned int channels = p->out_channels;
+	unsigned int in_left = *in_frames, out_left = *out_frames;
+	const char *s = src;
+	char *d = dst;
+	unsigned int n, used, got;
+
+	if (!p->use_float) {
+		n = (in_left < out_left) ? in_left : out_left;
+		pipeline_direct(p, src, dst, n);
+		*in_frames = *out_frames = n;
+		return;
+	}
+
+	while (out_left) {
+		if ((p->in_pos == p->in_len) && in_left) {
+			n = (in_left < BLOCK_FRAMES) ? in_left : BLOCK_FRAMES;
+			pipeline_load(p, s, n);
+			s += n * p->in_frame_bytes;
+			in_left -= n;
+		} else if ((p->in_pos == p->in_len) && p->drain) {
+			n = (p->drain < BLOCK_FRAMES) ? p->drain : BLOCK_FRAMES;
+			memset(p->in_buf, 0, n * channels * sizeof(float));
+			p->in_pos = 0;
+			p->in_len = n;
+			p->drain -= n;
+		}
+
+		used = p->in_len - p->in_pos;
+		n = (out_left < BLOCK_FRAMES) ? out_left : BLOCK_FRAMES;
+		if (p->resample) {
+			got = resampler_process(&p->resampler,
+						p->in_buf + p->in_pos * channels,
+						&used, p->out_buf, n);
+			format_convert(&p->convert_out, d, p->out_buf,
+				       got * channels);
+		} else {
+			got = used = (used < n) ? used : n;
+			format_convert(&p->convert_out, d,
+				       p->in_buf + p->in_pos * channels,
+				       got * channels);
+		}
+		p->in_pos += used;
+		d += got * p->out_frame_bytes;
+		out_left -= got;
+
+		/* out of input, with nothing more to give */
+		if (!got && !pipeline_pending(p) && !in_left)
+			break;
+	}
+
+	*in_frames -= in_left;
+	*out_frames -= out_left;
+}
+
+void pipeline_drain(struct pipeline *p)
+{
+	if (p->resample)
+		p->drain = resampler_delay(&p->resampler);
+}
+
+void pipeline_report(const struct pipeline *p)
+{
+	if (p->resample)
+		resampler_report(&p->resampler);
+}
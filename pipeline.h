@@ -0,0 +1,128 @@
+/*
+ * pipeline.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_PIPELINE_H__
+#define __AUDIO_TOOL_PIPELINE_H__
+
+#include <stdint.h>
+
+#include "channel-map.h"
+#include "format-convert.h"
+#include "resampler.h"
+
+/* The processing between a file and a PCM: channel routing, sample
+ * format conversion and, if the rates differ, resampling.
+ *
+ * When only formats change, or channels are just picked and reordered,
+ * samples are converted straight from one format to the other.  A
+ * downmix or a rate change goes through float: a block at a time is
+ * converted in, mixed, resampled and converted out.
+ */
+struct pipeline {
+	unsigned int in_channels;
+	unsigned int out_channels;
+	unsigned int in_frame_bytes;
+	unsigned int out_frame_bytes;
+
+	struct format_convert convert;		/* in to out, direct path */
+
+	int remap;
+	struct channel_map map;
+	void *map_buf;		/* input frames before the channel map */
+
+	int use_float;
+	int resample;
+	struct resampler resampler;
+	struct format_convert convert_in;	/* in to float */
+	struct format_convert convert_out;	/* float to out */
+	float *in_buf;		/* mapped input not yet resampled */
+	unsigned int in_pos;
+	unsigned int in_len;
+	unsigned int drain;	/* frames of silence still to feed in */
+	float *out_buf;
+};
+
+struct pipeline_params {
+	unsigned int in_channels;
+	uint32_t in_mask;	/* input channels to use */
+	enum sample_format in_format;
+	unsigned int in_rate;
+	unsigned int out_channels;
+	uint32_t out_mask;	/* output channels to fill */
+	enum sample_format out_format;
+	unsigned int out_rate;
+	enum resampler_quality quality;
+	int dither;
+};
+
+/* Returns 0 on success, errno on failure */
+int pipeline_init(struct pipeline *p, const struct pipeline_params *params);
+void pipeline_deinit(struct pipeline *p);
+
+/* True if frames pass through unchanged */
+static inline int pipeline_is_copy(const struct pipeline *p)
+{
+	return !p->use_float && !p->remap && format_convert_is_copy(&p->convert);
+}
+
+/* True if the output is narrowed with dither */
+static inline int pipeline_dithers(const struct pipeline *p)
+{
+	return p->use_float ? p->convert_out.dither : p->convert.dither;
+}
+
+/* Moves frames from src (*in_frames available) to dst (room for
+ * *out_frames).  On return, *in_frames holds the frames consumed and
+ * *out_frames the frames produced.
+ */
+void pipeline_process(struct pipeline *p, const void *src,
+		      unsigned int *in_frames, void *dst,
+		      unsigned int *out_frames);
+
+/* Called at the end of the input: queues enough silence to push the
+ * last frames through the resampler's filter.
+ */
+void pipeline_drain(struct pipeline *p);
+
+/* True if frames are still held inside the pipeline */
+static inline int pipeline_pending(const struct pipeline *p)
+{
+	return (p->in_pos < p->in_len) || p->drain;
+}
+
+void pipeline_report(const struct pipeline *p);
+
+#endif /* __AUDIO_TOOL_PIPELINE_H__ */
@@ -37,6 +37,11 @@
 
 #include "config.h"
 #include "pulse-generator.h"
+#include "noirq-scheduler.h"
+#include "rt-profile.h"
+#include "histogram.h"
+#include "xrun.h"
+#include "caps.h"
 
 static volatile int running = 1;
 
@@ -45,57 +50,37 @@ static void sigint_handler(int sig)
     running = 0;
 }
 
-struct interval_tracker {
-    struct timespec last;
-    struct timespec now;
-    size_t count;
-    double sum_ms;
-    double sum2_ms;
-    double max_ms;
-    double min_ms;
-    int initd;
-};
+#define NSEC_PER_SEC 1000000000LL
 
-static void ivt_init(struct interval_tracker *it)
+static int64_t now_ns(void)
 {
-    memset(it, 0, sizeof(struct interval_tracker));
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
 }
 
-static void ivt_lap(struct interval_tracker *it)
+/* Writes both histograms to path, for comparing runs */
+static void dump_histograms(const char *path, const struct histogram *intervals,
+                            const struct histogram *waits)
 {
-    double elapsed;
-    clock_gettime(CLOCK_MONOTONIC, &it->now);
-    if (it->initd) {
-        it->count++;
-        elapsed = (it->now.tv_sec - it->last.tv_sec) * 1000000.0
-            + (it->now.tv_nsec - it->last.tv_nsec) / 1000.0;
-        it->sum_ms += elapsed;
-        it->sum2_ms += elapsed*elapsed;
-        if (it->count == 1) {
-            it->max_ms = it->min_ms = elapsed;
-        } else {
-            if (elapsed > it->max_ms)
-                it->max_ms = elapsed;
-            if (elapsed < it->min_ms)
-                it->min_ms = elapsed;
-        }
-#if 0
-        printf("now=%ld dt=%08u max=%08u min=%08u\n",
-               1000000 * (it->now.tv_sec % 100) + it->now.tv_nsec / 1000,
-               (unsigned)(elapsed+.5), (unsigned)(it->max_ms+.5), (unsigned)(it->min_ms+.5));
-#endif
+    FILE *file = fopen(path, "w");
+    int ret;
+
+    if (!file) {
+        fprintf(stderr, "Unable to open '%s' (%s)\n", path, strerror(errno));
+        return;
     }
-    it->last = it->now;
-    it->initd = 1;
-}
 
-static double ivt_average(struct interval_tracker *it)
-{
-    if (it->count <= 0)
-        return 0.0;
-    return it->sum_ms / (double)(it->count);
+    ret = histogram_dump(intervals, file, "wakeup interval ns");
+    if (!ret)
+        ret = histogram_dump(waits, file, "wait duration ns");
+    if (fclose(file) && !ret)
+        ret = errno;
+    if (ret)
+        fprintf(stderr, "Unable to write '%s' (%s)\n", path, strerror(ret));
 }
-               
+
 #define PULSE_AT_FRONT  (1<<0)
 #define PULSE_AT_END    (1<<1)
 #define PULSE_AT_MIDDLE (1<<2)
@@ -109,6 +94,12 @@ struct play_pulses_params {
     unsigned int period_size;
     unsigned int period_count;
     unsigned int pulse_position;
+    int noirq;
+    const char *histogram_file;
+    int xrun_policy;
+    unsigned int xrun_log;
+    int low_latency;
+    struct rt_profile rt;
 };
 
 static void play_pulses(struct play_pulses_params *params);
@@ -153,6 +144,13 @@ int pulse_generator_main(const struct audio_tool_config *config, int argc, char
     params.channels = config->channels;
     params.rate = config->rate;
     params.bits = config->bits;
+    params.noirq = config->noirq;
+    params.histogram_file = config->histogram_file;
+    params.xrun_policy = config->xrun_policy;
+    params.xrun_log = config->xrun_log;
+    params.low_latency = config->low_latency;
+    rt_profile_init(&params.rt, config->rt_priority, config->cpu,
+                    config->mlock);
 
     signal(SIGINT, sigint_handler);
     play_pulses(&params);
@@ -164,13 +162,18 @@ static void play_pulses(struct play_pulses_params *params)
 {
     struct pcm_config config;
     struct pcm *pcm;
-    struct interval_tracker it;
+    static struct histogram intervals, waits;
+    int64_t wait_start, last_wakeup = 0, now;
+    struct noirq_scheduler sched;
+    unsigned int flags = PCM_OUT;
     char *buffer;
     int size;
     int num_read;
 
-    ivt_init(&it);
+    histogram_init(&intervals);
+    histogram_init(&waits);
 
+    memset(&config, 0, sizeof(config));
     config.channels = params->channels;
     config.rate = params->rate;
     config.period_size = params->period_size;
@@ -179,16 +182,28 @@ static void play_pulses(struct play_pulses_params *params)
         config.format = PCM_FORMAT_S32_LE;
     else if (params->bits == 16)
         config.format = PCM_FORMAT_S16_LE;
+    if (params->noirq)
+        flags |= PCM_MMAP | PCM_NOIRQ | PCM_MONOTONIC;
+    if (params->low_latency) {
+        if (caps_fit(params->card, params->device, flags, &config))
+            return;
+        params->period_size = config.period_size;
+        params->period_count = config.period_count;
+    }
     config.start_threshold = params->period_size;
     config.stop_threshold = params->period_size * params->period_count;
     config.silence_threshold = 0;
 
-    pcm = pcm_open(params->card, params->device, PCM_OUT, &config);
+    pcm = pcm_open(params->card, params->device, flags, &config);
     if (!pcm || !pcm_is_ready(pcm)) {
         fprintf(stderr, "Unable to open PCM device %u (%s)\n",
                 params->device, pcm_get_error(pcm));
         return;
     }
+    if (xrun_setup(pcm, params->xrun_policy, params->xrun_log)) {
+        pcm_close(pcm);
+        return;
+    }
 
     size = pcm_frames_to_bytes(pcm, pcm_get_buffer_size(pcm));
     printf("size = %d\n", size);
@@ -200,15 +215,29 @@ static void play_pulses(struct play_pulses_params *params)
         return;
     }
 
+    if (rt_profile_enter(&params->rt)) {
+        free(buffer);
+        pcm_close(pcm);
+        return;
+    }
+    rt_profile_prefault(&params->rt, buffer, size);
+
     printf("Playing sample: %u ch, %u hz, %u bit\n",
            params->channels, params->rate, params->bits);
 
     int k, stat;
-    int interrupt_tol = 20 + 1000000 * params->period_size / params->rate;
+    int interrupt_tol = 20 + 1000 * params->period_size / params->rate;
     int pulse_position = params->pulse_position;
     int period_bytes = pcm_frames_to_bytes(pcm, params->period_size);
     char pulse_byte = 0x1f;
-    pcm_start(pcm);
+    if (params->noirq) {
+        /* started by the first writes, once there is something to play */
+        noirq_scheduler_init(&sched, pcm, params->rate);
+        pcm_prepare(pcm);
+    } else {
+        pcm_start(pcm);
+    }
+    rt_profile_start(&params->rt);
     do {
         memset(buffer, 0, size);
         num_read = period_bytes;
@@ -228,14 +257,29 @@ static void play_pulses(struct play_pulses_params *params)
             }
         }
 
-	stat = pcm_wait(pcm, interrupt_tol /* ms timeout */);
+	wait_start = now_ns();
+	if (params->noirq)
+            stat = noirq_scheduler_wait(&sched, params->period_size,
+                                        interrupt_tol /* ms timeout */);
+	else
+            stat = pcm_wait(pcm, interrupt_tol /* ms timeout */);
+	now = now_ns();
+	histogram_record(&waits, now - wait_start);
 	switch (stat) {
 	case 0: /* timeout */
             printf("timeout");
             break;
 	case 1:
-            ivt_lap(&it);
-            if (pcm_write(pcm, buffer, num_read)) {
+            if (last_wakeup)
+                histogram_record(&intervals, now - last_wakeup);
+            last_wakeup = now;
+            if (params->noirq)
+                stat = pcm_mmap_write(pcm, buffer, num_read);
+            else
+                stat = pcm_write(pcm, buffer, num_read);
+            if (!stat && params->noirq)
+                noirq_scheduler_commit(&sched, params->period_size);
+            if (stat) {
                 fprintf(stderr, "Error playing sample\n");
                 num_read = 0;
             }
@@ -245,6 +289,8 @@ static void play_pulses(struct play_pulses_params *params)
             break;
 	case -EPIPE:
             printf("xrun\n");
+            if (params->noirq && noirq_scheduler_recover(&sched))
+                num_read = 0;
             break;
 	case -ESTRPIPE:
             printf("state suspended\n");
@@ -265,8 +311,14 @@ static void play_pulses(struct play_pulses_params *params)
 
     pcm_stop(pcm);
 
-    printf("avg=%g max=%g min=%g\n",
-           ivt_average(&it), it.max_ms, it.min_ms);
+    histogram_print(&intervals, "wakeup interval", 1000.0, "us");
+    histogram_print(&waits, "wait duration", 1000.0, "us");
+    if (params->histogram_file)
+        dump_histograms(params->histogram_file, &intervals, &waits);
+    rt_profile_report(&params->rt, "audio thread");
+    if (params->noirq)
+        noirq_scheduler_report(&sched);
+    xrun_report(pcm, "playback");
 
     free(buffer);
     pcm_close(pcm);
@@ -0,0 +1,239 @@
+/*
+ * reactor.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "reactor.h"
+
+/* Events taken from the kernel per epoll_wait() */
+#define REACTOR_MAX_EVENTS 16
+
+int reactor_init(struct reactor *r)
+{
+	memset(r, 0, sizeof(*r));
+	sigemptyset(&r->blocked);
+	r->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (r->epfd < 0)
+		return errno;
+	return 0;
+}
+
+void reactor_deinit(struct reactor *r)
+{
+	if (r->epfd >= 0)
+		close(r->epfd);
+	r->epfd = -1;
+
+	if (!sigisemptyset(&r->blocked)) {
+		pthread_sigmask(SIG_SETMASK, &r->old_mask, NULL);
+		sigemptyset(&r->blocked);
+	}
+}
+
+static int reactor_add(struct reactor *r, struct reactor_source *src,
+		       enum reactor_source_type type, int fd, uint32_t events,
+		       reactor_func func, void *data)
+{
+	struct epoll_event ev;
+
+	memset(src, 0, sizeof(*src));
+	src->reactor = r;
+	src->type = type;
+	src->fd = fd;
+	src->events = events;
+	src->func = func;
+	src->data = data;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = src;
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		src->fd = -1;
+		return errno;
+	}
+	return 0;
+}
+
+int reactor_add_fd(struct reactor *r, struct reactor_source *src, int fd,
+		   uint32_t events, reactor_func func, void *data)
+{
+	return reactor_add(r, src, REACTOR_FD, fd, events, func, data);
+}
+
+int reactor_set_events(struct reactor_source *src, uint32_t events)
+{
+	struct epoll_event ev;
+
+	if (src->events == events)
+		return 0;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = src;
+	if (epoll_ctl(src->reactor->epfd, EPOLL_CTL_MOD, src->fd, &ev))
+		return errno;
+	src->events = events;
+	return 0;
+}
+
+int reactor_add_timer(struct reactor *r, struct reactor_source *src,
+		      unsigned int interval_ms, reactor_func func, void *data)
+{
+	struct itimerspec its;
+	int fd, ret;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return errno;
+
+	its.it_interval.tv_sec = interval_ms / 1000;
+	its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(fd, 0, &its, NULL)) {
+		ret = errno;
+		close(fd);
+		return ret;
+	}
+
+	ret = reactor_add(r, src, REACTOR_TIMER, fd, EPOLLIN, func, data);
+	if (ret)
+		close(fd);
+	return ret;
+}
+
+int reactor_add_signals(struct reactor *r, struct reactor_source *src,
+			const sigset_t *mask, reactor_func func, void *data)
+{
+	sigset_t old_mask;
+	int fd, ret;
+
+	ret = pthread_sigmask(SIG_BLOCK, mask, &old_mask);
+	if (ret)
+		return ret;
+	/* only the first call saves the mask to go back to */
+	if (sigisemptyset(&r->blocked))
+		r->old_mask = old_mask;
+	sigorset(&r->blocked, &r->blocked, mask);
+
+	fd = signalfd(-1, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0)
+		return errno;
+
+	ret = reactor_add(r, src, REACTOR_SIGNAL, fd, EPOLLIN, func, data);
+	if (ret)
+		close(fd);
+	return ret;
+}
+
+void reactor_remove(struct reactor_source *src)
+{
+	if (src->fd < 0)
+		return;
+
+	epoll_ctl(src->reactor->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+	if (src->type != REACTOR_FD)
+		close(src->fd);
+	src->fd = -1;
+}
+
+/* Reads what a timer or signal descriptor has to say.  Returns 1 if
+ * there is something to report, 0 if the event was spurious.
+ */
+static int reactor_read(struct reactor_source *src)
+{
+	struct signalfd_siginfo info;
+	uint64_t expirations;
+
+	if (src->type == REACTOR_TIMER) {
+		if (read(src->fd, &expirations, sizeof(expirations)) !=
+		    sizeof(expirations))
+			return 0;
+		src->value = expirations;
+	} else {
+		if (read(src->fd, &info, sizeof(info)) != sizeof(info))
+			return 0;
+		src->value = info.ssi_signo;
+	}
+	return 1;
+}
+
+int reactor_run(struct reactor *r)
+{
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	struct reactor_source *src;
+	int i, n, ret;
+
+	r->running = 1;
+	r->error = 0;
+
+	while (r->running) {
+		n = epoll_wait(r->epfd, events, REACTOR_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			r->error = errno;
+			break;
+		}
+
+		for (i = 0; (i < n) && r->running; i++) {
+			src = events[i].data.ptr;
+			/* removed by an earlier callback of this batch */
+			if (src->fd < 0)
+				continue;
+			if ((src->type != REACTOR_FD) && !reactor_read(src))
+				continue;
+
+			ret = src->func(src, events[i].events);
+			if (ret) {
+				r->error = ret;
+				r->running = 0;
+			}
+		}
+	}
+
+	return r->error;
+}
+
+void reactor_stop(struct reactor *r)
+{
+	r->running = 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * reactor.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_REACTOR_H__
+#define __AUDIO_TOOL_REACTOR_H__
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/* Single-threaded event loop on epoll
+ *
+ * Anything with a file descriptor can be a source: PCMs (from
+ * pcm_get_file_descriptor()), timers and signals, which are turned into
+ * descriptors with timerfd and signalfd.  Every source has a callback
+ * that is run on the reactor's thread when the source is ready, so one
+ * thread can serve several streams and timers, and a signal is just
+ * another event rather than an interrupted system call.
+ *
+ * Sources are owned by the caller and must stay valid until they are
+ * removed or the reactor is deinitialized.  The reactor never
+ * allocates after reactor_init().
+ */
+struct reactor_source;
+
+/* Called with the epoll events of a ready source.  Returns 0 to go on,
+ * or errno to stop the reactor with that error.
+ */
+typedef int (*reactor_func)(struct reactor_source *src, uint32_t events);
+
+enum reactor_source_type {
+	REACTOR_FD,
+	REACTOR_TIMER,
+	REACTOR_SIGNAL,
+};
+
+struct reactor_source {
+	struct reactor *reactor;
+	enum reactor_source_type type;
+	int fd;			/* -1 once removed */
+	uint32_t events;
+	reactor_func func;
+	void *data;
+
+	/* for timers, expirations since the last callback; for signals,
+	 * the signal received
+	 */
+	uint64_t value;
+};
+
+struct reactor {
+	int epfd;
+	int running;
+	int error;
+	sigset_t blocked;	/* signals blocked for signal sources */
+	sigset_t old_mask;
+};
+
+/* Returns 0 on success, errno on failure */
+int reactor_init(struct reactor *r);
+
+/* Closes the reactor and restores the signal mask changed by
+ * reactor_add_signals().  Remove timer and signal sources first, to
+ * close their descriptors.
+ */
+void reactor_deinit(struct reactor *r);
+
+/* Watches fd for events (EPOLLIN, EPOLLOUT, ...; errors are always
+ * reported).  Returns 0 on success, errno on failure.
+ */
+int reactor_add_fd(struct reactor *r, struct reactor_source *src, int fd,
+		   uint32_t events, reactor_func func, void *data);
+
+/* Changes the events a source is watched for */
+int reactor_set_events(struct reactor_source *src, uint32_t events);
+
+/* Calls func every interval_ms, starting interval_ms from now.
+ * Expirations missed while the loop was busy are counted in src->value
+ * rather than lost.  Returns 0 on success, errno on failure.
+ */
+int reactor_add_timer(struct reactor *r, struct reactor_source *src,
+		      unsigned int interval_ms, reactor_func func, void *data);
+
+/* Blocks the signals in mask for the calling thread and delivers them
+ * to func instead, with the signal number in src->value.  Call it
+ * before starting other threads, so that they inherit the mask.
+ * Returns 0 on success, errno on failure.
+ */
+int reactor_add_signals(struct reactor *r, struct reactor_source *src,
+			const sigset_t *mask, reactor_func func, void *data);
+
+/* Stops watching a source.  Safe to call from any callback, including
+ * the source's own.
+ */
+void reactor_remove(struct reactor_source *src);
+
+/* Dispatches events until reactor_stop() is called or a callback fails.
+ * Returns 0, or the errno of the failure.
+ */
+int reactor_run(struct reactor *r);
+
+void reactor_stop(struct reactor *r);
+
+#endif /* __AUDIO_TOOL_REACTOR_H__ */
@@ -0,0 +1,263 @@
+/*
+ * resampler.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "resampler.h"
+#include "simd.h"
+
+/* Input frames buffered per channel beyond the filter history */
+#define BLOCK_FRAMES 1024
+
+/* Largest filter bank we build (e.g. 44.1 to 48 kHz needs 160 phases) */
+#define MAX_PHASES 1024
+
+static const struct {
+	const char *name;
+	unsigned int taps;	/* multiple of 4 */
+	double beta;		/* Kaiser window shape */
+	double rolloff;		/* pass band, as a fraction of Nyquist */
+} presets[RESAMPLER_QUALITY_MAX] = {
+	[RESAMPLER_QUALITY_LOW] = { "low", 16, 5.0, 0.80 },
+	[RESAMPLER_QUALITY_MEDIUM] = { "medium", 32, 8.0, 0.88 },
+	[RESAMPLER_QUALITY_HIGH] = { "high", 64, 10.0, 0.92 },
+};
+
+int resampler_quality_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < RESAMPLER_QUALITY_MAX; i++)
+		if (!strcmp(name, presets[i].name))
+			return i;
+
+	return -1;
+}
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	unsigned int t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	int k;
+
+	for (k = 1; k < 50; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+/* Builds the prototype low-pass filter for the up-sampled rate and
+ * splits it into phases.
+ */
+static void resampler_design(struct resampler *r, double beta, double rolloff)
+{
+	unsigned int n, len = r->taps * r->up;
+	unsigned int max = (r->up > r->down) ? r->up : r->down;
+	double cutoff = rolloff * 0.5 / max;
+	double t, w, h;
+
+	for (n = 0; n < len; n++) {
+		t = n - (len - 1) / 2.0;
+		w = 2.0 * n / (len - 1) - 1.0;
+		w = bessel_i0(beta * sqrt(1.0 - w * w)) / bessel_i0(beta);
+		h = 2.0 * cutoff;
+		if (t != 0.0)
+			h = sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+
+		/* phase n % up, tap n / up, reversed for the dot product;
+		 * the gain makes up for the zeros stuffed in by up-sampling
+		 */
+		r->coefs[(n % r->up) * r->taps + (r->taps - 1 - n / r->up)] =
+			h * w * r->up;
+	}
+}
+
+int resampler_init(struct resampler *r, unsigned int channels,
+		   unsigned int in_rate, unsigned int out_rate,
+		   enum resampler_quality quality)
+{
+	unsigned int g = gcd(in_rate, out_rate);
+	void *mem;
+
+	memset(r, 0, sizeof(*r));
+
+	if (!channels || !g || (quality >= RESAMPLER_QUALITY_MAX))
+		return EINVAL;
+
+	r->channels = channels;
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+	r->up = out_rate / g;
+	r->down = in_rate / g;
+	r->taps = presets[quality].taps;
+
+	if (r->up > MAX_PHASES)
+		return EINVAL;
+
+	if (posix_memalign(&mem, 16, r->up * r->taps * sizeof(float)))
+		return ENOMEM;
+	r->coefs = mem;
+
+	r->buf_size = r->taps - 1 + BLOCK_FRAMES;
+	r->buf = calloc(channels * r->buf_size, sizeof(float));
+	if (!r->buf) {
+		free(r->coefs);
+		r->coefs = NULL;
+		return ENOMEM;
+	}
+
+	resampler_design(r, presets[quality].beta, presets[quality].rolloff);
+
+	/* start with a history of silence */
+	r->fill = r->taps - 1;
+	r->pos = r->taps - 1;
+	return 0;
+}
+
+void resampler_deinit(struct resampler *r)
+{
+	free(r->coefs);
+	free(r->buf);
+	r->coefs = NULL;
+	r->buf = NULL;
+}
+
+/* Drops input that no future output needs */
+static void resampler_compact(struct resampler *r)
+{
+	unsigned int shift = r->pos - (r->taps - 1);
+	unsigned int c;
+
+	if (shift > r->fill)
+		shift = r->fill;
+	if (!shift)
+		return;
+
+	for (c = 0; c < r->channels; c++) {
+		float *b = r->buf + c * r->buf_size;
+		memmove(b, b + shift, (r->fill - shift) * sizeof(float));
+	}
+	r->fill -= shift;
+	r->pos -= shift;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned int resampler_process(struct resampler *r, const float *in,
+			       unsigned int *in_frames, float *out,
+			       unsigned int out_frames)
+{
+	unsigned int channels = r->channels;
+	unsigned int used = 0, produced = 0;
+	unsigned int n, i, c;
+	uint64_t start = thread_cpu_ns();
+	const float *coef;
+
+	while (produced < out_frames) {
+		if (r->pos >= r->fill) {
+			/* the next output needs more input */
+			if (used == *in_frames)
+				break;
+			if (r->fill == r->buf_size)
+				resampler_compact(r);
+
+			n = *in_frames - used;
+			if (n > r->buf_size - r->fill)
+				n = r->buf_size - r->fill;
+			for (c = 0; c < channels; c++) {
+				float *b = r->buf + c * r->buf_size + r->fill;
+				const float *s = in + used * channels + c;
+				for (i = 0; i < n; i++)
+					b[i] = s[i * channels];
+			}
+			r->fill += n;
+			used += n;
+			continue;
+		}
+
+		coef = r->coefs + r->phase * r->taps;
+		for (c = 0; c < channels; c++)
+			out[produced * channels + c] =
+				simd_dot(coef, r->buf + c * r->buf_size +
+					 r->pos - (r->taps - 1), r->taps);
+		produced++;
+
+		r->phase += r->down;
+		r->pos += r->phase / r->up;
+		r->phase %= r->up;
+	}
+
+	*in_frames = used;
+	r->out_frames += produced;
+	r->cpu_ns += thread_cpu_ns() - start;
+	return produced;
+}
+
+void resampler_report(const struct resampler *r)
+{
+	double seconds = (double)r->out_frames / r->out_rate;
+
+	printf("resampler: %u -> %u Hz (%u/%u), %u taps, %.3f ms CPU per second "
+	       "of audio\n", r->in_rate, r->out_rate, r->up, r->down, r->taps,
+	       seconds > 0 ? r->cpu_ns / 1e6 / seconds : 0.0);
+}
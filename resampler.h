@@ -0,0 +1,111 @@
+/*
+ * resampler.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_RESAMPLER_H__
+#define __AUDIO_TOOL_RESAMPLER_H__
+
+#include <stdint.h>
+
+/* Quality presets: more taps and a wider Kaiser window buy stopband
+ * attenuation and a narrower transition band, at the cost of CPU.
+ */
+enum resampler_quality {
+	RESAMPLER_QUALITY_LOW,		/* 16 taps, ~55 dB */
+	RESAMPLER_QUALITY_MEDIUM,	/* 32 taps, ~80 dB */
+	RESAMPLER_QUALITY_HIGH,		/* 64 taps, ~100 dB */
+
+	RESAMPLER_QUALITY_MAX,
+};
+
+/* Returns the preset for a name ("low", "medium" or "high"), or -1 */
+int resampler_quality_parse(const char *name);
+
+/* Streaming polyphase sample rate converter for interleaved float frames.
+ *
+ * The rate ratio is reduced to up/down.  A windowed-sinc low-pass filter
+ * for the up-sampled rate is computed once and split into 'up' phases
+ * of 'taps' coefficients each, so every output sample is a single dot
+ * product over the last 'taps' input samples (SSE or NEON when
+ * available).  Input is kept de-interleaved, one history buffer per
+ * channel.
+ */
+struct resampler {
+	unsigned int channels;
+	unsigned int in_rate;
+	unsigned int out_rate;
+	unsigned int up;
+	unsigned int down;
+	unsigned int taps;
+	float *coefs;		/* up * taps, each phase stored reversed */
+
+	float *buf;		/* channels * buf_size input samples */
+	unsigned int buf_size;
+	unsigned int fill;	/* samples in each channel's buffer */
+	unsigned int pos;	/* newest input sample of the next output */
+	unsigned int phase;
+
+	/* cost accounting */
+	uint64_t cpu_ns;
+	uint64_t out_frames;
+};
+
+/* Returns 0 on success, errno on failure (EINVAL if the rate ratio
+ * can't be reduced to a reasonable number of phases).
+ */
+int resampler_init(struct resampler *r, unsigned int channels,
+		   unsigned int in_rate, unsigned int out_rate,
+		   enum resampler_quality quality);
+void resampler_deinit(struct resampler *r);
+
+/* Converts from in (*in_frames frames available) to out (room for
+ * out_frames frames).  Input is only taken when it is needed, so on
+ * return *in_frames holds the number of frames consumed.  Returns the
+ * number of frames produced.
+ */
+unsigned int resampler_process(struct resampler *r, const float *in,
+			       unsigned int *in_frames, float *out,
+			       unsigned int out_frames);
+
+/* Input frames of delay through the filter */
+static inline unsigned int resampler_delay(const struct resampler *r)
+{
+	return r->taps / 2;
+}
+
+/* Prints the ratio, filter size and CPU time per second of output */
+void resampler_report(const struct resampler *r);
+
+#endif /* __AUDIO_TOOL_RESAMPLER_H__ */
@@ -0,0 +1,163 @@
+/*
+ * rt-profile.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define _GNU_SOURCE /* for RUSAGE_THREAD and pthread_setaffinity_np() */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rt-profile.h"
+
+/* Stack the audio thread is expected to use at most */
+#define STACK_PREFAULT_BYTES (128 * 1024)
+
+void rt_profile_init(struct rt_profile *rt, int priority, int cpu,
+		     int lock_memory)
+{
+	memset(rt, 0, sizeof(*rt));
+	rt->priority = priority;
+	rt->cpu = cpu;
+	rt->lock_memory = lock_memory;
+	if (pthread_getaffinity_np(pthread_self(), sizeof(rt->cpus), &rt->cpus))
+		CPU_ZERO(&rt->cpus);
+}
+
+/* Grows the stack now, while faulting is still cheap, and keeps it in */
+static int __attribute__((noinline)) prefault_stack(void)
+{
+	volatile char stack[STACK_PREFAULT_BYTES];
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += page)
+		stack[i] = 0;
+
+	return mlock((const void *)stack, sizeof(stack)) ? errno : 0;
+}
+
+int rt_profile_enter(const struct rt_profile *rt)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int ret;
+
+	if (rt->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(rt->cpu, &cpus);
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (ret) {
+			fprintf(stderr, "Unable to run on CPU %d (%s)\n", rt->cpu,
+				strerror(ret));
+			return ret;
+		}
+	}
+
+	if (rt->lock_memory) {
+		ret = prefault_stack();
+		if (ret) {
+			fprintf(stderr, "Unable to lock memory (%s)\n",
+				strerror(ret));
+			return ret;
+		}
+	}
+
+	if (rt->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = rt->priority;
+		ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (ret) {
+			fprintf(stderr, "Unable to set SCHED_FIFO priority %d (%s)\n",
+				rt->priority, strerror(ret));
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+void rt_profile_leave(const struct rt_profile *rt)
+{
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+	if ((rt->cpu >= 0) && CPU_COUNT(&rt->cpus))
+		pthread_setaffinity_np(pthread_self(), sizeof(rt->cpus),
+				       &rt->cpus);
+}
+
+void rt_profile_prefault(const struct rt_profile *rt, void *buf,
+			 size_t bytes)
+{
+	volatile char *p = buf;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	if (!rt->lock_memory || !bytes)
+		return;
+
+	/* write, so private pages get copied now rather than on first use */
+	for (i = 0; i < bytes; i += page)
+		p[i] = p[i];
+	p[bytes - 1] = p[bytes - 1];
+
+	if (mlock(buf, bytes))
+		fprintf(stderr, "Unable to lock buffer memory (%s)\n",
+			strerror(errno));
+}
+
+void rt_profile_start(struct rt_profile *rt)
+{
+	getrusage(RUSAGE_THREAD, &rt->start);
+}
+
+void rt_profile_report(const struct rt_profile *rt, const char *label)
+{
+	struct rusage now;
+
+	getrusage(RUSAGE_THREAD, &now);
+	printf("%s: %ld major faults, %ld minor faults, %ld voluntary and "
+	       "%ld involuntary context switches\n", label,
+	       now.ru_majflt - rt->start.ru_majflt,
+	       now.ru_minflt - rt->start.ru_minflt,
+	       now.ru_nvcsw - rt->start.ru_nvcsw,
+	       now.ru_nivcsw - rt->start.ru_nivcsw);
+}
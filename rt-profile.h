@@ -0,0 +1,94 @@
+/*
+ * rt-profile.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_RT_PROFILE_H__
+#define __AUDIO_TOOL_RT_PROFILE_H__
+
+#include <sched.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* How the audio thread of a streaming loop runs
+ *
+ * By default the loops run as ordinary timeshare threads on whatever
+ * CPU the kernel picks, and their buffers are faulted in on first use.
+ * A profile can move the thread to SCHED_FIFO, pin it to one CPU, and
+ * lock and prefault its memory, so that nothing but the sound card
+ * makes it wait.
+ *
+ * The profile also counts the page faults and context switches of the
+ * audio thread while it streams, to show whether that worked.
+ */
+struct rt_profile {
+	int priority;		/* SCHED_FIFO priority, 0 to leave it alone */
+	int cpu;		/* CPU to run on, -1 for any */
+	int lock_memory;	/* lock and prefault the stack and buffers */
+
+	cpu_set_t cpus;		/* CPUs allowed before, for rt_profile_leave() */
+	struct rusage start;
+};
+
+/* Also notes the CPUs the calling thread may run on, so call it before
+ * the profile is entered.
+ */
+void rt_profile_init(struct rt_profile *rt, int priority, int cpu,
+		     int lock_memory);
+
+/* Applies the profile to the calling thread.  Returns 0 on success,
+ * errno on failure (typically EPERM without the privilege for it).
+ */
+int rt_profile_enter(const struct rt_profile *rt);
+
+/* Puts a helper thread spawned by the audio thread (e.g. for file I/O)
+ * back on the normal scheduler and on the CPUs it had before the profile,
+ * so it can't starve the audio thread.
+ */
+void rt_profile_leave(const struct rt_profile *rt);
+
+/* Touches and locks every page of buf, if the profile locks memory, so
+ * that the streaming loop never faults on it.  Only the buffers passed
+ * here are locked, not the whole process: input files are mapped, and
+ * locking those would pin all of them in RAM.
+ */
+void rt_profile_prefault(const struct rt_profile *rt, void *buf,
+			 size_t bytes);
+
+/* Counts faults and context switches from here to rt_profile_report() */
+void rt_profile_start(struct rt_profile *rt);
+void rt_profile_report(const struct rt_profile *rt, const char *label);
+
+#endif /* __AUDIO_TOOL_RT_PROFILE_H__ */
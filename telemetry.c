@@ -0,0 +1,151 @@
+/*
+ * telemetry.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <tinyalsa/asoundlib.h>
+
+#include "telemetry.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+/* Time between samples of the hardware pointer */
+#define SAMPLE_NS 100000000LL
+
+/* Don't quote a drift measured over less than this */
+#define MIN_FIT_NS NSEC_PER_SEC
+
+static int64_t ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+void telemetry_init(struct telemetry *tm, struct pcm *pcm, unsigned int rate,
+		    unsigned int report_ms)
+{
+	struct timespec now;
+
+	memset(tm, 0, sizeof(*tm));
+	tm->pcm = pcm;
+	tm->rate = rate;
+	tm->report_ns = report_ms * 1000000LL;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	tm->next_report_ns = ts_to_ns(&now) + tm->report_ns;
+}
+
+static void telemetry_print(struct telemetry *tm, const char *label)
+{
+	double n = tm->samples, span, slope, den;
+	long delay;
+
+	printf("%s:", label);
+
+	delay = pcm_get_delay(tm->pcm);
+	if (delay >= 0)
+		printf(" delay %ld frames (%.2f ms),", delay,
+		       delay * 1000.0 / tm->rate);
+
+	span = (double)(tm->last_ns - tm->first_ns) / NSEC_PER_SEC;
+	den = n * tm->sum_tt - tm->sum_t * tm->sum_t;
+	if (!tm->samples || (tm->last_ns - tm->first_ns < MIN_FIT_NS) ||
+	    (den <= 0.0)) {
+		printf(" drift not known yet\n");
+		return;
+	}
+
+	slope = (n * tm->sum_tf - tm->sum_t * tm->sum_f) / den;
+	printf(" device clock %+.1f ppm (%.2f hz) over %.1f s",
+	       (slope / tm->rate - 1.0) * 1e6, slope, span);
+	if (tm->restarts)
+		printf(", %u restarts", tm->restarts);
+	printf("\n");
+}
+
+void telemetry_sample(struct telemetry *tm)
+{
+	struct timespec now, tstamp;
+	unsigned int ptr;
+	int64_t now_ns;
+	double t, f;
+
+	if (!tm->report_ns)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns = ts_to_ns(&now);
+	if (now_ns < tm->next_sample_ns)
+		return;
+	tm->next_sample_ns = now_ns + SAMPLE_NS;
+
+	if (!pcm_get_hw_ptr(tm->pcm, &ptr, &tstamp)) {
+		/* an xrun or a wrap: the old samples no longer line up */
+		if (tm->samples && (ptr < tm->last_ptr)) {
+			tm->samples = 0;
+			tm->restarts++;
+		}
+		if (!tm->samples) {
+			tm->first_ns = ts_to_ns(&tstamp);
+			tm->first_ptr = ptr;
+			tm->sum_t = tm->sum_f = tm->sum_tt = tm->sum_tf = 0.0;
+		}
+
+		t = (double)(ts_to_ns(&tstamp) - tm->first_ns) / NSEC_PER_SEC;
+		f = ptr - tm->first_ptr;
+		tm->sum_t += t;
+		tm->sum_f += f;
+		tm->sum_tt += t * t;
+		tm->sum_tf += t * f;
+		tm->samples++;
+		tm->last_ptr = ptr;
+		tm->last_ns = ts_to_ns(&tstamp);
+	}
+
+	if (now_ns >= tm->next_report_ns) {
+		telemetry_print(tm, "telemetry");
+		tm->next_report_ns += tm->report_ns;
+		if (tm->next_report_ns < now_ns)
+			tm->next_report_ns = now_ns + tm->report_ns;
+	}
+}
+
+void telemetry_report(struct telemetry *tm)
+{
+	if (tm->report_ns)
+		telemetry_print(tm, "telemetry (final)");
+}
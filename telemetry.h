@@ -0,0 +1,83 @@
+/*
+ * telemetry.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_TELEMETRY_H__
+#define __AUDIO_TOOL_TELEMETRY_H__
+
+#include <stdint.h>
+
+struct pcm;
+
+/* Watches a running stream's delay and the drift of its clock
+ *
+ * Every so often the hardware pointer and its timestamp are sampled,
+ * and a least squares fit of position against time gives the rate the
+ * device actually runs at.  Its drift from the nominal rate, in parts
+ * per million of CLOCK_MONOTONIC, is printed along with the driver's
+ * delay every report_ms.
+ *
+ * The PCM must be opened with PCM_MONOTONIC.
+ */
+struct telemetry {
+	struct pcm *pcm;
+	unsigned int rate;
+	int64_t report_ns;		/* 0 when disabled */
+	int64_t next_sample_ns;
+	int64_t next_report_ns;
+
+	/* the fit, with times and positions relative to the first sample */
+	unsigned int samples;
+	int64_t first_ns;
+	int64_t last_ns;
+	unsigned int first_ptr;
+	unsigned int last_ptr;
+	double sum_t, sum_f, sum_tt, sum_tf;
+	unsigned int restarts;		/* fits restarted by a pointer jump */
+};
+
+/* report_ms of 0 disables the telemetry */
+void telemetry_init(struct telemetry *tm, struct pcm *pcm, unsigned int rate,
+		    unsigned int report_ms);
+
+/* Call from the streaming loop, as often as convenient.  Cheap unless a
+ * sample or a report is due.
+ */
+void telemetry_sample(struct telemetry *tm);
+
+/* Prints a last report */
+void telemetry_report(struct telemetry *tm);
+
+#endif /* __AUDIO_TOOL_TELEMETRY_H__ */
@@ -0,0 +1,71 @@
+/*
+ * throughput.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "throughput.h"
+
+static double elapsed_sec(const struct timespec *start, clockid_t clock)
+{
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+	return (now.tv_sec - start->tv_sec)
+		+ (now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+void throughput_start(struct throughput *tp)
+{
+	memset(tp, 0, sizeof(*tp));
+	clock_gettime(CLOCK_MONOTONIC, &tp->wall_start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tp->cpu_start);
+}
+
+void throughput_report(struct throughput *tp, const char *label)
+{
+	double wall, cpu;
+
+	wall = elapsed_sec(&tp->wall_start, CLOCK_MONOTONIC);
+	cpu = elapsed_sec(&tp->cpu_start, CLOCK_PROCESS_CPUTIME_ID);
+
+	printf("%s: copied %llu bytes in %.3f s (%.0f bytes/s), "
+	       "cpu %.3f s (%.0f bytes per cpu-second)\n",
+	       label, (unsigned long long)tp->bytes,
+	       wall, (wall > 0.0) ? tp->bytes / wall : 0.0,
+	       cpu, (cpu > 0.0) ? tp->bytes / cpu : 0.0);
+}
@@ -0,0 +1,66 @@
+/*
+ * throughput.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_THROUGHPUT_H__
+#define __AUDIO_TOOL_THROUGHPUT_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/* Measures how fast a streaming loop moves audio data.
+ *
+ * Both the wall-clock time and the process CPU time are recorded, so
+ * that the cost of copying can be compared between transfer methods
+ * (e.g. read/write vs. mmap) even though the loops spend most of their
+ * time blocked on the sound card.
+ */
+struct throughput {
+	struct timespec wall_start;
+	struct timespec cpu_start;
+	uint64_t bytes;
+};
+
+void throughput_start(struct throughput *tp);
+
+static inline void throughput_add(struct throughput *tp, uint64_t bytes)
+{
+	tp->bytes += bytes;
+}
+
+/* Prints a one-line summary prefixed with label */
+void throughput_report(struct throughput *tp, const char *label);
+
+#endif /* __AUDIO_TOOL_THROUGHPUT_H__ */
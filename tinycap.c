@@ -32,40 +32,135 @@
 #include <stdint.h>
 #include <signal.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "tinycap.h"
+#include "period-ring.h"
+#include "throughput.h"
+#include "wav-writer.h"
+#include "format-convert.h"
+#include "pipeline.h"
+#include "rt-profile.h"
+#include "telemetry.h"
+#include "xrun.h"
+#include "caps.h"
 
-#define ID_RIFF 0x46464952
-#define ID_WAVE 0x45564157
-#define ID_FMT  0x20746d66
-#define ID_DATA 0x61746164
-
-#define FORMAT_PCM 1
-
-struct wav_header {
-    uint32_t riff_id;
-    uint32_t riff_sz;
-    uint32_t riff_fmt;
-    uint32_t fmt_id;
-    uint32_t fmt_sz;
-    uint16_t audio_format;
-    uint16_t num_channels;
-    uint32_t sample_rate;
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
-    uint32_t data_id;
-    uint32_t data_sz;
+int capturing = 1;
+
+struct capture_sample_params {
+    unsigned int card;
+    unsigned int device;
+    unsigned int channels;
+    unsigned int rate;
+    enum sample_format format;
+    unsigned int period_size;
+    unsigned int period_count;
+    unsigned int duration;
+    int mmap;
+    int io_thread;
+    unsigned int ring_periods;
+    unsigned int telemetry;     /* seconds between reports, 0 for none */
+    int xrun_policy;
+    unsigned int xrun_log;
+    int low_latency;
+    struct rt_profile rt;
 };
 
-int capturing = 1;
+/* Where cap puts its frames: the wav writer, after a pipeline that
+ * converts them from the PCM's format and rate to the file's.
+ */
+struct capture_sink {
+    struct wav_writer *wav;
+    unsigned int pcm_frame_bytes;
+    struct pipeline pipeline;
+    char *buffer;               /* converted frames */
+    unsigned int buffer_frames;
+};
 
-static
-unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
-                            unsigned int channels, unsigned int rate,
-                            unsigned int bits, unsigned int period_size,
-                            unsigned int period_count, unsigned int duration);
+/* Frames converted per write to the file */
+#define SINK_BUFFER_FRAMES 1024
+
+static uint64_t capture_sample(struct capture_sink *sink,
+                               struct capture_sample_params *params);
+
+/* Returns 0 on success, errno on failure */
+static int capture_sink_init(struct capture_sink *sink, struct wav_writer *wav,
+                             const struct pipeline_params *params)
+{
+    int ret;
+
+    sink->wav = wav;
+    sink->pcm_frame_bytes = params->in_channels *
+        sample_format_bytes(params->in_format);
+
+    ret = pipeline_init(&sink->pipeline, params);
+    if (ret)
+        return ret;
+
+    sink->buffer = NULL;
+    sink->buffer_frames = SINK_BUFFER_FRAMES;
+    if (!pipeline_is_copy(&sink->pipeline)) {
+        sink->buffer = malloc(sink->buffer_frames *
+                              sink->pipeline.out_frame_bytes);
+        if (!sink->buffer) {
+            pipeline_deinit(&sink->pipeline);
+            return ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+static void capture_sink_deinit(struct capture_sink *sink)
+{
+    pipeline_deinit(&sink->pipeline);
+    free(sink->buffer);
+    sink->buffer = NULL;
+}
+
+/* Writes frames captured in the PCM's format and rate.
+ * Returns 0 on success, errno on failure.
+ */
+static int capture_sink_write(struct capture_sink *sink, const void *data,
+                              unsigned int frames)
+{
+    const char *src = data;
+    unsigned int in, out;
+    int ret;
+
+    if (!sink->buffer)
+        return wav_writer_write(sink->wav, data,
+                                (size_t)frames * sink->pcm_frame_bytes);
+
+    while (frames || pipeline_pending(&sink->pipeline)) {
+        in = frames;
+        out = sink->buffer_frames;
+        pipeline_process(&sink->pipeline, src, &in, sink->buffer, &out);
+        if (!in && !out)
+            break;
+
+        ret = wav_writer_write(sink->wav, sink->buffer,
+                               (size_t)out * sink->pipeline.out_frame_bytes);
+        if (ret)
+            return ret;
+
+        src += in * sink->pcm_frame_bytes;
+        frames -= in;
+    }
+
+    return 0;
+}
+
+/* Writes out whatever the pipeline still holds.
+ * Returns 0 on success, errno on failure.
+ */
+static int capture_sink_flush(struct capture_sink *sink)
+{
+    pipeline_drain(&sink->pipeline);
+    return capture_sink_write(sink, NULL, 0);
+}
 
 void sigint_handler(int sig)
 {
@@ -75,18 +170,24 @@ void sigint_handler(int sig)
 int tinycap_main(const struct audio_tool_config *config, int argc, char **argv,
 		int legacy_mode)
 {
-    FILE *file;
-    struct wav_header header;
+    struct wav_writer wav;
+    struct capture_sink sink;
+    struct capture_sample_params params;
+    struct pipeline_params pipeline_params;
+    enum sample_format pcm_format, file_format;
+    unsigned int file_channels;
     unsigned int card = 0;
     unsigned int device = 0;
     unsigned int channels = 2;
     unsigned int rate = 44100;
     unsigned int bits = 16;
-    unsigned int frames;
+    uint64_t frames;
     unsigned int period_size = 1024;
     unsigned int period_count = 4;
     unsigned int duration = 0;
+    struct wav_writer_params wav_params;
     int arg;
+    int ret;
 
     if ((!legacy_mode && argc != 2) || (legacy_mode && argc != 1)) {
         fprintf(stderr, "Usage: audio-tool [options] capture file.wav\n");
@@ -98,12 +199,6 @@ int tinycap_main(const struct audio_tool_config *config, int argc, char **argv,
     else
 	    arg = 1;
 
-    file = fopen(argv[arg], "wb");
-    if (!file) {
-        fprintf(stderr, "Unable to create file '%s'\n", argv[arg]);
-        return 1;
-    }
-
     device = config->device;
     channels = config->channels;
     rate = config->rate;
@@ -113,70 +208,402 @@ int tinycap_main(const struct audio_tool_config *config, int argc, char **argv,
     period_count = config->num_periods;
     duration = config->duration;
 
-    header.riff_id = ID_RIFF;
-    header.riff_sz = 0;
-    header.riff_fmt = ID_WAVE;
-    header.fmt_id = ID_FMT;
-    header.fmt_sz = 16;
-    header.audio_format = FORMAT_PCM;
-    header.num_channels = channels;
-    header.sample_rate = rate;
-    header.bits_per_sample = bits;
-    header.byte_rate = (header.bits_per_sample / 8) * channels * rate;
-    header.block_align = channels * (header.bits_per_sample / 8);
-    header.data_id = ID_DATA;
-
-    /* leave enough room for header */
-    fseek(file, sizeof(struct wav_header), SEEK_SET);
+    if (config->pcm_format >= 0) {
+        pcm_format = config->pcm_format;
+    } else {
+        switch (bits) {
+        case 8: pcm_format = SAMPLE_FORMAT_S8; break;
+        case 16: pcm_format = SAMPLE_FORMAT_S16_LE; break;
+        case 24: pcm_format = SAMPLE_FORMAT_S24_3LE; break;
+        case 32: pcm_format = SAMPLE_FORMAT_S32_LE; break;
+        default:
+            fprintf(stderr, "Error: %u-bit samples are not supported\n", bits);
+            return 1;
+        }
+    }
+
+    /* by default, store what the PCM delivers (as WAV can hold it) */
+    if (config->file_format >= 0)
+        file_format = config->file_format;
+    else if (pcm_format == SAMPLE_FORMAT_S8)
+        file_format = SAMPLE_FORMAT_U8;
+    else if (pcm_format == SAMPLE_FORMAT_S24_LE)
+        file_format = SAMPLE_FORMAT_S24_3LE;
+    else
+        file_format = pcm_format;
+
+    /* only the PCM channels in --channel-mask go to the file */
+    file_channels = channel_mask_count(config->channel_mask, channels);
+    if (!file_channels) {
+        fprintf(stderr, "Error: channel mask 0x%x selects none of %u channels\n",
+                config->channel_mask, channels);
+        return 1;
+    }
+
+    sample_format_to_wav(file_format, &wav_params.format, &wav_params.bits);
+    wav_params.channels = file_channels;
+    wav_params.rate = rate;
+    /* the size of a fixed-duration capture is known, so preallocate it */
+    wav_params.max_bytes = (uint64_t)duration * rate * file_channels *
+        sample_format_bytes(file_format);
+    wav_params.preallocate = 1;
+    if (config->rotate_size)
+        wav_params.rotate_bytes = (uint64_t)config->rotate_size << 20;
+    else
+        wav_params.rotate_bytes = (uint64_t)config->rotate_time * rate *
+            file_channels * sample_format_bytes(file_format);
+
+    ret = wav_writer_open(&wav, argv[arg], &wav_params);
+    if (ret) {
+        fprintf(stderr, "Unable to create file '%s' (%s)\n", argv[arg],
+                strerror(ret));
+        return 1;
+    }
+
+    /* -r is the file's rate; the PCM can run at another */
+    pipeline_params.in_channels = channels;
+    pipeline_params.in_mask = config->channel_mask;
+    pipeline_params.in_format = pcm_format;
+    pipeline_params.in_rate = config->pcm_rate ? (unsigned int)config->pcm_rate : rate;
+    pipeline_params.out_channels = file_channels;
+    pipeline_params.out_mask = ~0;
+    pipeline_params.out_format = file_format;
+    pipeline_params.out_rate = rate;
+    pipeline_params.quality = config->resample_quality;
+    pipeline_params.dither = config->dither;
+    ret = capture_sink_init(&sink, &wav, &pipeline_params);
+    if (ret) {
+        fprintf(stderr, "Unable to set up conversion (%s)\n", strerror(ret));
+        wav_writer_close(&wav);
+        return 1;
+    }
+
+    printf("Capturing sample: %u ch, %u hz, %s", channels,
+           pipeline_params.in_rate, sample_format_name(pcm_format));
+    if (!pipeline_is_copy(&sink.pipeline))
+        printf(" as %u ch, %u hz, %s%s", file_channels, rate,
+               sample_format_name(file_format),
+               pipeline_dithers(&sink.pipeline) ? " (dithered)" : "");
+    printf("\n");
 
     /* install signal handler and begin capturing */
     signal(SIGINT, sigint_handler);
-    frames = capture_sample(file, card, device, header.num_channels,
-                            header.sample_rate, header.bits_per_sample,
-                            period_size, period_count, duration);
-    printf("Captured %d frames\n", frames);
+    params.card = card;
+    params.device = device;
+    params.channels = channels;
+    params.rate = pipeline_params.in_rate;
+    params.format = pcm_format;
+    params.period_size = period_size;
+    params.period_count = period_count;
+    params.duration = duration;
+    params.mmap = config->mmap;
+    params.io_thread = config->io_thread;
+    params.ring_periods = config->ring_periods;
+    params.telemetry = config->telemetry;
+    params.xrun_policy = config->xrun_policy;
+    params.xrun_log = config->xrun_log;
+    params.low_latency = config->low_latency;
+    rt_profile_init(&params.rt, config->rt_priority, config->cpu,
+                    config->mlock);
+    frames = capture_sample(&sink, &params);
+    printf("Captured %llu frames\n", (unsigned long long)frames);
+    if (capture_sink_flush(&sink))
+        fprintf(stderr, "Error capturing sample\n");
+    pipeline_report(&sink.pipeline);
+    capture_sink_deinit(&sink);
 
     /* write header now all information is known */
-    header.data_sz = frames * header.block_align;
-    fseek(file, 0, SEEK_SET);
-    fwrite(&header, sizeof(struct wav_header), 1, file);
+    ret = wav_writer_close(&wav);
+    if (ret) {
+        fprintf(stderr, "Error finishing file '%s' (%s)\n", argv[arg],
+                strerror(ret));
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Captures through the mmap() API: each chunk of captured frames is
+ * written to the file directly from the DMA ring, without going through
+ * an intermediate buffer.  With a preallocated file and no format
+ * conversion, that is a single copy from the DMA area into the file's
+ * pages.
+ */
+static int capture_sample_mmap(struct pcm *pcm, struct capture_sink *sink,
+                               uint64_t requested, int wait_ms,
+                               uint64_t *bytes_read, struct telemetry *tm,
+                               struct throughput *tp)
+{
+    unsigned int buffer_size = pcm_get_buffer_size(pcm);
+    unsigned int offset, frames, bytes;
+    unsigned int overruns = 0;
+    int avail, err;
+    void *area;
+
+    if (pcm_start(pcm)) {
+        fprintf(stderr, "Unable to start PCM (%s)\n", pcm_get_error(pcm));
+        return -1;
+    }
+
+    while (capturing && (!requested || (*bytes_read < requested))) {
+        /* the stop threshold is well beyond the buffer size, so an
+         * overrun shows up as more frames than the ring can hold */
+        avail = pcm_avail_update(pcm);
+        if (avail > (int)buffer_size) {
+            overruns++;
+            pcm_stop(pcm);
+            if (pcm_start(pcm))
+                return -1;
+            continue;
+        }
+
+        frames = buffer_size;
+        pcm_mmap_begin(pcm, &area, &offset, &frames);
+        if (!frames) {
+            err = pcm_wait(pcm, wait_ms);
+            if (err == 0) {
+                fprintf(stderr, "Timeout waiting for PCM\n");
+                return -1;
+            } else if (err == -EPIPE) {
+                overruns++;
+                pcm_stop(pcm);
+                if (pcm_start(pcm))
+                    return -1;
+            } else if (err < 0) {
+                fprintf(stderr, "Error waiting for PCM (%s)\n", strerror(-err));
+                return -1;
+            }
+            continue;
+        }
+
+        bytes = pcm_frames_to_bytes(pcm, frames);
+        if (requested && (bytes > requested - *bytes_read)) {
+            frames = pcm_bytes_to_frames(pcm, requested - *bytes_read);
+            bytes = pcm_frames_to_bytes(pcm, frames);
+        }
+
+        if (capture_sink_write(sink,
+                               (char*)area + pcm_frames_to_bytes(pcm, offset),
+                               frames)) {
+            fprintf(stderr, "Error capturing sample\n");
+            return -1;
+        }
+        pcm_mmap_commit(pcm, offset, frames);
+        throughput_add(tp, bytes);
+        telemetry_sample(tm);
+        *bytes_read += bytes;
+    }
 
-    fclose(file);
+    if (overruns)
+        printf("%u overruns\n", overruns);
 
     return 0;
 }
 
+struct capture_writer {
+    struct capture_sink *sink;
+    const struct rt_profile *rt;
+    struct period_ring ring;
+    uint64_t written;
+    int error;
+};
+
+/* Drains the ring to the file, as many contiguous periods per write as
+ * are ready.  Any format conversion happens here, off the audio thread.
+ */
+static void *capture_writer_thread(void *arg)
+{
+    struct capture_writer *writer = arg;
+    unsigned int periods, bytes;
+    char *block;
+
+    rt_profile_leave(writer->rt);
+
+    while ((block = period_ring_read_begin_block(&writer->ring,
+                                                 writer->ring.periods,
+                                                 &periods, &bytes, 1))) {
+        if (!writer->error &&
+            capture_sink_write(writer->sink, block,
+                               bytes / writer->sink->pcm_frame_bytes))
+            writer->error = 1;
+        if (!writer->error)
+            writer->written += bytes;
+        period_ring_read_commit_block(&writer->ring, periods);
+    }
+
+    return NULL;
+}
+
+/* The audio thread only moves periods into the ring.  If the writer
+ * falls behind and the ring is full, the period is read anyway (so the
+ * hardware doesn't overrun) and dropped.
+ */
+static int capture_sample_ring(struct pcm *pcm, struct capture_sink *sink,
+                               uint64_t requested,
+                               struct capture_sample_params *params,
+                               uint64_t *bytes_read, struct telemetry *tm,
+                               struct throughput *tp)
+{
+    struct capture_writer writer;
+    unsigned int period_bytes;
+    uint64_t captured = 0;
+    pthread_t thread;
+    char *scratch;
+    char *slot;
+    int ret;
+
+    period_bytes = pcm_frames_to_bytes(pcm, params->period_size);
+
+    memset(&writer, 0, sizeof(writer));
+    writer.sink = sink;
+    writer.rt = &params->rt;
+    ret = period_ring_init(&writer.ring, params->ring_periods, period_bytes);
+    if (ret) {
+        fprintf(stderr, "Unable to allocate ring (%s)\n", strerror(ret));
+        return -1;
+    }
+
+    scratch = malloc(period_bytes);
+    if (!scratch) {
+        fprintf(stderr, "Unable to allocate %u bytes\n", period_bytes);
+        period_ring_deinit(&writer.ring);
+        return -1;
+    }
+    rt_profile_prefault(&params->rt, writer.ring.data,
+                        writer.ring.periods * period_bytes);
+    rt_profile_prefault(&params->rt, scratch, period_bytes);
+
+    ret = pthread_create(&thread, NULL, capture_writer_thread, &writer);
+    if (ret) {
+        fprintf(stderr, "Unable to start writer thread (%s)\n", strerror(ret));
+        free(scratch);
+        period_ring_deinit(&writer.ring);
+        return -1;
+    }
+
+    while (capturing && (!requested || (captured < requested))
+           && !writer.error) {
+        slot = period_ring_write_begin(&writer.ring, 0);
+
+        if (params->mmap)
+            ret = pcm_mmap_read(pcm, slot ? slot : scratch, period_bytes);
+        else
+            ret = pcm_read(pcm, slot ? slot : scratch, period_bytes);
+
+        if (slot)
+            period_ring_write_commit(&writer.ring, ret ? 0 : period_bytes);
+        if (ret) {
+            fprintf(stderr, "Error capturing sample (%s)\n", pcm_get_error(pcm));
+            break;
+        }
+        throughput_add(tp, period_bytes);
+        telemetry_sample(tm);
+        captured += period_bytes;
+    }
+
+    period_ring_write_eof(&writer.ring);
+    pthread_join(thread, NULL);
+
+    if (writer.error)
+        fprintf(stderr, "Error writing file\n");
+
+    printf("ring: %u periods, high water %u, low water %u, "
+           "%u periods dropped (writer stalled), %d overruns (hardware)\n",
+           writer.ring.periods, writer.ring.high_water, writer.ring.low_water,
+           writer.ring.overflows, pcm_get_underruns(pcm));
+
+    *bytes_read = writer.written;
+    free(scratch);
+    period_ring_deinit(&writer.ring);
+    return (ret || writer.error) ? -1 : 0;
+}
+
 static
-unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
-                            unsigned int channels, unsigned int rate,
-                            unsigned int bits, unsigned int period_size,
-                            unsigned int period_count, unsigned int duration)
+uint64_t capture_sample(struct capture_sink *sink,
+                        struct capture_sample_params *params)
 {
     struct pcm_config config;
     struct pcm *pcm;
+    struct throughput tp;
+    struct telemetry tm;
     char *buffer;
-    unsigned int size;
-    unsigned int bytes_read = 0;
-    unsigned long requested;
-
-    config.channels = channels;
-    config.rate = rate;
-    config.period_size = period_size;
-    config.period_count = period_count;
-    if (bits == 32)
-        config.format = PCM_FORMAT_S32_LE;
-    else if (bits == 16)
-        config.format = PCM_FORMAT_S16_LE;
+    unsigned int size, flags;
+    uint64_t bytes_read = 0;
+    uint64_t requested;
+    int wait_ms;
+
+    memset(&config, 0, sizeof(config));
+    config.channels = params->channels;
+    config.rate = params->rate;
+    config.period_size = params->period_size;
+    config.period_count = params->period_count;
+    sample_format_to_pcm(params->format, &config.format);
     config.start_threshold = 0;
     config.stop_threshold = 0;
     config.silence_threshold = 0;
 
-    pcm = pcm_open(card, device, PCM_IN, &config);
+    flags = PCM_IN;
+    if (params->mmap)
+        flags |= PCM_MMAP;
+    if (params->telemetry)
+        flags |= PCM_MONOTONIC;
+
+    if (params->low_latency) {
+        if (caps_fit(params->card, params->device, flags, &config))
+            return 0;
+        params->period_size = config.period_size;
+        params->period_count = config.period_count;
+    }
+
+    pcm = pcm_open(params->card, params->device, flags, &config);
     if (!pcm || !pcm_is_ready(pcm)) {
         fprintf(stderr, "Unable to open PCM device (%s)\n",
                 pcm_get_error(pcm));
         return 0;
     }
+    if (xrun_setup(pcm, params->xrun_policy, params->xrun_log)) {
+        pcm_close(pcm);
+        return 0;
+    }
+
+    if (rt_profile_enter(&params->rt)) {
+        pcm_close(pcm);
+        return 0;
+    }
+    telemetry_init(&tm, pcm, params->rate, params->telemetry * 1000);
+
+    if (params->duration)
+        requested = (uint64_t)params->rate * params->duration *
+            pcm_frames_to_bytes(pcm, 1);
+    else
+        requested = 0;
+
+    if (params->io_thread) {
+        throughput_start(&tp);
+        rt_profile_start(&params->rt);
+        capture_sample_ring(pcm, sink, requested, params, &bytes_read, &tm,
+                            &tp);
+        throughput_report(&tp, params->mmap ? "mmap, io thread" : "io thread");
+        rt_profile_report(&params->rt, "audio thread");
+        telemetry_report(&tm);
+        xrun_report(pcm, "capture");
+        pcm_close(pcm);
+        return bytes_read / sink->pcm_frame_bytes;
+    }
+
+    if (params->mmap) {
+        wait_ms = 100 + 1000 * pcm_get_buffer_size(pcm) / params->rate;
+        throughput_start(&tp);
+        rt_profile_start(&params->rt);
+        capture_sample_mmap(pcm, sink, requested, wait_ms, &bytes_read, &tm,
+                            &tp);
+        throughput_report(&tp, "mmap");
+        rt_profile_report(&params->rt, "audio thread");
+        telemetry_report(&tm);
+        xrun_report(pcm, "capture");
+        pcm_close(pcm);
+        return bytes_read / sink->pcm_frame_bytes;
+    }
 
     size = pcm_frames_to_bytes(pcm, pcm_get_buffer_size(pcm));
     buffer = malloc(size);
@@ -186,25 +613,27 @@ unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
         pcm_close(pcm);
         return 0;
     }
+    rt_profile_prefault(&params->rt, buffer, size);
 
-    if (duration)
-        requested = pcm_frames_to_bytes(pcm, rate * duration);
-    else
-        requested = 0;
-
-    printf("Capturing sample: %u ch, %u hz, %u bit\n", channels, rate, bits);
-
+    throughput_start(&tp);
+    rt_profile_start(&params->rt);
     while (capturing && (!requested || (bytes_read < requested)) &&
            !pcm_read(pcm, buffer, size)) {
-        if (fwrite(buffer, 1, size, file) != size) {
+        if (capture_sink_write(sink, buffer, pcm_bytes_to_frames(pcm, size))) {
             fprintf(stderr,"Error capturing sample\n");
             break;
         }
+        throughput_add(&tp, size);
+        telemetry_sample(&tm);
         bytes_read += size;
     }
+    throughput_report(&tp, "read/write");
+    rt_profile_report(&params->rt, "audio thread");
+    printf("%d overruns\n", pcm_get_underruns(pcm));
+    telemetry_report(&tm);
+    xrun_report(pcm, "capture");
 
     free(buffer);
     pcm_close(pcm);
-    return bytes_read / ((bits / 8) * channels);
+    return bytes_read / sink->pcm_frame_bytes;
 }
-
@@ -26,63 +26,465 @@
 ** DAMAGE.
 */
 
+#define _GNU_SOURCE /* for asprintf() */
 #include <tinyalsa/asoundlib.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "tinyplay.h"
+#include "period-ring.h"
+#include "throughput.h"
+#include "wav-reader.h"
+#include "format-convert.h"
+#include "pipeline.h"
+#include "rt-profile.h"
+#include "telemetry.h"
+#include "xrun.h"
+#include "caps.h"
+#include "noirq-scheduler.h"
 
-#define ID_RIFF 0x46464952
-#define ID_WAVE 0x45564157
-#define ID_FMT  0x20746d66
-#define ID_DATA 0x61746164
-
-struct riff_wave_header {
-    uint32_t riff_id;
-    uint32_t riff_sz;
-    uint32_t wave_id;
+struct play_sample_params {
+    unsigned int card;
+    unsigned int device;
+    unsigned int channels;
+    unsigned int rate;
+    enum sample_format format;
+    unsigned int period_size;
+    unsigned int period_count;
+    int mmap;
+    int noirq;
+    int io_thread;
+    unsigned int ring_periods;
+    unsigned int telemetry;     /* seconds between reports, 0 for none */
+    int xrun_policy;
+    unsigned int xrun_log;
+    int low_latency;
+    struct rt_profile rt;
 };
 
-struct chunk_header {
-    uint32_t id;
-    uint32_t sz;
+/* A file in the play list: mapped, with its own pipeline to the PCM */
+struct play_file {
+    const char *name;
+    struct wav_reader wav;
+    enum sample_format format;
+    struct pipeline pipeline;
+    const char *data;
+    uint64_t frames;            /* file frames not yet read */
+    int drained;
+    int open;
 };
 
-struct chunk_fmt {
-    uint16_t audio_format;
-    uint16_t num_channels;
-    uint32_t sample_rate;
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
+/* Where play gets its frames from: the files on the command line, one
+ * after the other, through a single open PCM.  Each file is converted
+ * to the PCM's format and rate by its own pipeline.  The next file is
+ * opened, parsed and prefetched as soon as the current one starts, and
+ * reads are spliced across the boundary, so the PCM never sees a gap.
+ *
+ * The opening and closing is done by a loader thread, so that the
+ * thread reading frames (the audio thread, without --io-thread) only
+ * swaps files at a boundary.
+ */
+struct play_source {
+    char **names;
+    unsigned int num_names;
+    unsigned int next;          /* next name to open */
+    struct play_file files[2];  /* current and next */
+    unsigned int cur;
+    struct pipeline_params out; /* the PCM side of every pipeline */
+    int limited;
+    uint64_t remaining;         /* PCM frames left, if limited by -t */
+
+    pthread_t loader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int have_loader;
+    int ready;                  /* files[cur ^ 1] is set up (or none is left) */
+    int quit;
 };
 
-static
-void play_sample(FILE *file, unsigned int card, unsigned int device, unsigned int channels,
-                 unsigned int rate, unsigned int bits, unsigned int period_size,
-                 unsigned int period_count, unsigned int duration);
+/* Seconds of each file to read ahead before it starts playing */
+#define PREFETCH_SECONDS 1
+
+static void play_sample(struct play_source *src,
+                        struct play_sample_params *params);
+
+/* Returns 0 on success, errno on failure */
+static int play_source_add(struct play_source *src, const char *name)
+{
+    char **names;
+
+    names = realloc(src->names, (src->num_names + 1) * sizeof(*names));
+    if (!names)
+        return ENOMEM;
+    src->names = names;
+
+    names[src->num_names] = strdup(name);
+    if (!names[src->num_names])
+        return ENOMEM;
+    src->num_names++;
+    return 0;
+}
+
+static int is_playlist(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+
+    return ext && (!strcmp(ext, ".m3u") || !strcmp(ext, ".m3u8"));
+}
+
+/* Adds the files listed in an M3U playlist.  Relative paths are taken
+ * from the playlist's directory.  Returns 0 on success, errno on failure.
+ */
+static int play_source_add_playlist(struct play_source *src, const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    int dir_len = slash ? slash - path + 1 : 0;
+    char *line = NULL, *name;
+    size_t size = 0;
+    ssize_t len;
+    FILE *file;
+    int ret = 0;
+
+    file = fopen(path, "r");
+    if (!file)
+        return errno;
+
+    while (!ret && ((len = getline(&line, &size, file)) >= 0)) {
+        while (len && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+            line[--len] = '\0';
+        if (!len || (line[0] == '#'))
+            continue;
+
+        if ((line[0] == '/') || !dir_len) {
+            ret = play_source_add(src, line);
+            continue;
+        }
+
+        if (asprintf(&name, "%.*s%s", dir_len, path, line) < 0) {
+            ret = ENOMEM;
+            break;
+        }
+        ret = play_source_add(src, name);
+        free(name);
+    }
+
+    free(line);
+    fclose(file);
+    return ret;
+}
+
+/* Maps and parses the file.  Returns 0 on success, -1 on failure. */
+static int play_file_open(struct play_file *f, const char *name)
+{
+    int ret;
+
+    f->name = name;
+    ret = wav_reader_open(&f->wav, name);
+    if (ret == EINVAL) {
+        fprintf(stderr, "Error: '%s' is not a valid wave file (%s)\n",
+                name, f->wav.error);
+        return -1;
+    } else if (ret) {
+        fprintf(stderr, "Unable to open file '%s' (%s)\n", name,
+                strerror(ret));
+        return -1;
+    }
+
+    if (sample_format_from_wav(f->wav.format, f->wav.bits, &f->format)) {
+        fprintf(stderr, "Error: '%s' has unsupported %u-bit samples\n",
+                name, f->wav.bits);
+        wav_reader_close(&f->wav);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Sets up the pipeline from the file to the PCM and starts reading the
+ * file ahead.  Returns 0 on success, -1 on failure.
+ */
+static int play_file_start(struct play_source *src, struct play_file *f)
+{
+    struct pipeline_params params = src->out;
+    int ret;
+
+    params.in_channels = f->wav.channels;
+    params.in_mask = ~0;
+    params.in_format = f->format;
+    params.in_rate = f->wav.rate;
+    ret = pipeline_init(&f->pipeline, &params);
+    if (ret) {
+        fprintf(stderr, "Unable to convert '%s' from %u ch, %u hz to %u ch, "
+                "%u hz (%s)\n", f->name, f->wav.channels, f->wav.rate,
+                params.out_channels, params.out_rate, strerror(ret));
+        wav_reader_close(&f->wav);
+        return -1;
+    }
+
+    f->data = f->wav.data;
+    f->frames = f->wav.data_bytes / f->wav.block_align;
+    f->drained = 0;
+    f->open = 1;
+
+    wav_reader_prefetch(&f->wav, (size_t)PREFETCH_SECONDS * f->wav.rate *
+                        f->wav.block_align);
+    return 0;
+}
+
+static void play_file_close(struct play_file *f)
+{
+    if (!f->open)
+        return;
+
+    pipeline_report(&f->pipeline);
+    pipeline_deinit(&f->pipeline);
+    wav_reader_close(&f->wav);
+    f->open = 0;
+}
+
+static void play_file_describe(struct play_source *src, struct play_file *f)
+{
+    printf("Playing '%s': %u ch, %u hz, %s", f->name, f->wav.channels,
+           f->wav.rate, sample_format_name(f->format));
+    if (!pipeline_is_copy(&f->pipeline))
+        printf(" as %u ch, %u hz, %s%s", src->out.out_channels,
+               src->out.out_rate, sample_format_name(src->out.out_format),
+               pipeline_dithers(&f->pipeline) ? " (dithered)" : "");
+    printf("\n");
+}
+
+/* Opens the next file in the list that can be played into f */
+static void play_source_open_next(struct play_source *src, struct play_file *f)
+{
+    while (src->next < src->num_names) {
+        if (!play_file_open(f, src->names[src->next++]) &&
+            !play_file_start(src, f))
+            return;
+    }
+}
+
+/* Each time the reading side moves on, closes the file it left and
+ * sets up the one after the new current one in its place
+ */
+static void *play_source_loader(void *arg)
+{
+    struct play_source *src = arg;
+    struct play_file *f;
+
+    pthread_mutex_lock(&src->lock);
+    for (;;) {
+        while (src->ready && !src->quit)
+            pthread_cond_wait(&src->cond, &src->lock);
+        if (src->quit)
+            break;
+        /* cur doesn't change until ready is set again */
+        f = &src->files[src->cur ^ 1];
+        pthread_mutex_unlock(&src->lock);
+
+        play_file_close(f);
+        if (src->files[src->cur].open)
+            play_file_describe(src, &src->files[src->cur]);
+        play_source_open_next(src, f);
+
+        pthread_mutex_lock(&src->lock);
+        src->ready = 1;
+        pthread_cond_signal(&src->cond);
+    }
+    pthread_mutex_unlock(&src->lock);
+    return NULL;
+}
+
+/* The current file is finished: move on to the one already opened, and
+ * leave the rest to the loader.  This only waits if the loader is still
+ * opening that file, i.e. the one before it was shorter than that took.
+ */
+static void play_source_advance(struct play_source *src)
+{
+    pthread_mutex_lock(&src->lock);
+    while (!src->ready)
+        pthread_cond_wait(&src->cond, &src->lock);
+    src->cur ^= 1;
+    src->ready = 0;
+    pthread_cond_signal(&src->cond);
+    pthread_mutex_unlock(&src->lock);
+}
+
+/* Opens the first playable file, which decides the PCM's configuration
+ * unless the command line does.  Returns 0 on success, -1 on failure.
+ */
+static int play_source_init(struct play_source *src,
+                            const struct audio_tool_config *config)
+{
+    struct play_file *f = &src->files[0];
+    enum sample_format format;
+    int ret = -1;
+
+    while (ret && (src->next < src->num_names))
+        ret = play_file_open(f, src->names[src->next++]);
+    if (ret)
+        return -1;
+
+    /* unless told otherwise, play the file's format if the PCM API has it */
+    if (config->pcm_format >= 0)
+        format = config->pcm_format;
+    else
+        format = sample_format_playable(f->format);
+
+    /* the file's channels go to the PCM channels in --channel-mask */
+    src->out.out_channels = config->pcm_channels ?
+        (unsigned int)config->pcm_channels : f->wav.channels;
+    src->out.out_mask = config->channel_mask;
+    src->out.out_format = format;
+    src->out.out_rate = config->pcm_rate ?
+        (unsigned int)config->pcm_rate : f->wav.rate;
+    src->out.quality = config->resample_quality;
+    src->out.dither = config->dither;
+
+    src->limited = (config->duration > 0);
+    src->remaining = (uint64_t)config->duration * src->out.out_rate;
+
+    if (play_file_start(src, f))
+        return -1;
+
+    src->cur = 0;
+    play_file_describe(src, f);
+    play_source_open_next(src, &src->files[1]);
+
+    /* started before the audio thread takes on its profile, so it runs
+     * as an ordinary thread */
+    src->ready = 1;
+    pthread_mutex_init(&src->lock, NULL);
+    pthread_cond_init(&src->cond, NULL);
+    ret = pthread_create(&src->loader, NULL, play_source_loader, src);
+    if (ret) {
+        fprintf(stderr, "Unable to start loader thread (%s)\n",
+                strerror(ret));
+        pthread_mutex_destroy(&src->lock);
+        pthread_cond_destroy(&src->cond);
+        return -1;
+    }
+    src->have_loader = 1;
+    return 0;
+}
+
+static void play_source_deinit(struct play_source *src)
+{
+    unsigned int i;
+
+    if (src->have_loader) {
+        pthread_mutex_lock(&src->lock);
+        src->quit = 1;
+        pthread_cond_signal(&src->cond);
+        pthread_mutex_unlock(&src->lock);
+        pthread_join(src->loader, NULL);
+        pthread_mutex_destroy(&src->lock);
+        pthread_cond_destroy(&src->cond);
+    }
+
+    play_file_close(&src->files[0]);
+    play_file_close(&src->files[1]);
+
+    for (i = 0; i < src->num_names; i++)
+        free(src->names[i]);
+    free(src->names);
+}
+
+/* True once every frame has been handed to the PCM */
+static int play_source_done(struct play_source *src)
+{
+    return !src->files[src->cur].open || (src->limited && !src->remaining);
+}
+
+/* Moves up to frames frames to dst, in the PCM's format and rate,
+ * crossing into the next file if need be.  Returns the number of frames
+ * moved.
+ */
+static unsigned int play_source_read(struct play_source *src, void *dst,
+                                     unsigned int frames)
+{
+    struct play_file *f;
+    unsigned int total = 0, in, out;
+    char *d = dst;
+
+    if (src->limited && (frames > src->remaining))
+        frames = src->remaining;
+
+    while (total < frames) {
+        f = &src->files[src->cur];
+        if (!f->open)
+            break;
+
+        in = (f->frames > UINT32_MAX) ? UINT32_MAX : f->frames;
+        out = frames - total;
+        pipeline_process(&f->pipeline, f->data, &in, d, &out);
+        f->data += (size_t)in * f->wav.block_align;
+        f->frames -= in;
+        total += out;
+        d += (size_t)out * f->pipeline.out_frame_bytes;
+
+        /* flush the tail of the file out of the resampler */
+        if (!f->frames && !f->drained) {
+            pipeline_drain(&f->pipeline);
+            f->drained = 1;
+        }
+
+        if (!f->frames && !pipeline_pending(&f->pipeline))
+            play_source_advance(src);
+    }
+
+    if (src->limited)
+        src->remaining -= total;
+    return total;
+}
+
+/* If the current file needs no conversion, returns a pointer to its next
+ * frames, with *frames lowered to the number available there.  Returns
+ * NULL otherwise.
+ */
+static const void *play_source_peek(struct play_source *src,
+                                    unsigned int *frames)
+{
+    struct play_file *f = &src->files[src->cur];
+
+    if (!f->open || !pipeline_is_copy(&f->pipeline))
+        return NULL;
+
+    if (*frames > f->frames)
+        *frames = f->frames;
+    if (src->limited && (*frames > src->remaining))
+        *frames = src->remaining;
+    return f->data;
+}
+
+/* Consumes frames returned by play_source_peek() */
+static void play_source_skip(struct play_source *src, unsigned int frames)
+{
+    struct play_file *f = &src->files[src->cur];
+
+    f->data += (size_t)frames * f->wav.block_align;
+    f->frames -= frames;
+    if (src->limited)
+        src->remaining -= frames;
+
+    if (!f->frames)
+        play_source_advance(src);
+}
 
 int tinyplay_main(const struct audio_tool_config *config, int argc, char **argv,
 		int legacy_mode)
 {
-    FILE *file;
-    struct riff_wave_header riff_wave_header;
-    struct chunk_header chunk_header;
-    struct chunk_fmt chunk_fmt;
-    unsigned int device = 0;
-    unsigned int card = 0;
-    unsigned int period_size = 1024;
-    unsigned int period_count = 4;
-    unsigned int duration = -1;
+    struct play_sample_params params;
+    struct play_source src;
     int arg;
-    char *filename;
-    int more_chunks = 1;
+    int ret = 0;
 
-    if ((!legacy_mode && argc != 2) || (legacy_mode && argc != 1)) {
-        fprintf(stderr, "Usage: audio-tool [options] play file.wav\n");
+    if ((!legacy_mode && argc < 2) || (legacy_mode && argc < 1)) {
+        fprintf(stderr, "Usage: audio-tool [options] play file.wav|list.m3u...\n");
         return 1;
     }
 
@@ -91,115 +493,393 @@ int tinyplay_main(const struct audio_tool_config *config, int argc, char **argv,
     else
 	    arg = 1;
 
-    filename = argv[1];
-    file = fopen(filename, "rb");
-    if (!file) {
-        fprintf(stderr, "Unable to open file '%s'\n", filename);
+    memset(&src, 0, sizeof(src));
+    for (; !ret && arg < argc; arg++) {
+        if (is_playlist(argv[arg]))
+            ret = play_source_add_playlist(&src, argv[arg]);
+        else
+            ret = play_source_add(&src, argv[arg]);
+        if (ret)
+            fprintf(stderr, "Unable to read '%s' (%s)\n", argv[arg],
+                    strerror(ret));
+    }
+
+    if (ret || play_source_init(&src, config)) {
+        play_source_deinit(&src);
         return 1;
     }
 
-    device = config->device;
-    period_size = config->period_size;
-    period_count = config->num_periods;
-    card = config->card;
-    duration = config->duration;
+    params.card = config->card;
+    params.device = config->device;
+    params.channels = src.out.out_channels;
+    params.rate = src.out.out_rate;
+    params.format = src.out.out_format;
+    params.period_size = config->period_size;
+    params.period_count = config->num_periods;
+    params.mmap = config->mmap || config->noirq;
+    params.noirq = config->noirq;
+    params.io_thread = config->io_thread;
+    params.ring_periods = config->ring_periods;
+    params.telemetry = config->telemetry;
+    params.xrun_policy = config->xrun_policy;
+    params.xrun_log = config->xrun_log;
+    params.low_latency = config->low_latency;
+    rt_profile_init(&params.rt, config->rt_priority, config->cpu,
+                    config->mlock);
 
-    fread(&riff_wave_header, sizeof(riff_wave_header), 1, file);
-    if ((riff_wave_header.riff_id != ID_RIFF) ||
-        (riff_wave_header.wave_id != ID_WAVE)) {
-        fprintf(stderr, "Error: '%s' is not a riff/wave file\n", filename);
-        fclose(file);
-        return 1;
+    play_sample(&src, &params);
+
+    play_source_deinit(&src);
+
+    return 0;
+}
+
+/* Waits for room for frames frames, on the timer if there are no period
+ * interrupts.  Returns the same as pcm_wait().
+ */
+static int play_wait(struct pcm *pcm, struct noirq_scheduler *sched,
+                     unsigned int frames, int wait_ms)
+{
+    if (sched)
+        return noirq_scheduler_wait(sched, frames, wait_ms);
+    return pcm_wait(pcm, wait_ms);
+}
+
+/* Plays through the mmap() API: frames are copied (or converted) from
+ * the mapped file straight into the DMA ring, so nothing is staged in
+ * between.
+ */
+static int play_sample_mmap(struct pcm *pcm, struct play_source *src,
+                            unsigned int period_size, int wait_ms,
+                            struct noirq_scheduler *sched,
+                            struct telemetry *tm, struct throughput *tp)
+{
+    unsigned int buffer_size = pcm_get_buffer_size(pcm);
+    unsigned int start_threshold = buffer_size / 2;
+    unsigned int offset, frames, queued = 0;
+    int started = 0;
+    int err;
+    void *area;
+
+    if (pcm_prepare(pcm)) {
+        fprintf(stderr, "Unable to prepare PCM (%s)\n", pcm_get_error(pcm));
+        return -1;
     }
 
-    do {
-        fread(&chunk_header, sizeof(chunk_header), 1, file);
+    while (!play_source_done(src)) {
+        frames = buffer_size;
+        pcm_mmap_begin(pcm, &area, &offset, &frames);
 
-        switch (chunk_header.id) {
-        case ID_FMT:
-            fread(&chunk_fmt, sizeof(chunk_fmt), 1, file);
-            /* If the format header is larger, skip the rest */
-            if (chunk_header.sz > sizeof(chunk_fmt))
-                fseek(file, chunk_header.sz - sizeof(chunk_fmt), SEEK_CUR);
-            break;
-        case ID_DATA:
-            /* Stop looking for chunks */
-            more_chunks = 0;
+        if (!frames) {
+            /* the ring is full: make sure it drains, then wait for room */
+            if (!started) {
+                if (pcm_start(pcm)) {
+                    fprintf(stderr, "Unable to start PCM (%s)\n",
+                            pcm_get_error(pcm));
+                    return -1;
+                }
+                started = 1;
+            }
+            err = play_wait(pcm, sched, period_size, wait_ms);
+            if (err == 0) {
+                fprintf(stderr, "Timeout waiting for PCM\n");
+                return -1;
+            } else if (err == -EPIPE) {
+                /* underrun: start over with an empty ring */
+                fprintf(stderr, "Underrun\n");
+                if (sched) {
+                    noirq_scheduler_recover(sched);
+                } else {
+                    pcm_stop(pcm);
+                    pcm_prepare(pcm);
+                }
+                started = 0;
+                queued = 0;
+            } else if (err < 0) {
+                fprintf(stderr, "Error waiting for PCM (%s)\n", strerror(-err));
+                return -1;
+            }
+            continue;
+        }
+
+        frames = play_source_read(src,
+                                  (char*)area + pcm_frames_to_bytes(pcm, offset),
+                                  frames);
+        if (!frames)
             break;
-        default:
-            /* Unknown chunk, skip bytes */
-            fseek(file, chunk_header.sz, SEEK_CUR);
+
+        pcm_mmap_commit(pcm, offset, frames);
+        if (sched)
+            noirq_scheduler_commit(sched, frames);
+        throughput_add(tp, pcm_frames_to_bytes(pcm, frames));
+        telemetry_sample(tm);
+        queued += frames;
+
+        if (!started && (queued >= start_threshold)) {
+            if (pcm_start(pcm)) {
+                fprintf(stderr, "Unable to start PCM (%s)\n", pcm_get_error(pcm));
+                return -1;
+            }
+            started = 1;
         }
-    } while (more_chunks);
+    }
 
-    play_sample(file, card, device, chunk_fmt.num_channels, chunk_fmt.sample_rate,
-                chunk_fmt.bits_per_sample, period_size, period_count, duration);
+    /* short files may never reach the start threshold */
+    if (!started && queued) {
+        if (pcm_start(pcm))
+            return -1;
+        started = 1;
+    }
 
-    fclose(file);
+    /* pcm_close() drops whatever is left in the ring, so let it play out */
+    while (started && (pcm_avail_update(pcm) < (int)buffer_size)) {
+        if (play_wait(pcm, sched, buffer_size, wait_ms) <= 0)
+            break;
+    }
 
     return 0;
 }
 
+struct play_reader {
+    struct play_source *src;
+    const struct rt_profile *rt;
+    unsigned int period_size;
+    struct period_ring ring;
+    int stop;               /* set by the audio thread to give up early */
+};
+
+/* Keeps the ring topped up, so that the audio thread never has to wait
+ * for the filesystem: page faults on the mapped file, and any format
+ * conversion, are taken here.
+ */
+static void *play_reader_thread(void *arg)
+{
+    struct play_reader *reader = arg;
+    unsigned int frame_bytes = reader->ring.period_bytes / reader->period_size;
+    unsigned int frames;
+    char *slot;
+
+    rt_profile_leave(reader->rt);
+
+    while (!play_source_done(reader->src) &&
+           !__atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+        slot = period_ring_write_begin(&reader->ring, 1);
+        if (!slot)
+            break;
+
+        frames = play_source_read(reader->src, slot, reader->period_size);
+        if (!frames)
+            break;
+
+        period_ring_write_commit(&reader->ring, frames * frame_bytes);
+    }
+
+    period_ring_write_eof(&reader->ring);
+    return NULL;
+}
+
+static int play_sample_ring(struct pcm *pcm, struct play_source *src,
+                            struct play_sample_params *params,
+                            struct noirq_scheduler *sched,
+                            struct telemetry *tm, struct throughput *tp)
+{
+    struct play_reader reader;
+    pthread_t thread;
+    unsigned int count, frames;
+    char *slot;
+    int ret = 0;
+
+    reader.src = src;
+    reader.rt = &params->rt;
+    reader.stop = 0;
+    reader.period_size = params->period_size;
+    ret = period_ring_init(&reader.ring, params->ring_periods,
+                           pcm_frames_to_bytes(pcm, params->period_size));
+    if (ret) {
+        fprintf(stderr, "Unable to allocate ring (%s)\n", strerror(ret));
+        return -1;
+    }
+    rt_profile_prefault(&params->rt, reader.ring.data,
+                        reader.ring.periods * reader.ring.period_bytes);
+
+    ret = pthread_create(&thread, NULL, play_reader_thread, &reader);
+    if (ret) {
+        fprintf(stderr, "Unable to start reader thread (%s)\n", strerror(ret));
+        period_ring_deinit(&reader.ring);
+        return -1;
+    }
+
+    while ((slot = period_ring_read_begin(&reader.ring, &count, 1))) {
+        frames = pcm_bytes_to_frames(pcm, count);
+        if (sched) {
+            ret = noirq_scheduler_wait(sched, frames, -1);
+            if (ret == -EPIPE) {
+                fprintf(stderr, "Underrun\n");
+                ret = noirq_scheduler_recover(sched);
+            } else if (ret > 0) {
+                ret = 0;
+            }
+        }
+        if (!ret && params->mmap)
+            ret = pcm_mmap_write(pcm, slot, count);
+        else if (!ret)
+            ret = pcm_write(pcm, slot, count);
+        if (!ret && sched)
+            noirq_scheduler_commit(sched, frames);
+        period_ring_read_commit(&reader.ring);
+        if (ret)
+            break;
+        throughput_add(tp, count);
+        telemetry_sample(tm);
+    }
+
+    if (ret) {
+        /* stop the reader, and free slots until it has seen that, rather
+         * than have it read the rest of the playlist */
+        __atomic_store_n(&reader.stop, 1, __ATOMIC_RELEASE);
+        while (period_ring_read_begin(&reader.ring, &count, 1))
+            period_ring_read_commit(&reader.ring);
+    }
+
+    pthread_join(thread, NULL);
+
+    printf("ring: %u periods, high water %u, low water %u, ran dry %u times, "
+           "%d underruns\n", reader.ring.periods, reader.ring.high_water,
+           reader.ring.low_water, reader.ring.dry, pcm_get_underruns(pcm));
+
+    period_ring_deinit(&reader.ring);
+    return ret;
+}
+
 static
-void play_sample(FILE *file, unsigned int card, unsigned int device, unsigned int channels,
-                 unsigned int rate, unsigned int bits, unsigned int period_size,
-                 unsigned int period_count, unsigned int duration)
+void play_sample(struct play_source *src, struct play_sample_params *params)
 {
     struct pcm_config config;
     struct pcm *pcm;
+    struct throughput tp;
+    struct noirq_scheduler noirq, *sched = NULL;
+    struct telemetry tm;
+    const void *data;
     char *buffer;
-    int size;
-    int num_read;
-    unsigned long requested;
-    unsigned long written = 0;
-
-    config.channels = channels;
-    config.rate = rate;
-    config.period_size = period_size;
-    config.period_count = period_count;
-    if (bits == 32)
-        config.format = PCM_FORMAT_S32_LE;
-    else if (bits == 16)
-        config.format = PCM_FORMAT_S16_LE;
+    unsigned int size, frames, flags;
+    int wait_ms;
+
+    memset(&config, 0, sizeof(config));
+    config.channels = params->channels;
+    config.rate = params->rate;
+    config.period_size = params->period_size;
+    config.period_count = params->period_count;
+    sample_format_to_pcm(params->format, &config.format);
     config.start_threshold = 0;
     config.stop_threshold = 0;
     config.silence_threshold = 0;
 
-    pcm = pcm_open(card, device, PCM_OUT, &config);
+    flags = PCM_OUT;
+    if (params->mmap)
+        flags |= PCM_MMAP;
+    if (params->noirq || params->telemetry)
+        flags |= PCM_MONOTONIC;
+    if (params->noirq)
+        flags |= PCM_NOIRQ;
+
+    if (params->low_latency &&
+        caps_fit(params->card, params->device, flags, &config))
+        return;
+
+    pcm = pcm_open(params->card, params->device, flags, &config);
     if (!pcm || !pcm_is_ready(pcm)) {
         fprintf(stderr, "Unable to open PCM device %u (%s)\n",
-                device, pcm_get_error(pcm));
+                params->device, pcm_get_error(pcm));
+        return;
+    }
+    if (xrun_setup(pcm, params->xrun_policy, params->xrun_log)) {
+        pcm_close(pcm);
+        return;
+    }
+    params->period_size = config.period_size;
+    telemetry_init(&tm, pcm, params->rate, params->telemetry * 1000);
+
+    if (params->noirq) {
+        noirq_scheduler_init(&noirq, pcm, params->rate);
+        sched = &noirq;
+    }
+
+    if (rt_profile_enter(&params->rt)) {
+        pcm_close(pcm);
+        return;
+    }
+
+    if (params->io_thread) {
+        throughput_start(&tp);
+        rt_profile_start(&params->rt);
+        if (play_sample_ring(pcm, src, params, sched, &tm, &tp))
+            fprintf(stderr, "Error playing sample\n");
+        throughput_report(&tp, params->noirq ? "noirq, io thread" :
+                          params->mmap ? "mmap, io thread" : "io thread");
+        rt_profile_report(&params->rt, "audio thread");
+        if (sched)
+            noirq_scheduler_report(sched);
+        telemetry_report(&tm);
+        xrun_report(pcm, "playback");
+        pcm_close(pcm);
         return;
     }
 
+    if (params->mmap) {
+        wait_ms = 100 + 1000 * pcm_get_buffer_size(pcm) / params->rate;
+        throughput_start(&tp);
+        rt_profile_start(&params->rt);
+        if (play_sample_mmap(pcm, src, params->period_size, wait_ms, sched,
+                             &tm, &tp))
+            fprintf(stderr, "Error playing sample\n");
+        throughput_report(&tp, params->noirq ? "noirq" : "mmap");
+        rt_profile_report(&params->rt, "audio thread");
+        if (sched)
+            noirq_scheduler_report(sched);
+        telemetry_report(&tm);
+        xrun_report(pcm, "playback");
+        pcm_close(pcm);
+        return;
+    }
+
+    /* files that need no conversion are written straight from the map */
     size = pcm_frames_to_bytes(pcm, pcm_get_buffer_size(pcm));
     buffer = malloc(size);
     if (!buffer) {
-        fprintf(stderr, "Unable to allocate %d bytes\n", size);
-        free(buffer);
+        fprintf(stderr, "Unable to allocate %u bytes\n", size);
         pcm_close(pcm);
         return;
     }
+    rt_profile_prefault(&params->rt, buffer, size);
 
-    if (duration)
-        requested = pcm_frames_to_bytes(pcm, rate * duration);
-    else
-        requested = 0;
-
-    printf("Playing sample: %u ch, %u hz, %u bit\n", channels, rate, bits);
+    throughput_start(&tp);
+    rt_profile_start(&params->rt);
+    while (!play_source_done(src)) {
+        frames = pcm_get_buffer_size(pcm);
+        data = play_source_peek(src, &frames);
+        if (!data) {
+            frames = play_source_read(src, buffer, frames);
+            data = buffer;
+        }
+        if (!frames)
+            break;
 
-    do {
-        num_read = fread(buffer, 1, size, file);
-        if (num_read > 0) {
-            if (pcm_write(pcm, buffer, num_read)) {
-                fprintf(stderr, "Error playing sample\n");
-                break;
-            }
+        size = pcm_frames_to_bytes(pcm, frames);
+        if (pcm_write(pcm, data, size)) {
+            fprintf(stderr, "Error playing sample\n");
+            break;
         }
-        written += num_read;
-    } while ((num_read > 0) && (!requested || (written < requested)));
+        if (data != buffer)
+            play_source_skip(src, frames);
+        throughput_add(&tp, size);
+        telemetry_sample(&tm);
+    }
+    throughput_report(&tp, "read/write");
+    rt_profile_report(&params->rt, "audio thread");
+    printf("%d underruns\n", pcm_get_underruns(pcm));
+    telemetry_report(&tm);
+    xrun_report(pcm, "playback");
 
     free(buffer);
     pcm_close(pcm);
 }
-
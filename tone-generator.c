@@ -37,11 +37,17 @@
 #include <math.h>
 #include <stdint.h>
 #include <limits.h>
+#include <errno.h>
 #include <tinyalsa/asoundlib.h>
 #include "oscillator-table.h"
 
 #include "config.h"
 #include "tone-generator.h"
+#include "noirq-scheduler.h"
+#include "rt-profile.h"
+#include "telemetry.h"
+#include "xrun.h"
+#include "caps.h"
 
 /* LOAD ALL THE WAVE TABLES
  *
@@ -71,11 +77,32 @@ static int16_t g_table_sawtooth_wave_data[] = {
 #include "table_sawtooth.c"
 };
 
+/* The same waves at 32 bits, for 24- and 32-bit output */
+static int32_t g_table_square_wave_data32[] = {
+#include "table_square_s32.c"
+};
+
+static int32_t g_table_sine_wave_data32[] = {
+#include "table_sine_s32.c"
+};
+
+static int32_t g_table_triangle_wave_data32[] = {
+#include "table_triangle_s32.c"
+};
+
+static int32_t g_table_sawtooth_wave_data32[] = {
+#include "table_sawtooth_s32.c"
+};
+
 static struct wave_table g_wave_tables[] = {
-	DECLARE_TABLE("square", g_table_square_wave_data),
-	DECLARE_TABLE("sine", g_table_sine_wave_data),
-	DECLARE_TABLE("triangle", g_table_triangle_wave_data),
-	DECLARE_TABLE("sawtooth", g_table_sawtooth_wave_data),
+	DECLARE_TABLE_S32("square", g_table_square_wave_data,
+			  g_table_square_wave_data32),
+	DECLARE_TABLE_S32("sine", g_table_sine_wave_data,
+			  g_table_sine_wave_data32),
+	DECLARE_TABLE_S32("triangle", g_table_triangle_wave_data,
+			  g_table_triangle_wave_data32),
+	DECLARE_TABLE_S32("sawtooth", g_table_sawtooth_wave_data,
+			  g_table_sawtooth_wave_data32),
 	{ 0 }
 };
 
@@ -85,10 +112,23 @@ static int check_wave_tables()
 	assert( STATIC_ARRAY_SIZE(g_table_sine_wave_data) <= 0xFFFF );
 	assert( STATIC_ARRAY_SIZE(g_table_triangle_wave_data) <= 0xFFFF );
 	assert( STATIC_ARRAY_SIZE(g_table_sawtooth_wave_data) <= 0xFFFF );
+	assert( STATIC_ARRAY_SIZE(g_table_square_wave_data32) ==
+		STATIC_ARRAY_SIZE(g_table_square_wave_data) );
+	assert( STATIC_ARRAY_SIZE(g_table_sine_wave_data32) ==
+		STATIC_ARRAY_SIZE(g_table_sine_wave_data) );
+	assert( STATIC_ARRAY_SIZE(g_table_triangle_wave_data32) ==
+		STATIC_ARRAY_SIZE(g_table_triangle_wave_data) );
+	assert( STATIC_ARRAY_SIZE(g_table_sawtooth_wave_data32) ==
+		STATIC_ARRAY_SIZE(g_table_sawtooth_wave_data) );
 
 	return 0;
 }
 
+const struct wave_table *tone_wave_tables(void)
+{
+	return g_wave_tables;
+}
+
 struct tone_generator_config {
 	int card;
 	int device;
@@ -99,16 +139,26 @@ struct tone_generator_config {
 	int16_t volume; /* binary fraction / USHRT_MAX */
 	uint32_t chan_mask;
 	int bits;
+	int noirq;
+	unsigned int telemetry;
+	unsigned int pcm_flags;
+	int xrun_policy;
+	unsigned int xrun_log;
+	struct rt_profile rt;
 };
 
 static int inner_main(struct tone_generator_config config)
 {
 	struct pcm_config *pcm_config = &config.pcm_config;
+	struct oscillator osc;
+	struct noirq_scheduler sched;
+	struct telemetry tm;
 	struct pcm *pcm;
 	unsigned pos;
 	void *buf;
+	int ret;
 
-	pcm = pcm_open(config.card, config.device, PCM_OUT, pcm_config);
+	pcm = pcm_open(config.card, config.device, config.pcm_flags, pcm_config);
 	if (!pcm) {
 		fprintf(stderr, "Could not open sound card\n");
 		fprintf(stderr, "%s\n", pcm_get_error(pcm));
@@ -119,6 +169,10 @@ static int inner_main(struct tone_generator_config config)
 		fprintf(stderr, "%s\n", pcm_get_error(pcm));
 		return 1;
 	}
+	if (xrun_setup(pcm, config.xrun_policy, config.xrun_log)) {
+		pcm_close(pcm);
+		return 1;
+	}
 
 	buf = calloc(config.bits / 8,
 			pcm_config->period_size * pcm_config->channels);
@@ -127,30 +181,125 @@ static int inner_main(struct tone_generator_config config)
 		return 1;
 	}
 
-	for (pos=0 ; (!config.duration || (pos < config.duration)) ; pos += pcm_config->period_size) {
-		oscillator_table_render(buf,
-			config.wave_table,
-			pos,
-			pcm_config->period_size,
-			config.wave_scale,
-			pcm_config->channels,
-			config.chan_mask, /* write to all channels */
-			config.volume,
+	if (rt_profile_enter(&config.rt)) {
+		free(buf);
+		pcm_close(pcm);
+		return 1;
+	}
+	rt_profile_prefault(&config.rt, buf, pcm_frames_to_bytes(pcm,
+				pcm_config->period_size));
+	telemetry_init(&tm, pcm, pcm_config->rate, config.telemetry * 1000);
+	rt_profile_start(&config.rt);
+
+	if (config.noirq) {
+		noirq_scheduler_init(&sched, pcm, pcm_config->rate);
+		pcm_prepare(pcm);
+	}
+
+	oscillator_init(&osc, config.wave_table, config.wave_scale,
+			config.volume, pcm_config->channels, config.chan_mask,
 			config.bits);
-		if (pcm_write(pcm,
-			      buf,
-			      pcm_config->channels * pcm_config->period_size * (config.bits/8))) {
+
+	for (pos=0 ; (!config.duration || (pos < config.duration)) ; pos += pcm_config->period_size) {
+		oscillator_render(&osc, buf, pcm_config->period_size);
+		if (config.noirq) {
+			/* sleep until the period fits, rather than on an interrupt */
+			ret = noirq_scheduler_wait(&sched, pcm_config->period_size, -1);
+			if (ret == -EPIPE) {
+				fprintf(stderr, "Underrun\n");
+				ret = noirq_scheduler_recover(&sched);
+			}
+			if (ret < 0) {
+				fprintf(stderr, "Error waiting for sound card (%s)\n",
+					strerror(-ret));
+				break;
+			}
+			ret = pcm_mmap_write(pcm, buf, pcm_frames_to_bytes(pcm,
+						pcm_config->period_size));
+			if (!ret)
+				noirq_scheduler_commit(&sched, pcm_config->period_size);
+		} else {
+			ret = pcm_write(pcm,
+					buf,
+					pcm_config->channels * pcm_config->period_size * (config.bits/8));
+		}
+		if (ret) {
 			fprintf(stderr, "Error writing to sound card\n");
 			fprintf(stderr, "%s\n", pcm_get_error(pcm));
 			break;
 		}
+		telemetry_sample(&tm);
 	}
 
+	rt_profile_report(&config.rt, "audio thread");
+	telemetry_report(&tm);
+	if (config.noirq)
+		noirq_scheduler_report(&sched);
+	xrun_report(pcm, "playback");
 	pcm_close(pcm);
 
 	return 0;
 }
 
+int tone_init(struct tone *tone, const char *wave, const char *freq,
+	      const char *vol_db, unsigned int rate)
+{
+	struct wave_table *ptr;
+	double frequency;
+	double tmp;
+
+	for (ptr = g_wave_tables ; ptr->name ; ++ptr) {
+		if (strcmp(wave, ptr->name) == 0) {
+			tone->table = ptr;
+			assert( IS_POWER_OF_TWO(ptr->length) );
+			assert( ptr->mask == ptr->length - 1 );
+			break;
+		}
+	}
+	if (ptr->name == 0) {
+		fprintf(stderr, "Invalied wave_type parameter\n");
+		return -1;
+	}
+
+	tmp = atof(freq);
+	if (tmp < 10.0) {
+		fprintf(stderr, "Error: frequency must be > 10Hz\n");
+		return -1;
+	}
+	frequency = tmp;
+
+	tmp = atof(vol_db);
+	if (tmp < 0 ) {
+		fprintf(stderr, "Volume attenuation must be greater than 0 dB FS\n");
+		return -1;
+	}
+	/* Convert db to fraction */
+	tmp = -tmp;
+	tmp = pow(10.0, tmp/10.0);
+	tone->volume = (unsigned short) (tmp * ((double)USHRT_MAX));
+
+	tmp = ((double)rate) / frequency;
+	tone->scale.length = tmp;
+	tmp = (tmp - tone->scale.length) * 0xFFF;
+	tone->scale.sub = tmp;
+	tone->scale.sub_den = 0xFFF;
+	tone->scale.sub_shift = 12;
+
+	/* This restriction prevents overflows in render()
+	 */
+	{
+		uint16_t bits = 0;
+		while ((1<<bits) < tone->table->length) ++bits;
+		if (tone->scale.sub_shift + bits > 24) {
+			fprintf(stderr, "bits(wave_scale) + bits(table.length) "
+				" must be less than or equal to 24\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 static void usage()
 {
 	struct wave_table *ptr;
@@ -173,11 +322,8 @@ int tone_generator_main(const struct audio_tool_config *at_config, int argc, cha
 		.chan_mask = ~0,
 	};
 	struct pcm_config pcm_config;
-	struct wave_table *ptr, *table;
-	struct wave_scale wave_scale;
-	double freq;
+	struct tone tone;
 	char *arg_wave_type, *arg_freq, *arg_voldb;
-	double tmp;
 
 	if ((argc < 3) || (argc > 4)) {
 		usage();
@@ -199,7 +345,7 @@ int tone_generator_main(const struct audio_tool_config *at_config, int argc, cha
 	switch (at_config->bits) {
 	case 8: pcm_config.format = PCM_FORMAT_S8; break;
 	case 16: pcm_config.format = PCM_FORMAT_S16_LE; break;
-	case 24: pcm_config.format = PCM_FORMAT_S24_LE; break;
+	case 24: pcm_config.format = PCM_FORMAT_S24_3LE; break;
 	case 32: pcm_config.format = PCM_FORMAT_S32_LE; break;
 	default:
 		assert(0);
@@ -214,59 +360,30 @@ int tone_generator_main(const struct audio_tool_config *at_config, int argc, cha
 	config.chan_mask = at_config->channel_mask;
 	config.duration = at_config->duration * pcm_config.rate;
 	config.bits = at_config->bits;
-
-	for (ptr = g_wave_tables ; ptr->name ; ++ptr) {
-		if (strcmp(arg_wave_type, ptr->name) == 0) {
-			table = ptr;
-			assert( IS_POWER_OF_TWO(table->length) );
-			assert( table->mask == table->length - 1 );
-			break;
-		}
-	}
-	if (ptr->name == 0) {
-		fprintf(stderr, "Invalied wave_type parameter\n");
+	config.noirq = at_config->noirq;
+	config.telemetry = at_config->telemetry;
+	config.xrun_policy = at_config->xrun_policy;
+	config.xrun_log = at_config->xrun_log;
+	rt_profile_init(&config.rt, at_config->rt_priority, at_config->cpu,
+			at_config->mlock);
+
+	config.pcm_flags = PCM_OUT;
+	if (config.noirq)
+		config.pcm_flags |= PCM_MMAP | PCM_NOIRQ | PCM_MONOTONIC;
+	if (config.telemetry)
+		config.pcm_flags |= PCM_MONOTONIC;
+
+	if (at_config->low_latency &&
+	    caps_fit(config.card, config.device, config.pcm_flags, &pcm_config))
 		return 1;
-	}
 
-	tmp = atof(arg_freq);
-	if (tmp < 10.0) {
-		fprintf(stderr, "Error: frequency must be > 10Hz\n");
+	if (tone_init(&tone, arg_wave_type, arg_freq, arg_voldb, pcm_config.rate))
 		return 1;
-	}
-	freq = tmp;
-
-	tmp = atof(arg_voldb);
-	if (tmp < 0 ) {
-		fprintf(stderr, "Volume attenuation must be greater than 0 dB FS\n");
-		return 1;
-	}
-	/* Convert db to fraction */
-	tmp = -tmp;
-	tmp = pow(10.0, tmp/10.0);
-	config.volume = (unsigned short) (tmp * ((double)USHRT_MAX));
-
-	tmp = ((double)pcm_config.rate) / freq;
-	wave_scale.length = tmp;
-	tmp = (tmp - wave_scale.length) * 0xFFF;
-	wave_scale.sub = tmp;
-	wave_scale.sub_den = 0xFFF;
-	wave_scale.sub_shift = 12;
-
-	/* This restriction prevents overflows in render()
-	 */
-	{
-		uint16_t bits = 0;
-		while ((1<<bits) < table->length) ++bits;
-		if (wave_scale.sub_shift + bits > 24) {
-			fprintf(stderr, "bits(wave_scale) + bits(table.length) "
-				" must be less than or equal to 24\n");
-			return 1;
-		}
-	}
+	config.volume = tone.volume;
 
 	memcpy(&config.pcm_config, &pcm_config, sizeof(pcm_config));
-	memcpy(&config.wave_scale, &wave_scale, sizeof(wave_scale));
-	config.wave_table = table;
+	memcpy(&config.wave_scale, &tone.scale, sizeof(tone.scale));
+	config.wave_table = tone.table;
 
 	return inner_main(config);
 
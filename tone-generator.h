@@ -26,6 +26,29 @@
 #ifndef __AUDIO_TOOL_TONE_GENERATOR_H__
 #define __AUDIO_TOOL_TONE_GENERATOR_H__
 
+#include <stdint.h>
+
+#include "oscillator-table.h"
+
+struct audio_tool_config;
+
+/* A tone, ready for oscillator_init() */
+struct tone {
+	struct wave_table *table;
+	struct wave_scale scale;
+	uint16_t volume; /* binary fraction / USHRT_MAX */
+};
+
+/* Sets up a tone from its wave type, frequency (Hz) and attenuation
+ * (dB FS, >= 0) at the given sample rate.  Prints why and returns -1 if
+ * they aren't valid.
+ */
+int tone_init(struct tone *tone, const char *wave, const char *freq,
+	      const char *vol_db, unsigned int rate);
+
+/* Returns the wave tables tone knows, ending with one whose name is NULL */
+const struct wave_table *tone_wave_tables(void);
+
 int tone_generator_main(const struct audio_tool_config *config, int argc, char **argv);
 
 #endif /* __AUDIO_TOOL_TONE_GENERATOR_H__ */
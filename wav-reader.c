@@ -0,0 +1,310 @@
+/*
+ * wav-reader.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "wav-reader.h"
+
+#define ID_RIFF 0x46464952
+#define ID_RF64 0x34364652
+#define ID_BW64 0x34365742
+#define ID_WAVE 0x45564157
+#define ID_DS64 0x34367364
+#define ID_FMT  0x20746d66
+#define ID_DATA 0x61746164
+
+/* Tail of the KSDATAFORMAT_SUBTYPE_* GUIDs; the first two bytes are the
+ * format tag.
+ */
+static const uint8_t subformat_guid_tail[14] = {
+	0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+	0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71,
+};
+
+static uint16_t get16(const char *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t get32(const char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t get64(const char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static int wav_reader_fail(struct wav_reader *r, const char *error)
+{
+	r->error = error;
+	return EINVAL;
+}
+
+static int wav_reader_add_chunk(struct wav_reader *r, uint32_t id,
+				uint64_t offset, uint64_t size)
+{
+	struct wav_chunk *chunks;
+
+	/* grow in powers of two */
+	if (!(r->num_chunks & (r->num_chunks - 1))) {
+		chunks = realloc(r->chunks, (r->num_chunks ? 2 * r->num_chunks : 1)
+				 * sizeof(*chunks));
+		if (!chunks)
+			return ENOMEM;
+		r->chunks = chunks;
+	}
+
+	r->chunks[r->num_chunks].id = id;
+	r->chunks[r->num_chunks].offset = offset;
+	r->chunks[r->num_chunks].size = size;
+	r->num_chunks++;
+	return 0;
+}
+
+static int wav_reader_parse_fmt(struct wav_reader *r,
+				const struct wav_chunk *chunk)
+{
+	const char *fmt = r->map + chunk->offset;
+
+	if (chunk->size < 16)
+		return wav_reader_fail(r, "fmt chunk is too short");
+
+	r->format = get16(fmt);
+	r->channels = get16(fmt + 2);
+	r->rate = get32(fmt + 4);
+	r->block_align = get16(fmt + 12);
+	r->bits = get16(fmt + 14);
+	r->valid_bits = r->bits;
+	r->channel_mask = 0;
+
+	if (r->format == WAV_FORMAT_EXTENSIBLE) {
+		if (chunk->size < 40 || get16(fmt + 16) < 22)
+			return wav_reader_fail(r, "extensible fmt chunk is too short");
+		if (memcmp(fmt + 26, subformat_guid_tail,
+			   sizeof(subformat_guid_tail)))
+			return wav_reader_fail(r, "unknown sub-format GUID");
+		r->valid_bits = get16(fmt + 18);
+		r->channel_mask = get32(fmt + 20);
+		r->format = get16(fmt + 24);
+	}
+
+	if ((r->format != WAV_FORMAT_PCM) && (r->format != WAV_FORMAT_IEEE_FLOAT))
+		return wav_reader_fail(r, "not PCM or IEEE float data");
+	if (!r->channels || !r->rate)
+		return wav_reader_fail(r, "no channels or no sample rate");
+	if (!r->bits || (r->bits % 8) || (r->bits > 64))
+		return wav_reader_fail(r, "unsupported sample size");
+	if (!r->valid_bits || (r->valid_bits > r->bits))
+		return wav_reader_fail(r, "bad number of valid bits");
+	if (r->block_align != r->channels * (r->bits / 8))
+		return wav_reader_fail(r, "block alignment doesn't match format");
+
+	return 0;
+}
+
+/* Walks every chunk after the RIFF header */
+static int wav_reader_parse(struct wav_reader *r)
+{
+	const struct wav_chunk *fmt, *data;
+	uint64_t ds64_data_size = 0;
+	uint64_t offset, end, size;
+	uint32_t riff_id, id;
+	int ret;
+
+	if (r->map_size < 12)
+		return wav_reader_fail(r, "file is too short");
+
+	riff_id = get32(r->map);
+	if (((riff_id != ID_RIFF) && (riff_id != ID_RF64) && (riff_id != ID_BW64))
+	    || (get32(r->map + 8) != ID_WAVE))
+		return wav_reader_fail(r, "not a riff/wave file");
+
+	/* the RIFF size may be bogus (e.g. a capture that was killed), the
+	 * file size is what counts
+	 */
+	end = r->map_size;
+	for (offset = 12; offset + 8 <= end; ) {
+		id = get32(r->map + offset);
+		size = get32(r->map + offset + 4);
+		offset += 8;
+
+		if ((id == ID_DATA) && (size == UINT32_MAX) && ds64_data_size)
+			size = ds64_data_size;
+
+		/* offset <= end here, so this can't wrap even when the size
+		 * is a 64-bit one from ds64 */
+		if (size > end - offset) {
+			if (id != ID_DATA)
+				return wav_reader_fail(r, "chunk runs past end of file");
+			/* truncated capture: play what is there */
+			size = end - offset;
+		}
+
+		if ((id == ID_DS64) && (riff_id != ID_RIFF) && (size >= 24))
+			ds64_data_size = get64(r->map + offset + 8);
+
+		ret = wav_reader_add_chunk(r, id, offset, size);
+		if (ret)
+			return ret;
+
+		/* chunks are word aligned.  size <= end - offset, so the
+		 * padded size only overruns on a last chunk with no pad byte,
+		 * and there's nothing after it to walk */
+		if (size + (size & 1) > end - offset)
+			break;
+		offset += size + (size & 1);
+	}
+
+	fmt = wav_reader_find_chunk(r, ID_FMT);
+	data = wav_reader_find_chunk(r, ID_DATA);
+	if (!fmt)
+		return wav_reader_fail(r, "no fmt chunk");
+	if (!data)
+		return wav_reader_fail(r, "no data chunk");
+
+	ret = wav_reader_parse_fmt(r, fmt);
+	if (ret)
+		return ret;
+
+	r->data = r->map + data->offset;
+	r->data_bytes = data->size - (data->size % r->block_align);
+	return 0;
+}
+
+int wav_reader_open(struct wav_reader *r, const char *path)
+{
+	struct stat st;
+	void *map;
+	int ret;
+
+	memset(r, 0, sizeof(*r));
+
+	r->fd = open(path, O_RDONLY);
+	if (r->fd < 0)
+		return errno;
+
+	if (fstat(r->fd, &st)) {
+		ret = errno;
+		goto fail;
+	}
+
+	if ((uint64_t)st.st_size > SIZE_MAX) {
+		ret = EFBIG;
+		goto fail;
+	}
+
+	r->map_size = st.st_size;
+	if (r->map_size) {
+		map = mmap(NULL, r->map_size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+		if (map == MAP_FAILED) {
+			ret = errno;
+			goto fail;
+		}
+		madvise(map, r->map_size, MADV_SEQUENTIAL);
+		r->map = map;
+	}
+
+	ret = wav_reader_parse(r);
+	if (ret)
+		goto fail;
+
+	return 0;
+
+fail:
+	wav_reader_close(r);
+	return ret;
+}
+
+const struct wav_chunk *wav_reader_find_chunk(const struct wav_reader *r,
+					      uint32_t id)
+{
+	unsigned int i;
+
+	for (i = 0; i < r->num_chunks; i++)
+		if (r->chunks[i].id == id)
+			return &r->chunks[i];
+
+	return NULL;
+}
+
+void wav_reader_prefetch(const struct wav_reader *r, size_t bytes)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	uintptr_t start, end;
+
+	if (!r->map || !r->data_bytes)
+		return;
+
+	if (bytes > r->data_bytes)
+		bytes = r->data_bytes;
+
+	start = (uintptr_t)r->data & ~(uintptr_t)(page - 1);
+	end = (uintptr_t)r->data + bytes;
+	madvise((void *)start, end - start, MADV_WILLNEED);
+}
+
+void wav_reader_close(struct wav_reader *r)
+{
+	if (r->map)
+		munmap((void *)r->map, r->map_size);
+	if (r->fd >= 0)
+		close(r->fd);
+	free(r->chunks);
+
+	r->map = NULL;
+	r->fd = -1;
+	r->chunks = NULL;
+	r->num_chunks = 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * wav-reader.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_WAV_READER_H__
+#define __AUDIO_TOOL_WAV_READER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WAV_FORMAT_PCM		0x0001
+#define WAV_FORMAT_IEEE_FLOAT	0x0003
+#define WAV_FORMAT_EXTENSIBLE	0xfffe
+
+/* A chunk in a RIFF file.  offset is where the chunk's payload starts in
+ * the file, size is the payload size (without the pad byte of odd-sized
+ * chunks).
+ */
+struct wav_chunk {
+	uint32_t id;
+	uint64_t offset;
+	uint64_t size;
+};
+
+/* Reads RIFF/WAVE and RF64/BW64 files.
+ *
+ * The whole file is mapped with mmap() and every chunk is indexed in a
+ * single pass when the file is opened.  The audio data is not copied:
+ * 'data' points into the mapping, so readers stream straight from the
+ * page cache.
+ *
+ * For WAVE_FORMAT_EXTENSIBLE files, 'format' is the sub-format (PCM or
+ * IEEE float) and 'channel_mask' is the speaker mask from the file.
+ */
+struct wav_reader {
+	int fd;
+	const char *map;
+	size_t map_size;
+
+	struct wav_chunk *chunks;
+	unsigned int num_chunks;
+
+	unsigned int format;
+	unsigned int channels;
+	unsigned int rate;
+	unsigned int bits;		/* container size of a sample */
+	unsigned int valid_bits;	/* significant bits in the container */
+	unsigned int block_align;	/* bytes per frame */
+	uint32_t channel_mask;
+
+	const void *data;
+	uint64_t data_bytes;		/* always a whole number of frames */
+
+	const char *error;		/* why the file was rejected */
+};
+
+/* Maps the file and parses its chunks.  Returns 0 on success, errno on
+ * failure.  If the file isn't a valid WAVE file, EINVAL is returned and
+ * r->error says why.
+ */
+int wav_reader_open(struct wav_reader *r, const char *path);
+
+/* Returns the first chunk with the given id, or NULL */
+const struct wav_chunk *wav_reader_find_chunk(const struct wav_reader *r,
+					      uint32_t id);
+
+/* Starts reading the first bytes of sample data into memory, so that
+ * they can be played without waiting on the disk.
+ */
+void wav_reader_prefetch(const struct wav_reader *r, size_t bytes);
+
+void wav_reader_close(struct wav_reader *r);
+
+#endif /* __AUDIO_TOOL_WAV_READER_H__ */
@@ -0,0 +1,397 @@
+/*
+ * wav-writer.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define _GNU_SOURCE /* for fallocate() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "wav-reader.h"
+#include "wav-writer.h"
+
+#define ID_RIFF 0x46464952
+#define ID_RF64 0x34364652
+#define ID_WAVE 0x45564157
+#define ID_JUNK 0x4b4e554a
+#define ID_DS64 0x34367364
+#define ID_FMT  0x20746d66
+#define ID_DATA 0x61746164
+
+/* Size of the mmap() window.  Must be a multiple of the page size. */
+#define WINDOW_SIZE (4 << 20)
+
+/* RIFF header, fmt chunk and data chunk header */
+#define HEADER_SIZE 44
+/* 'ds64' chunk: RIFF size, data size, sample count, table length */
+#define DS64_SIZE (8 + 28)
+#define HEADER_MAX (HEADER_SIZE + DS64_SIZE)
+
+static char *put16(char *p, uint16_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static char *put32(char *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static char *put64(char *p, uint64_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+/* Builds the header for the current file in buf (HEADER_MAX bytes) */
+static void wav_writer_fill_header(struct wav_writer *w, char *buf)
+{
+	const struct wav_writer_params *params = &w->params;
+	unsigned int block_align = params->channels * (params->bits / 8);
+	uint64_t riff_sz = w->header_size - 8 + w->data_bytes;
+	int rf64 = w->reserve_ds64 && (riff_sz > UINT32_MAX);
+	char *p = buf;
+
+	p = put32(p, rf64 ? ID_RF64 : ID_RIFF);
+	p = put32(p, (riff_sz > UINT32_MAX) ? UINT32_MAX : riff_sz);
+	p = put32(p, ID_WAVE);
+
+	if (w->reserve_ds64) {
+		memset(p, 0, DS64_SIZE);
+		put32(p, rf64 ? ID_DS64 : ID_JUNK);
+		put32(p + 4, DS64_SIZE - 8);
+		if (rf64) {
+			put64(p + 8, riff_sz);
+			put64(p + 16, w->data_bytes);
+			put64(p + 24, w->data_bytes / block_align);
+		}
+		p += DS64_SIZE;
+	}
+
+	p = put32(p, ID_FMT);
+	p = put32(p, 16);
+	p = put16(p, params->format);
+	p = put16(p, params->channels);
+	p = put32(p, params->rate);
+	p = put32(p, block_align * params->rate);
+	p = put16(p, block_align);
+	p = put16(p, params->bits);
+
+	p = put32(p, ID_DATA);
+	p = put32(p, (w->data_bytes > UINT32_MAX) ? UINT32_MAX : w->data_bytes);
+}
+
+/* Reserves room for the header plus bytes of audio.  Falls back to a
+ * sparse file if the filesystem can't preallocate.
+ */
+static int wav_writer_reserve(struct wav_writer *w, uint64_t bytes)
+{
+	off_t size = w->header_size + bytes;
+
+	if (fallocate(w->fd, 0, 0, size)) {
+		if ((errno != EOPNOTSUPP) && (errno != ENOSYS))
+			return errno;
+		if (ftruncate(w->fd, size))
+			return errno;
+	}
+
+	w->capacity = bytes;
+	return 0;
+}
+
+static void wav_writer_unmap(struct wav_writer *w)
+{
+	if (w->window)
+		munmap(w->window, w->window_size);
+	w->window = NULL;
+}
+
+/* Maps the window that holds the given file offset */
+static int wav_writer_map(struct wav_writer *w, uint64_t offset)
+{
+	void *window;
+
+	wav_writer_unmap(w);
+
+	w->window_offset = offset - (offset % WINDOW_SIZE);
+	w->window_size = WINDOW_SIZE;
+	window = mmap(NULL, w->window_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      w->fd, w->window_offset);
+	if (window == MAP_FAILED)
+		return errno;
+
+	madvise(window, w->window_size, MADV_SEQUENTIAL);
+	w->window = window;
+	return 0;
+}
+
+/* Returns the name of the current file.  The caller frees it. */
+static char *wav_writer_file_name(struct wav_writer *w)
+{
+	const char *ext, *slash;
+	char *name;
+	int len;
+
+	if (!w->params.rotate_bytes)
+		return strdup(w->path);
+
+	ext = strrchr(w->path, '.');
+	slash = strrchr(w->path, '/');
+	if (!ext || (slash && slash > ext))
+		ext = w->path + strlen(w->path);
+
+	len = ext - w->path;
+	if (asprintf(&name, "%.*s-%04u%s", len, w->path, w->index, ext) < 0)
+		return NULL;
+	return name;
+}
+
+static int wav_writer_open_file(struct wav_writer *w)
+{
+	const struct wav_writer_params *params = &w->params;
+	char header[HEADER_MAX];
+	uint64_t expected = 0;
+	char *name;
+	int ret = 0;
+
+	w->data_bytes = 0;
+	w->capacity = 0;
+	w->fd = -1;
+	w->file = NULL;
+
+	if (params->max_bytes)
+		expected = params->max_bytes - w->total_bytes;
+	if (params->rotate_bytes && (!expected || expected > params->rotate_bytes))
+		expected = params->rotate_bytes;
+
+	w->reserve_ds64 = !expected || (HEADER_SIZE - 8 + expected > UINT32_MAX);
+	w->header_size = HEADER_SIZE + (w->reserve_ds64 ? DS64_SIZE : 0);
+
+	name = wav_writer_file_name(w);
+	if (!name)
+		return ENOMEM;
+
+	if (!params->preallocate || !expected) {
+		w->file = fopen(name, "wb");
+		if (!w->file)
+			ret = errno;
+		else
+			/* leave enough room for header */
+			fseek(w->file, w->header_size, SEEK_SET);
+		free(name);
+		return ret;
+	}
+
+	w->fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	free(name);
+	if (w->fd < 0)
+		return errno;
+
+	ret = wav_writer_reserve(w, expected);
+	if (ret)
+		goto fail;
+
+	/* write a header now, so the file is valid even if we never close */
+	wav_writer_fill_header(w, header);
+	if (pwrite(w->fd, header, w->header_size, 0) != w->header_size) {
+		ret = errno;
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	close(w->fd);
+	w->fd = -1;
+	return ret;
+}
+
+static int wav_writer_close_file(struct wav_writer *w)
+{
+	char header[HEADER_MAX];
+	int ret = 0;
+
+	wav_writer_fill_header(w, header);
+
+	if (w->file) {
+		fseek(w->file, 0, SEEK_SET);
+		if (fwrite(header, w->header_size, 1, w->file) != 1)
+			ret = EIO;
+		if (fclose(w->file))
+			ret = errno;
+		w->file = NULL;
+		return ret;
+	}
+
+	if (w->fd < 0)
+		return 0;
+
+	wav_writer_unmap(w);
+
+	if (pwrite(w->fd, header, w->header_size, 0) != w->header_size)
+		ret = errno;
+
+	/* give back what an interrupted capture didn't use */
+	if (w->data_bytes < w->capacity
+	    && ftruncate(w->fd, w->header_size + w->data_bytes))
+		ret = errno;
+
+	if (close(w->fd))
+		ret = errno;
+	w->fd = -1;
+	return ret;
+}
+
+int wav_writer_open(struct wav_writer *w, const char *path,
+		    const struct wav_writer_params *params)
+{
+	unsigned int block_align = params->channels * (params->bits / 8);
+	int ret;
+
+	memset(w, 0, sizeof(*w));
+	w->fd = -1;
+	w->params = *params;
+
+	/* only ever split files on a frame boundary */
+	if (block_align)
+		w->params.rotate_bytes -= w->params.rotate_bytes % block_align;
+
+	w->path = strdup(path);
+	if (!w->path)
+		return ENOMEM;
+
+	ret = wav_writer_open_file(w);
+	if (ret) {
+		free(w->path);
+		w->path = NULL;
+	}
+	return ret;
+}
+
+static int wav_writer_write_file(struct wav_writer *w, const char *src,
+				 size_t bytes)
+{
+	uint64_t offset;
+	size_t count;
+	int ret;
+
+	if (w->file) {
+		if (fwrite(src, 1, bytes, w->file) != bytes)
+			return EIO;
+		w->data_bytes += bytes;
+		return 0;
+	}
+
+	/* a capture that runs long: grow by one more window */
+	if (w->data_bytes + bytes > w->capacity) {
+		ret = wav_writer_reserve(w, w->data_bytes + bytes + WINDOW_SIZE);
+		if (ret)
+			return ret;
+	}
+
+	while (bytes) {
+		offset = w->header_size + w->data_bytes;
+		if (!w->window || (offset >= w->window_offset + w->window_size)) {
+			ret = wav_writer_map(w, offset);
+			if (ret)
+				return ret;
+		}
+
+		count = w->window_offset + w->window_size - offset;
+		if (count > bytes)
+			count = bytes;
+
+		memcpy(w->window + (offset - w->window_offset), src, count);
+		w->data_bytes += count;
+		src += count;
+		bytes -= count;
+	}
+
+	return 0;
+}
+
+int wav_writer_write(struct wav_writer *w, const void *data, size_t bytes)
+{
+	uint64_t rotate = w->params.rotate_bytes;
+	const char *src = data;
+	size_t count;
+	int ret;
+
+	while (bytes) {
+		if (rotate && (w->data_bytes >= rotate)) {
+			ret = wav_writer_close_file(w);
+			if (ret)
+				return ret;
+			w->index++;
+			ret = wav_writer_open_file(w);
+			if (ret)
+				return ret;
+		}
+
+		count = bytes;
+		if (rotate && (count > rotate - w->data_bytes))
+			count = rotate - w->data_bytes;
+
+		ret = wav_writer_write_file(w, src, count);
+		if (ret)
+			return ret;
+
+		w->total_bytes += count;
+		src += count;
+		bytes -= count;
+	}
+
+	return 0;
+}
+
+int wav_writer_close(struct wav_writer *w)
+{
+	int ret;
+
+	ret = wav_writer_close_file(w);
+	free(w->path);
+	w->path = NULL;
+	return ret;
+}
@@ -0,0 +1,107 @@
+/*
+ * wav-writer.h
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __AUDIO_TOOL_WAV_WRITER_H__
+#define __AUDIO_TOOL_WAV_WRITER_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Writes RIFF/WAVE files with a PCM or IEEE float format chunk.
+ *
+ * If the size of the data is known in advance (e.g. for captures with
+ * a duration), the file is preallocated and written through a sliding
+ * mmap() window: data is copied straight into the file's pages, without
+ * stdio buffering.  Otherwise the file is written with stdio.  Either
+ * way, the header is completed when the file is closed.
+ *
+ * Unless the data is known to fit in a plain RIFF file, space for an
+ * RF64 'ds64' chunk is reserved (as a 'JUNK' chunk) after the RIFF
+ * header.  If the file grows past 4 GB it is turned into an RF64/BW64
+ * file when it is closed.
+ *
+ * The writer can also rotate files: after rotate_bytes of audio, the
+ * current file is finished and writing continues, without a gap, in a
+ * new file.  Rotated files are named after the path given to
+ * wav_writer_open(), with a sequence number before the extension
+ * (e.g. cap.wav gives cap-0000.wav, cap-0001.wav, ...).
+ */
+struct wav_writer_params {
+	unsigned int format;	/* WAV_FORMAT_PCM or WAV_FORMAT_IEEE_FLOAT */
+	unsigned int channels;
+	unsigned int rate;
+	unsigned int bits;
+
+	uint64_t max_bytes;	/* total bytes of audio to expect, 0 if unknown */
+	int preallocate;	/* use the mmap backend (needs max_bytes) */
+	uint64_t rotate_bytes;	/* bytes of audio per file, 0 for one file */
+};
+
+struct wav_writer {
+	struct wav_writer_params params;
+	char *path;
+	unsigned int index;	/* sequence number of the current file */
+	uint64_t total_bytes;	/* bytes of audio written to all files */
+
+	/* current file */
+	uint64_t data_bytes;	/* bytes of audio written so far */
+	unsigned int header_size;
+	int reserve_ds64;
+
+	/* stdio backend */
+	FILE *file;
+
+	/* mmap backend */
+	int fd;
+	uint64_t capacity;	/* bytes of audio the file has room for */
+	char *window;		/* mapping of the file */
+	uint64_t window_offset;	/* file offset of the mapping */
+	size_t window_size;
+};
+
+/* Returns 0 on success, errno on failure. */
+int wav_writer_open(struct wav_writer *w, const char *path,
+		    const struct wav_writer_params *params);
+
+/* Returns 0 on success, errno on failure */
+int wav_writer_write(struct wav_writer *w, const void *data, size_t bytes);
+
+/* Finishes the header and closes the file.
+ * Returns 0 on success, errno on failure.
+ */
+int wav_writer_close(struct wav_writer *w);
+
+#endif /* __AUDIO_TOOL_WAV_WRITER_H__ */
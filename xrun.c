@@ -0,0 +1,106 @@
+/*
+ * xrun.c
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com/
+ *
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *    Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *    Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *    Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tinyalsa/asoundlib.h>
+
+#include "xrun.h"
+
+static const char *policy_names[] = {
+	[PCM_XRUN_RESTART] = "restart",
+	[PCM_XRUN_FAIL] = "fail",
+	[PCM_XRUN_SILENCE] = "silence",
+	[PCM_XRUN_SKIP] = "skip",
+};
+
+#define NUM_POLICIES (sizeof(policy_names) / sizeof(policy_names[0]))
+
+int xrun_policy_parse(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_POLICIES; i++)
+		if (!strcmp(name, policy_names[i]))
+			return i;
+
+	return -1;
+}
+
+const char *xrun_policy_name(int policy)
+{
+	if ((policy < 0) || (policy >= (int)NUM_POLICIES))
+		return "unknown";
+	return policy_names[policy];
+}
+
+int xrun_setup(struct pcm *pcm, int policy, unsigned int log_size)
+{
+	if (pcm_set_xrun_policy(pcm, policy) ||
+	    pcm_set_xrun_log(pcm, log_size)) {
+		fprintf(stderr, "Unable to set up xrun recovery (%s)\n",
+			pcm_get_error(pcm));
+		return -1;
+	}
+	return 0;
+}
+
+void xrun_report(struct pcm *pcm, const char *label)
+{
+	struct pcm_xrun *xruns;
+	unsigned int count = pcm_get_underruns(pcm), kept, i;
+
+	if (!count)
+		return;
+
+	/* at exit, allocating is fine */
+	xruns = malloc(count * sizeof(*xruns));
+	if (!xruns)
+		return;
+	kept = pcm_get_xruns(pcm, xruns, count);
+
+	printf("%s: %u xruns", label, count);
+	if (kept < count)
+		printf(", the last %u", kept);
+	printf("%s\n", kept ? ":" : "");
+	for (i = 0; i < kept; i++)
+		printf("  %ld.%09ld s: hw_ptr %lu, appl_ptr %lu, %lu frames lost, "
+		       "%lu skipped\n", (long)xruns[i].tstamp.tv_sec,
+		       xruns[i].tstamp.tv_nsec, xruns[i].hw_ptr,
+		       xruns[i].appl_ptr, xruns[i].lost, xruns[i].skipped);
+	free(xruns);
+}